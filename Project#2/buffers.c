@@ -0,0 +1,236 @@
+#include "tips.h"
+
+/******************************************************************************
+   Victim caches, write buffers and MSHRs
+
+   Two optional buffers sit beside a level, between it and the level below:
+
+     victim cache - a small fully associative LRU cache that catches the
+                    blocks the level evicts, and is searched when the level
+                    misses before the level below is.  A hit swaps the block
+                    back into the level.  Exclusive levels have none, since
+                    the level above already keeps their blocks apart, nor do
+                    sectored levels, whose blocks may be partly missing.
+     write buffer - holds the write-throughs and write-backs the level sends
+                    down, one entry per block of the level.  A write to a
+                    block already buffered is merged into its entry; a write
+                    that finds the buffer full first drains the oldest entry.
+                    Entries a read from below overlaps are drained first.
+
+   In cycle mode, the level accesses enter the hierarchy at also has miss
+   status holding registers (MSHRs) that track its outstanding misses, so
+   that it can serve hits and further misses while they are in flight.
+
+   The cache logic moves the data (see cachelogic.c); this file keeps the
+   lines and entries, and prints them.
+ *****************************************************************************/
+
+/*
+  Empties the victim cache and write buffer of a level, as configured by
+  level->victim_lines and level->write_buffer_depth.  Called when the level
+  is flushed; buffered writes are dropped like the dirty blocks of the level.
+
+  returns 0 if successful, non-zero if they could not be allocated.
+*/
+int reset_level_buffers(cacheLevel* level)
+{
+  unsigned int victim_lines = (level->inclusion == EXCLUSIVE || SECTOR_SIZE(level) < level->block_size) ? 0 : level->victim_lines;
+
+  free_level_buffers(level);
+
+  if(victim_lines != 0 && (level->victim = (victimLine*)calloc(victim_lines, sizeof(victimLine))) == NULL)
+    return -1;
+  if(level->write_buffer_depth != 0 &&
+     (level->write_buffer = (writeBufferEntry*)calloc(level->write_buffer_depth, sizeof(writeBufferEntry))) == NULL)
+  {
+    free_level_buffers(level);
+    return -1;
+  }
+
+  return 0;
+}
+
+void free_level_buffers(cacheLevel* level)
+{
+  free(level->victim);
+  free(level->write_buffer);
+  level->victim = NULL;
+  level->write_buffer = NULL;
+  level->write_buffer_count = 0;
+  level->buffer_clock = 0;
+}
+
+/* returns the line of the victim cache holding block, or NULL */
+victimLine* find_victim_line(cacheLevel* level, address block)
+{
+  unsigned int i;
+
+  if(level->victim == NULL)
+    return NULL;
+
+  for(i = 0; i < level->victim_lines; i++)
+  {
+    if(level->victim[i].valid && level->victim[i].block == block)
+      return &level->victim[i];
+  }
+
+  return NULL;
+}
+
+/*
+  Returns the line of the victim cache an evicted block goes into: an empty
+  one, else the least recently filled.  The caller moves a valid line out
+  of the way before reusing it.
+*/
+victimLine* victim_slot(cacheLevel* level)
+{
+  victimLine* slot;
+  unsigned int i;
+
+  if(level->victim == NULL)
+    return NULL;
+
+  slot = &level->victim[0];
+  for(i = 0; i < level->victim_lines; i++)
+  {
+    if(!level->victim[i].valid)
+      return &level->victim[i];
+    if(level->victim[i].used < slot->used)
+      slot = &level->victim[i];
+  }
+
+  return slot;
+}
+
+/* returns the entry of the write buffer for block, or NULL */
+writeBufferEntry* find_write_entry(cacheLevel* level, address block)
+{
+  unsigned int i;
+
+  for(i = 0; i < level->write_buffer_count; i++)
+  {
+    if(level->write_buffer[i].block == block)
+      return &level->write_buffer[i];
+  }
+
+  return NULL;
+}
+
+/* Removes the entry at position i of the write buffer, keeping the rest in age order */
+void remove_write_entry(cacheLevel* level, unsigned int i)
+{
+  memmove(&level->write_buffer[i], &level->write_buffer[i + 1], (level->write_buffer_count - i - 1) * sizeof(writeBufferEntry));
+  level->write_buffer_count--;
+}
+
+/* Prints the victim cache and write buffer of a level, if it has any */
+void report_level_buffers(const cacheLevel* level, FILE* out)
+{
+  const writeBufferEntry* entry;
+  unsigned int i, w;
+
+  if(level->victim != NULL)
+  {
+    fprintf(out, "%s victim cache (%u lines)\nLine V D  Block\n", level->name, level->victim_lines);
+    for(i = 0; i < level->victim_lines; i++)
+    {
+      fprintf(out, "%4u %d %d  ", i, level->victim[i].valid, level->victim[i].dirty);
+      if(level->victim[i].valid)
+	fprintf(out, "%08x", level->victim[i].block);
+      fprintf(out, "\n");
+    }
+  }
+
+  if(level->write_buffer != NULL)
+  {
+    fprintf(out, "%s write buffer (%u of %u entries, oldest first)\nEntry  Block     Words\n", level->name,
+	    level->write_buffer_count, level->write_buffer_depth);
+    for(i = 0; i < level->write_buffer_count; i++)
+    {
+      entry = &level->write_buffer[i];
+      fprintf(out, "%5u  %08x  ", i, entry->block);
+      for(w = 0; w < level->block_size / sizeof(word); w++)
+	fprintf(out, "%c", (entry->words & (1u << w)) ? 'W' : '.');
+      fprintf(out, "\n");
+    }
+  }
+}
+
+/*
+  Empties the MSHRs of a level, as configured by level->mshrs.  Called when
+  the level is flushed; misses in flight are dropped with the blocks.
+
+  returns 0 if successful, non-zero if they could not be allocated.
+*/
+int reset_mshrs(cacheLevel* level)
+{
+  free_mshrs(level);
+
+  if(level->mshrs != 0 && (level->mshr = (mshrEntry*)calloc(level->mshrs, sizeof(mshrEntry))) == NULL)
+    return -1;
+
+  return 0;
+}
+
+void free_mshrs(cacheLevel* level)
+{
+  free(level->mshr);
+  level->mshr = NULL;
+}
+
+/* returns the MSHR of a miss to block still outstanding at cycle now, or NULL */
+mshrEntry* find_mshr(cacheLevel* level, address block, unsigned long long now)
+{
+  unsigned int i;
+
+  if(level->mshr == NULL)
+    return NULL;
+
+  for(i = 0; i < level->mshrs; i++)
+  {
+    if(level->mshr[i].ready > now && level->mshr[i].block == block)
+      return &level->mshr[i];
+  }
+
+  return NULL;
+}
+
+/*
+  Returns the MSHR a new miss at cycle now goes into: a free one, else the
+  one that frees first, whose ready cycle the miss waits for.  NULL if the
+  level has none.
+*/
+mshrEntry* mshr_slot(cacheLevel* level, unsigned long long now)
+{
+  mshrEntry* slot;
+  unsigned int i;
+
+  if(level->mshr == NULL)
+    return NULL;
+
+  slot = &level->mshr[0];
+  for(i = 0; i < level->mshrs; i++)
+  {
+    if(level->mshr[i].ready <= now)
+      return &level->mshr[i];
+    if(level->mshr[i].ready < slot->ready)
+      slot = &level->mshr[i];
+  }
+
+  return slot;
+}
+
+/* returns the misses of a level outstanding at cycle now */
+unsigned int outstanding_mshrs(const cacheLevel* level, unsigned long long now)
+{
+  unsigned int count = 0;
+  unsigned int i;
+
+  if(level->mshr == NULL)
+    return 0;
+
+  for(i = 0; i < level->mshrs; i++)
+    count += level->mshr[i].ready > now;
+
+  return count;
+}
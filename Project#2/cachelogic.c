@@ -1,7 +1,5 @@
 #include "tips.h"
 
-void handlePolicy(unsigned int* lruIndex, unsigned int* lruValue);
-
 /* The following two functions are defined in util.c */
 
 /* finds the highest 1 bit, and returns its position, else 0xFFFFFFFF */
@@ -44,154 +42,942 @@ char* lru_to_string(int assoc_index, int block_index)
   return buffer;
 }
 
+// Address decomposition for a level
+#define OFFSET_VALUE(level, addr) ((addr) & ((level)->block_size - 1))
+#define INDEX_VALUE(level, addr) (((addr) >> (level)->offset_bits) & ((level)->set_count - 1))
+#define TAG_VALUE(level, addr) ((addr) >> ((level)->offset_bits + (level)->index_bits))
+
+// Sectors of a level's blocks; a block that is not sectored is one sector
+#define SECTOR_COUNT(level) ((level)->block_size / SECTOR_SIZE(level))
+#define ALL_SECTORS(level) ((1u << SECTOR_COUNT(level)) - 1)
+
+// Accesses that entered a hierarchy so far, the clock prefetches are timed with
+#define ACCESS_CLOCK(h) ((h)->accesses[IFETCH] + (h)->accesses[LOAD] + (h)->accesses[STORE])
+
+// Only the L1 data (or unified) level of the CPU's hierarchy is drawn in the cache display,
+// and only when the GUI is up; without it nothing is highlighted
+#define IS_DISPLAYED(level) (IS_GUI_ACTIVE() && (level)->hierarchy->displayed && (level) == &(level)->hierarchy->level[L1D])
+
+static void access_level(cacheLevel* level, address addr, byte* data, unsigned int size, WriteEnable we, AccessType type);
+static void insert_block(cacheLevel* level, address addr, byte* data, int dirty);
+
+// Determine the accessDRAM transfer mode moving size bytes
+static TransferUnit transfer_unit(unsigned int size)
+{
+  switch (size) {
+    case 1:
+      return BYTE_SIZE;
+    case 2:
+      return HALF_WORD_SIZE;
+    case 4:
+      return WORD_SIZE;
+    case 8:
+      return DOUBLEWORD_SIZE;
+    case 16:
+      return QUADWORD_SIZE;
+    default:
+      return OCTWORD_SIZE;
+  }
+}
+
+// Send a request to a level of the hierarchy, or to DRAM below the last level
+static void access_next(cacheHierarchy* h, cacheLevel* next, address addr, byte* data, unsigned int size, WriteEnable we, AccessType type)
+{
+  unsigned int latency;
+
+  if (next == NULL) {
+    if (we == READ) {
+      h->dram_reads += size;
+      h->dram_read_transfers++;
+    } else {
+      h->dram_writes += size;
+      h->dram_write_transfers++;
+    }
+    if (h->dram != NULL) {
+      h->dram(addr, data, transfer_unit(size), we);
+    }
+    if (h->timed) {
+      // The reads of a demand access wait for DRAM; dram_request() is the fixed latency without the model
+      latency = dram_request(h, addr, we, h->cycle + h->demand_cycles);
+      if (h->demand && we == READ) {
+        h->demand_cycles += latency;
+      }
+    } else if (h->dram_timing != NULL) {
+      // Time it as if the CPU made one access per cycle and waited for DRAM reads
+      dram_request(h, addr, we, ACCESS_CLOCK(h) + h->dram_read_cycles);
+    }
+  } else if (we == WRITE && h->demand) {
+    // Writes sent down are off the critical path of the demand access, even when they miss
+    h->demand = 0;
+    access_level(next, addr, data, size, we, type);
+    h->demand = 1;
+  } else {
+    access_level(next, addr, data, size, we, type);
+  }
+}
+
+// Write one write buffer entry to the level below: whole blocks at once, else word by word
+static void drain_write_entry(cacheLevel* level, unsigned int i)
+{
+  writeBufferEntry* entry = &level->write_buffer[i];
+  unsigned int words = level->block_size / sizeof(word);
+
+  level->write_buffer_drains++;
+  if (entry->words == (1u << words) - 1) {
+    access_next(level->hierarchy, level->next, entry->block, entry->data, level->block_size, WRITE, DATA_ACCESS);
+  } else {
+    for (unsigned int w = 0; w < words; w++) {
+      if (entry->words & (1u << w)) {
+        access_next(level->hierarchy, level->next, entry->block + w * sizeof(word), entry->data + w * sizeof(word), sizeof(word), WRITE, DATA_ACCESS);
+      }
+    }
+  }
+
+  remove_write_entry(level, i);
+}
+
+// Drain the write buffer entries of a level overlapping [addr, addr + size), before that range is read from below
+static void drain_overlapping(cacheLevel* level, address addr, unsigned int size)
+{
+  unsigned int i = 0;
+
+  while (i < level->write_buffer_count) {
+    if (level->write_buffer[i].block < addr + size && addr < level->write_buffer[i].block + level->block_size) {
+      level->read_drains++;
+      drain_write_entry(level, i);
+    } else {
+      i++;
+    }
+  }
+}
+
+// Put a write from a level to the level below into its write buffer
+static void buffer_write(cacheLevel* level, address addr, byte* data, unsigned int size)
+{
+  address blockAddr = addr & ~(level->block_size - 1);
+  writeBufferEntry* entry = find_write_entry(level, blockAddr);
+
+  level->buffered_writes++;
+  if (entry != NULL) {
+    level->merged_writes++;
+  } else {
+    if (level->write_buffer_count == level->write_buffer_depth) {
+      level->full_drains++;
+      drain_write_entry(level, 0);
+    }
+    entry = &level->write_buffer[level->write_buffer_count++];
+    entry->block = blockAddr;
+    entry->words = 0;
+  }
+
+  memcpy(entry->data + (addr - blockAddr), data, size);
+  for (address a = addr; a < addr + size; a += sizeof(word)) {
+    entry->words |= 1u << ((a - blockAddr) / sizeof(word));
+  }
+}
+
+// Send a request from a level to the level below it, through its write buffer if it has one
+static void access_below(cacheLevel* level, address addr, byte* data, unsigned int size, WriteEnable we, AccessType type)
+{
+  if (level->write_buffer == NULL) {
+    access_next(level->hierarchy, level->next, addr, data, size, we, type);
+  } else if (we == WRITE) {
+    buffer_write(level, addr, data, size);
+  } else {
+    drain_overlapping(level, addr, size);
+    access_next(level->hierarchy, level->next, addr, data, size, READ, type);
+  }
+}
+
+// Rebuild the address of the first byte of a block from its tag and index
+static address block_address(cacheLevel* level, unsigned int indexValue, unsigned int blockIndex)
+{
+  return ((level->set[indexValue].tag[blockIndex] << level->index_bits) | indexValue) << level->offset_bits;
+}
+
+// Sectors of a level holding any of the bytes [offset, offset + size) of a block
+static unsigned int sector_mask(cacheLevel* level, unsigned int offset, unsigned int size)
+{
+  unsigned int first = offset / SECTOR_SIZE(level);
+  unsigned int last = (offset + size - 1) / SECTOR_SIZE(level);
+
+  return ((2u << last) - 1) & ~((1u << first) - 1);
+}
+
+// Sectors of a level entirely inside the bytes [offset, offset + size) of a block
+static unsigned int covered_sectors(cacheLevel* level, unsigned int offset, unsigned int size)
+{
+  unsigned int first = (offset + SECTOR_SIZE(level) - 1) / SECTOR_SIZE(level);
+  unsigned int end = (offset + size) / SECTOR_SIZE(level);
+
+  return end > first ? ((1u << end) - 1) & ~((1u << first) - 1) : 0;
+}
+
+// Count a lookup of addr in a level, for its totals, its set, the kind of access and the class of miss
+static void count_lookup(cacheLevel* level, unsigned int indexValue, address addr, AccessType type, WriteEnable we, int hit)
+{
+  MissClass missClass = classify_lookup(level, addr, hit);
+
+  if (hit) {
+    level->hits++;
+    level->kind_hits[ACCESS_KIND(type, we)]++;
+    level->set[indexValue].hits++;
+  } else {
+    level->misses++;
+    level->kind_misses[ACCESS_KIND(type, we)]++;
+    level->set[indexValue].misses++;
+    if (missClass != MISS_CLASS_COUNT) {
+      level->miss_classes[missClass]++;
+      level->set[indexValue].miss_classes[missClass]++;
+    }
+  }
+}
+
+// Count a lookup that found the block of addr but not all the sectors it needs, as a miss outside the three Cs
+static void count_sector_miss(cacheLevel* level, unsigned int indexValue, address addr, AccessType type, WriteEnable we)
+{
+  classify_lookup(level, addr, 1);
+  level->misses++;
+  level->sector_misses++;
+  level->kind_misses[ACCESS_KIND(type, we)]++;
+  level->set[indexValue].misses++;
+}
+
+// Get block to replace based on policy; invalid blocks are always used first
+static unsigned int choose_victim(cacheLevel* level, unsigned int indexValue)
+{
+  cacheSet* set = &level->set[indexValue];
+
+  for (int i = 0; i < level->assoc; i++) {
+    if (set->block[i].valid == INVALID) {
+      return i;
+    }
+  }
+
+  return replacement_policies[level->policy].choose_victim(level, indexValue);
+}
+
+// Drop a block from a level without writing it anywhere
+static void invalidate_block(cacheLevel* level, unsigned int indexValue, unsigned int blockIndex)
+{
+  level->set[indexValue].tag[blockIndex] = INVALID_TAG;
+  level->set[indexValue].block[blockIndex].valid = INVALID;
+  level->set[indexValue].block[blockIndex].dirty = VIRGIN;
+  level->set[indexValue].block[blockIndex].sector_valid = 0;
+  level->set[indexValue].block[blockIndex].sector_dirty = 0;
+  level->set[indexValue].block[blockIndex].prefetched = 0;
+}
+
 /*
-  This function initializes the lfu information
+  Removes the block [addr, addr + size) from every level above level, so an
+  inclusive level can evict it.  Dirty data found above is newer than the
+  copy in data, and is merged into it; bit i of dirty_words is set for each
+  word i of data merged.  Levels closer to the CPU are merged last since they
+  hold the most recent data.
 
-    assoc_index - the cache unit that contains the block to be modified
-    block_number - the index of the block to be modified
+  returns the number of blocks invalidated
+*/
+static unsigned int invalidate_upper(cacheLevel* level, address addr, unsigned int size, byte* data, unsigned int* dirty_words)
+{
+  cacheLevel* upper;
+  cacheBlock* block;
+  victimLine* line;
+  unsigned int indexValue;
+  unsigned int invalidated = 0;
+  unsigned int offset;
+  int blockIndex;
+
+  for (int id = L1I; id < LEVEL_COUNT; id++) {
+    upper = &level->hierarchy->level[id];
+    if (upper->next != level || !LEVEL_ENABLED(upper)) {
+      continue;
+    }
+
+    for (address a = addr; a < addr + size; a += upper->block_size) {
+      indexValue = INDEX_VALUE(upper, a);
+      blockIndex = match_tag(&upper->set[indexValue], TAG_VALUE(upper, a), upper->assoc);
+      if (blockIndex >= 0) {
+        // Only the dirty sectors of a sectored block are known to be newer
+        block = &upper->set[indexValue].block[blockIndex];
+        for (unsigned int s = 0; s < SECTOR_COUNT(upper); s++) {
+          if (block->sector_dirty & (1u << s)) {
+            offset = a - addr + s * SECTOR_SIZE(upper);
+            memcpy(data + offset, block->data + s * SECTOR_SIZE(upper), SECTOR_SIZE(upper));
+            *dirty_words |= ((1u << (SECTOR_SIZE(upper) / sizeof(word))) - 1) << (offset / sizeof(word));
+          }
+        }
+        invalidate_block(upper, indexValue, blockIndex);
+        invalidated++;
+      }
+      if ((line = find_victim_line(upper, a)) != NULL) {
+        if (line->dirty) {
+          memcpy(data + (a - addr), line->data, upper->block_size);
+          *dirty_words |= ((1u << (upper->block_size / sizeof(word))) - 1) << ((a - addr) / sizeof(word));
+        }
+        line->valid = 0;
+        invalidated++;
+      }
+    }
+
+    invalidated += invalidate_upper(upper, addr, size, data, dirty_words);
+  }
 
+  return invalidated;
+}
+
+/*
+  Sends a block that leaves a level down: dirty blocks are written back to the
+  next level, only their dirty sectors when sectored; when the next level is
+  exclusive every block moves down into it instead.
 */
-void init_lfu(int assoc_index, int block_index)
+static void retire_block(cacheLevel* level, address blockAddr, byte* data, unsigned int dirtySectors)
 {
-  cache[assoc_index].block[block_index].accessCount = 0;
+  if (level->next != NULL && level->next->inclusion == EXCLUSIVE) {
+    drain_overlapping(level, blockAddr, level->block_size);
+    insert_block(level->next, blockAddr, data, dirtySectors != 0);
+  } else if (dirtySectors == ALL_SECTORS(level)) {
+    // Write-back to next level
+    level->write_backs++;
+    access_below(level, blockAddr, data, level->block_size, WRITE, DATA_ACCESS);
+  } else if (dirtySectors != 0) {
+    level->write_backs++;
+    for (unsigned int s = 0; s < SECTOR_COUNT(level); s++) {
+      if (dirtySectors & (1u << s)) {
+        access_below(level, blockAddr + s * SECTOR_SIZE(level), data + s * SECTOR_SIZE(level), SECTOR_SIZE(level), WRITE, DATA_ACCESS);
+      }
+    }
+  }
+}
+
+// Catch a block evicted from a level in its victim cache, retiring the line it replaces
+static void push_victim(cacheLevel* level, address blockAddr, byte* data, unsigned int dirtySectors)
+{
+  victimLine* line = victim_slot(level);
+
+  if (line->valid) {
+    level->victim_evictions++;
+    retire_block(level, line->block, line->data, line->dirty);
+  }
+
+  line->block = blockAddr;
+  line->dirty = dirtySectors;
+  line->valid = 1;
+  line->used = ++level->buffer_clock;
+  memcpy(line->data, data, level->block_size);
 }
 
 /*
-  This function initializes the lru information
+  Makes room in a level by evicting a block, into the victim cache of the
+  level if it has one.
+*/
+static void evict_block(cacheLevel* level, unsigned int indexValue, unsigned int blockIndex)
+{
+  cacheBlock* block = &level->set[indexValue].block[blockIndex];
+  address victim;
+  unsigned int dirtyWords = 0;
+  unsigned int dirtySectors;
 
-    assoc_index - the cache unit that contains the block to be modified
-    block_number - the index of the block to be modified
+  if (block->valid == INVALID) {
+    return;
+  }
 
+  victim = block_address(level, indexValue, blockIndex);
+  level->evictions++;
+  if (block->prefetched) {
+    level->useless_prefetches++;
+  }
+
+  // An inclusive level may not lose a block still held above it
+  if (level->inclusion == INCLUSIVE) {
+    level->back_invalidations += invalidate_upper(level, victim, level->block_size, block->data, &dirtyWords);
+  }
+
+  // Words merged from above make their sectors dirty
+  dirtySectors = block->sector_dirty;
+  for (unsigned int w = 0; w < level->block_size / sizeof(word); w++) {
+    if (dirtyWords & (1u << w)) {
+      dirtySectors |= sector_mask(level, w * sizeof(word), sizeof(word));
+    }
+  }
+
+  if (level->victim != NULL) {
+    push_victim(level, victim, block->data, dirtySectors);
+  } else {
+    retire_block(level, victim, block->data, dirtySectors);
+  }
+
+  invalidate_block(level, indexValue, blockIndex);
+}
+
+/*
+  Places a block into a level, evicting whatever it replaces.  With no data
+  none of its sectors are valid yet; dirtySectors are those newer than below.
 */
-void init_lru(int assoc_index, int block_index)
+static unsigned int fill_block(cacheLevel* level, address addr, byte* data, unsigned int dirtySectors)
 {
-  cache[assoc_index].block[block_index].lru.value = 0;
+  unsigned int indexValue = INDEX_VALUE(level, addr);
+  unsigned int blockIndex = choose_victim(level, indexValue);
+  cacheBlock* block = &level->set[indexValue].block[blockIndex];
+
+  evict_block(level, indexValue, blockIndex);
+
+  if (data != NULL) {
+    memcpy(block->data, data, level->block_size);
+  }
+  level->set[indexValue].tag[blockIndex] = TAG_VALUE(level, addr);
+  block->valid = VALID;
+  block->dirty = dirtySectors ? DIRTY : VIRGIN;
+  block->sector_valid = data != NULL ? ALL_SECTORS(level) : 0;
+  block->sector_dirty = dirtySectors;
+  block->prefetched = 0;
+  replacement_policies[level->policy].on_fill(level, indexValue, blockIndex);
+
+  return blockIndex;
 }
 
 /*
-  This is the primary function you are filling out,
-  You are free to add helper functions if you need them
+  Takes a block out of an exclusive level for the level above it.  On a miss
+  the block is read from further down without being allocated here.
 
-  @param addr 32-bit byte address
-  @param data a pointer to a SINGLE word (32-bits of data)
-  @param we   if we == READ, then data used to return
-              information back to CPU
+  returns non-zero if the block is dirty with respect to DRAM
+*/
+static int extract_block(cacheLevel* level, address addr, byte* data, unsigned int size, AccessType type)
+{
+  unsigned int indexValue = INDEX_VALUE(level, addr);
+  int blockIndex = match_tag(&level->set[indexValue], TAG_VALUE(level, addr), level->assoc);
+  int dirty;
+
+  if (blockIndex < 0) {
+    count_lookup(level, indexValue, addr, type, READ, 0);
+    if (level->next != NULL && level->next->inclusion == EXCLUSIVE) {
+      drain_overlapping(level, addr, size);
+      return extract_block(level->next, addr, data, size, type);
+    }
+    access_below(level, addr, data, size, READ, type);
+    return 0;
+  }
 
-              if we == WRITE, then data used to
-              update Cache/DRAM
+  count_lookup(level, indexValue, addr, type, READ, 1);
+  memcpy(data, level->set[indexValue].block[blockIndex].data, size);
+  dirty = (level->set[indexValue].block[blockIndex].dirty == DIRTY);
+  invalidate_block(level, indexValue, blockIndex);
+  return dirty;
+}
+
+// Receive a block evicted from the level above an exclusive level
+static void insert_block(cacheLevel* level, address addr, byte* data, int dirty)
+{
+  unsigned int indexValue = INDEX_VALUE(level, addr);
+  int blockIndex = match_tag(&level->set[indexValue], TAG_VALUE(level, addr), level->assoc);
+
+  // A split L1 may hand down a block this level already took from the other half
+  if (blockIndex >= 0) {
+    if (dirty) {
+      memcpy(level->set[indexValue].block[blockIndex].data, data, level->block_size);
+      level->set[indexValue].block[blockIndex].dirty = DIRTY;
+      level->set[indexValue].block[blockIndex].sector_valid = ALL_SECTORS(level);
+      level->set[indexValue].block[blockIndex].sector_dirty = ALL_SECTORS(level);
+    }
+    replacement_policies[level->policy].on_hit(level, indexValue, blockIndex);
+  } else {
+    fill_block(level, addr, data, dirty ? ALL_SECTORS(level) : 0);
+  }
+}
+
+// Read a block missing from a level out of the next level, into the block it replaces
+static unsigned int fetch_block(cacheLevel* level, address blockAddr, AccessType type)
+{
+  unsigned int blockIndex = fill_block(level, blockAddr, NULL, 0);
+  cacheBlock* block = &level->set[INDEX_VALUE(level, blockAddr)].block[blockIndex];
+
+  if (level->next != NULL && level->next->inclusion == EXCLUSIVE) {
+    drain_overlapping(level, blockAddr, level->block_size);
+    if (extract_block(level->next, blockAddr, block->data, level->block_size, type)) {
+      block->dirty = DIRTY;
+      block->sector_dirty = ALL_SECTORS(level);
+    }
+  } else {
+    access_below(level, blockAddr, block->data, level->block_size, READ, type);
+  }
+  block->sector_valid = ALL_SECTORS(level);
+
+  return blockIndex;
+}
+
+/*
+  Reads the sectors of a block a level is missing out of the next level.
+  Sectors in skip are about to be overwritten whole, so they are only
+  marked valid.
 */
-void accessMemory(address addr, word* data, WriteEnable we)
+static void fetch_sectors(cacheLevel* level, unsigned int indexValue, unsigned int blockIndex, unsigned int sectors, unsigned int skip, AccessType type)
+{
+  cacheBlock* block = &level->set[indexValue].block[blockIndex];
+  address blockAddr = block_address(level, indexValue, blockIndex);
+  unsigned int missing = sectors & ~skip & ~block->sector_valid;
+
+  for (unsigned int s = 0; s < SECTOR_COUNT(level); s++) {
+    if (missing & (1u << s)) {
+      access_below(level, blockAddr + s * SECTOR_SIZE(level), block->data + s * SECTOR_SIZE(level), SECTOR_SIZE(level), READ, type);
+    }
+  }
+  block->sector_valid |= sectors;
+}
+
+/*
+  Counts the first demand use of a prefetched block.  issued is the access
+  clock when it was prefetched, plus one.  Without a timing model a prefetch
+  is late when fewer accesses separate it from its use than the cycles a fill
+  from the level below takes, as if one access were made per cycle.
+*/
+static void use_prefetch(cacheLevel* level, unsigned long long issued)
+{
+  unsigned long long lead = ACCESS_CLOCK(level->hierarchy) + 1 - issued;
+
+  level->useful_prefetches++;
+  level->prefetch_lead += lead;
+  if (lead < level_amat(level->hierarchy, level->next)) {
+    level->late_prefetches++;
+  }
+}
+
+// Bring a block into a level, or its prefetch buffer, ahead of any demand for it
+static void prefetch_block(cacheLevel* level, address blockAddr, AccessType type)
 {
-  /* Declare variables here */
-  unsigned int indexBits, offsetBits;
-  unsigned int indexValue, offsetValue, tagValue;
-  unsigned int blockHit, blockIndex;
-  TransferUnit transferSize;
+  unsigned int indexValue = INDEX_VALUE(level, blockAddr);
+  unsigned int blockIndex;
+  prefetchLine* line;
+  int demand = level->hierarchy->demand;
 
-  /* handle the case of no cache at all - leave this in */
-  if(assoc == 0) {
-    accessDRAM(addr, (byte*)data, WORD_SIZE, we);
+  if (match_tag(&level->set[indexValue], TAG_VALUE(level, blockAddr), level->assoc) >= 0 ||
+      find_prefetched_line(level, blockAddr) != NULL || find_victim_line(level, blockAddr) != NULL) {
     return;
   }
 
-  // Calculate number of bits
-  offsetBits = uint_log2(block_size);
-  indexBits = uint_log2(set_count);
-  // unsigned int tagBits = 32 - indexBits - offsetBits;
+  // The demand access does not wait for its prefetches
+  level->hierarchy->demand = 0;
+
+  level->prefetches++;
+  if (level->prefetch.buffer_lines == 0) {
+    blockIndex = fetch_block(level, blockAddr, type);
+    level->set[indexValue].block[blockIndex].prefetched = ACCESS_CLOCK(level->hierarchy) + 1;
+  } else if ((line = prefetch_buffer_slot(level)) != NULL) {
+    // A copy is read even from an exclusive level, so the buffer never holds dirty data
+    access_below(level, blockAddr, line->data, level->block_size, READ, type);
+    line->block = blockAddr;
+    line->issued = ACCESS_CLOCK(level->hierarchy) + 1;
+    line->valid = 1;
+  }
+  level->hierarchy->demand = demand;
+}
 
-  // Calculate value of bits
-  offsetValue = addr & ((1 << offsetBits) - 1); // Determines offset within a block
-  indexValue = (addr >> offsetBits) & ((1 << indexBits) - 1); // Determines which cache set
-  tagValue = addr >> (indexBits + offsetBits); // Determines if there is a block match
+// Train the prefetcher of a level with a demand access, and issue what it asks for
+static void run_prefetcher(cacheLevel* level, address addr, int trigger, AccessType type)
+{
+  address blocks[MAX_PREFETCH_DEGREE];
+  unsigned int count = predict_prefetches(level, level->hierarchy->pc, addr, type, trigger, blocks);
 
-  // Determine amount of bytes to transfer
-  switch (block_size) {
-    case 4:
-      transferSize = WORD_SIZE;
-      break;
-    case 8:
-      transferSize = DOUBLEWORD_SIZE;
-      break;
-    case 16:
-      transferSize = QUADWORD_SIZE;
-      break;
-    case 32:
-      transferSize = OCTWORD_SIZE;
-      break;
-  }
-
-  blockHit = 0; // Defaultly assume miss
-  // Determine if hit
-  for (int i = 0; i < assoc; i++) {
-    // Hit
-    if (tagValue == cache[indexValue].block[i].tag && cache[indexValue].block[i].valid == VALID) {
-      blockHit = 1; // Set as hit
-      blockIndex = i; // Save block index
-      highlight_offset(indexValue, blockIndex, offsetValue, HIT); // Highlight hit
-      break;
+  for (unsigned int i = 0; i < count; i++) {
+    prefetch_block(level, blocks[i], type);
+  }
+}
+
+/*
+  Moves size bytes between the requester and a level.  size is a power of two
+  and addr is aligned to it, so a request no larger than a block lies in a
+  single block; larger requests (from a level with bigger blocks above) are
+  split into blocks.
+*/
+static void access_level(cacheLevel* level, address addr, byte* data, unsigned int size, WriteEnable we, AccessType type)
+{
+  unsigned int indexValue, offsetValue, blockIndex;
+  cacheBlock* block;
+  prefetchLine* line;
+  victimLine* victimHit;
+  byte victimData[MAX_BLOCK_SIZE];
+  address blockAddr;
+  unsigned int sectors, skip;
+  int hitIndex;
+  int trigger = 0;
+  int demand = level->hierarchy->demand;
+
+  if (size > level->block_size) {
+    for (unsigned int i = 0; i < size; i += level->block_size) {
+      access_level(level, addr + i, data + i, level->block_size, we, type);
     }
+    return;
   }
 
-  // Miss
-  if (blockHit == 0) {
-    // Highlight Miss
-    highlight_offset(indexValue, blockIndex, offsetValue, MISS);
-    highlight_block(indexValue, blockIndex);
-
-    // Get block to replace based on policy
-    if (policy == RANDOM) {
-      // Get random block
-      blockIndex = randomint(assoc);
-    } else if (policy == LRU) {
-      // get LRU block
-      for (int i = 0; i < assoc; i++) {
-        if (cache[indexValue].block[i].lru.value == 0) {
-          blockIndex = cache[indexValue].block[i].lru.value;
-          break;
-        }
-      }
+  // A demand access in cycle mode waits for each level it reads from, one block at a time
+  if (demand && we == READ) {
+    level->hierarchy->demand_cycles += level->latency;
+  }
+
+  offsetValue = OFFSET_VALUE(level, addr); // Determines offset within a block
+  indexValue = INDEX_VALUE(level, addr); // Determines which cache set
+
+  // Determine if hit; invalid blocks hold INVALID_TAG so only the tags need comparing
+  hitIndex = match_tag(&level->set[indexValue], TAG_VALUE(level, addr), level->assoc);
+  blockAddr = addr & ~(level->block_size - 1);
+
+  // A write that covers whole sectors of a sectored level needs not read them first
+  sectors = sector_mask(level, offsetValue, size);
+  skip = (we == WRITE && SECTOR_COUNT(level) > 1) ? covered_sectors(level, offsetValue, size) : 0;
+
+  if (hitIndex >= 0 && (level->set[indexValue].block[hitIndex].sector_valid & sectors) != sectors) {
+    // The block is here but some of its sectors are not; only they are read
+    count_sector_miss(level, indexValue, addr, type, we);
+    blockIndex = hitIndex;
+    replacement_policies[level->policy].on_hit(level, indexValue, blockIndex);
+    fetch_sectors(level, indexValue, blockIndex, sectors, skip, type);
+    trigger = 1;
+    if (IS_DISPLAYED(level)) {
+      highlight_offset(indexValue, blockIndex, offsetValue, MISS);
+    }
+  } else if (hitIndex >= 0) {
+    count_lookup(level, indexValue, addr, type, we, 1);
+    blockIndex = hitIndex;
+    replacement_policies[level->policy].on_hit(level, indexValue, blockIndex);
+    block = &level->set[indexValue].block[blockIndex];
+    if (block->prefetched) {
+      use_prefetch(level, block->prefetched);
+      block->prefetched = 0;
+      trigger = 1;
+    }
+    if (IS_DISPLAYED(level)) {
+      highlight_offset(indexValue, blockIndex, offsetValue, HIT); // Highlight hit
+    }
+  } else if ((line = find_prefetched_line(level, blockAddr)) != NULL) {
+    // The prefetch buffer holds the block; it moves into the level
+    count_lookup(level, indexValue, addr, type, we, 1);
+    use_prefetch(level, line->issued);
+    line->valid = 0;
+    blockIndex = fill_block(level, blockAddr, line->data, 0);
+    trigger = 1;
+    if (IS_DISPLAYED(level)) {
+      highlight_offset(indexValue, blockIndex, offsetValue, HIT);
+      highlight_block(indexValue, blockIndex);
+    }
+  } else {
+    count_lookup(level, indexValue, addr, type, we, 0);
+    trigger = 1;
+
+    // Exclusive levels are only filled by blocks evicted from above
+    if (level->inclusion == EXCLUSIVE) {
+      access_below(level, addr, data, size, we, type);
+      return;
     }
 
-    // Write-back to DRAM
-    if (memory_sync_policy == WRITE_BACK && cache[indexValue].block[blockIndex].dirty == DIRTY) {
-      accessDRAM(addr, cache[indexValue].block[blockIndex].data, transferSize, WRITE);
+    if ((victimHit = find_victim_line(level, blockAddr)) != NULL) {
+      // Swap the block back out of the victim cache; the block it replaces takes its line
+      level->victim_hits++;
+      if (demand) {
+        level->hierarchy->demand_cycles += VICTIM_CACHE_LATENCY;
+      }
+      memcpy(victimData, victimHit->data, level->block_size);
+      victimHit->valid = 0;
+      blockIndex = fill_block(level, blockAddr, victimData, victimHit->dirty);
+    } else if (we == WRITE && level->allocation == NO_WRITE_ALLOCATE) {
+      // Write around the level
+      access_below(level, addr, data, size, WRITE, type);
+      if (level->prefetcher != NULL) {
+        run_prefetcher(level, addr, trigger, type);
+      }
+      return;
+    } else if (SECTOR_COUNT(level) > 1) {
+      blockIndex = fill_block(level, blockAddr, NULL, 0);
+      fetch_sectors(level, indexValue, blockIndex, sectors, skip, type);
+    } else {
+      blockIndex = fetch_block(level, blockAddr, type);
     }
 
-    // Read from DRAM to replace block
-    accessDRAM(addr, cache[indexValue].block[blockIndex].data, transferSize, READ);
-    cache[indexValue].block[blockIndex].tag = tagValue;
-    cache[indexValue].block[blockIndex].valid = VALID;
-    if (memory_sync_policy == WRITE_BACK) {
-      cache[indexValue].block[blockIndex].dirty = VIRGIN;
+    // Highlight Miss
+    if (IS_DISPLAYED(level)) {
+      highlight_offset(indexValue, blockIndex, offsetValue, MISS);
+      highlight_block(indexValue, blockIndex);
     }
   }
 
+  block = &level->set[indexValue].block[blockIndex];
   if (we == READ) {
     // Read from cache
-    memcpy(data, cache[indexValue].block[blockIndex].data + offsetValue, transferSize);
+    memcpy(data, block->data + offsetValue, size);
   } else if (we == WRITE) {
     // Write to cache
-    memcpy(cache[indexValue].block[blockIndex].data + offsetValue, data, transferSize);
-
-    // For future write-back to DRAM
-    if (memory_sync_policy == WRITE_BACK) {
-      cache[indexValue].block[blockIndex].dirty = DIRTY;
-    } else if (memory_sync_policy == WRITE_THROUGH) { // Write-through to DRAM
-      accessDRAM(addr, cache[indexValue].block[blockIndex].data, transferSize, WRITE);
+    memcpy(block->data + offsetValue, data, size);
+
+    // For future write-back to next level
+    if (level->memory_sync_policy == WRITE_BACK) {
+      block->dirty = DIRTY;
+      block->sector_dirty |= sectors;
+    } else if (level->memory_sync_policy == WRITE_THROUGH) { // Write-through to next level
+      level->write_throughs++;
+      access_below(level, addr, data, size, WRITE, type);
     }
   }
 
-  // Update LRU values, assoc - 1 means most recently used down to 0 which means least recently used (LRU); acts like a Jenga stack where you can pull from anywhere and put on top
-  if (policy == LRU) {
-    // Save LRU value that will be set to most recent
-    unsigned int oldLRU = cache[indexValue].block[blockIndex].lru.value;
-    // Decrement the LRU of all blocks above the oldLRU; this will lead to an order of LRUs from 0 to assoc - 1 if all blocks are used
-    for (int i = 0; i < assoc; i++) {
-      if (cache[indexValue].block[i].lru.value > oldLRU) { 
-        cache[indexValue].block[i].lru.value--;
+  if (level->prefetcher != NULL) {
+    run_prefetcher(level, addr, trigger, type);
+  }
+}
+
+// Write the dirty copy of a block held by a level back below it; one above an exclusive level moves down instead
+static void snoop_write_back(cacheLevel* level, address blockAddr, byte* data, unsigned int dirtySectors)
+{
+  if (level->next != NULL && level->next->inclusion == EXCLUSIVE) {
+    drain_overlapping(level, blockAddr, level->block_size);
+    insert_block(level->next, blockAddr, data, 1);
+  } else {
+    retire_block(level, blockAddr, data, dirtySectors);
+  }
+}
+
+// Snoop the blocks of one level inside [addr, addr + size), which is aligned to size
+static int snoop_level(cacheLevel* level, address addr, unsigned int size, SnoopAction action)
+{
+  unsigned int indexValue;
+  int blockIndex;
+  cacheBlock* block;
+  victimLine* victimHit;
+  prefetchLine* line;
+  int result = 0;
+  // A dirty copy above an exclusive level leaves the level as it moves down
+  int moves = level->next != NULL && level->next->inclusion == EXCLUSIVE;
+
+  for (address a = addr; a < addr + size; a += level->block_size) {
+    indexValue = INDEX_VALUE(level, a);
+    blockIndex = match_tag(&level->set[indexValue], TAG_VALUE(level, a), level->assoc);
+    if (blockIndex >= 0) {
+      block = &level->set[indexValue].block[blockIndex];
+      result |= SNOOP_HELD;
+      if (block->dirty == DIRTY) {
+        result |= SNOOP_DIRTY;
+        if (action != SNOOP_PROBE) {
+          snoop_write_back(level, a, block->data, block->sector_dirty);
+          block->dirty = VIRGIN;
+          block->sector_dirty = 0;
+          if (moves) {
+            invalidate_block(level, indexValue, blockIndex);
+          }
+        }
+      }
+      if (action == SNOOP_INVALIDATE && block->valid == VALID) {
+        if (block->prefetched) {
+          level->useless_prefetches++;
+        }
+        invalidate_block(level, indexValue, blockIndex);
+      }
+    }
+
+    if ((victimHit = find_victim_line(level, a)) != NULL) {
+      result |= SNOOP_HELD;
+      if (victimHit->dirty) {
+        result |= SNOOP_DIRTY;
+        if (action != SNOOP_PROBE) {
+          snoop_write_back(level, a, victimHit->data, victimHit->dirty);
+          victimHit->dirty = 0;
+          if (moves) {
+            victimHit->valid = 0;
+          }
+        }
+      }
+      if (action == SNOOP_INVALIDATE) {
+        victimHit->valid = 0;
+      }
+    }
+
+    if ((line = find_prefetched_line(level, a)) != NULL) {
+      result |= SNOOP_HELD;
+      if (action == SNOOP_INVALIDATE) {
+        level->useless_prefetches++;
+        line->valid = 0;
       }
     }
-    // Set LRU value to highest value/most recent
-    cache[indexValue].block[blockIndex].lru.value = assoc - 1;
+
+    // Buffered writes are the newest data of the block, after what the level itself just wrote back
+    if (find_write_entry(level, a) != NULL) {
+      result |= SNOOP_HELD | SNOOP_DIRTY;
+      for (unsigned int i = 0; action != SNOOP_PROBE && i < level->write_buffer_count; ) {
+        if (level->write_buffer[i].block == a) {
+          drain_write_entry(level, i);
+        } else {
+          i++;
+        }
+      }
+    }
+  }
+
+  return result;
+}
+
+/*
+  Looks for the bytes [addr, addr + size) in a hierarchy for a request of
+  another core (see multicore.c), and acts on the copies it finds:
+
+    SNOOP_PROBE - only looks
+    SNOOP_CLEAN - writes the dirty copies back so that DRAM is up to date,
+                  and keeps them clean
+    SNOOP_INVALIDATE - writes the dirty copies back and drops every copy
+
+  size is a power of two no smaller than any block, and addr is aligned to
+  it.  Levels are snooped from the top so that dirty data moves down in
+  order, through the write buffers of the levels below.
+
+  returns SNOOP_HELD if any copy was found, plus SNOOP_DIRTY if one was dirty
+*/
+int snoop_hierarchy(cacheHierarchy* h, address addr, unsigned int size, SnoopAction action)
+{
+  int result = 0;
+
+  for (int id = L1I; id < LEVEL_COUNT; id++) {
+    if (LEVEL_ENABLED(&h->level[id])) {
+      result |= snoop_level(&h->level[id], addr, size, action);
+    }
+  }
+
+  return result;
+}
+
+/*
+  Makes an access in cycle mode at h->cycle, and sets when the entry level
+  accepted it and when its data is ready.  The access itself is made right
+  away, as in the blocking model; only its timing depends on the MSHRs of
+  the entry level:
+
+    hit - ready after the latency of the level, even under other misses
+    miss to a block in flight - merged into its MSHR, ready with the block
+    other miss - takes a free MSHR, or waits for the first to free; ready
+                 after the latencies of the levels it read from and DRAM
+    any miss without MSHRs - accepted only once its data is ready
+*/
+static void timed_access(cacheHierarchy* h, cacheLevel* entry, address addr, byte* data, WriteEnable we, AccessType type)
+{
+  unsigned long long now = h->cycle;
+  unsigned long long start = now;
+  address blockAddr;
+  mshrEntry* pending;
+  mshrEntry* slot;
+
+  h->demand = 1;
+  h->demand_cycles = 0;
+
+  if (entry == NULL) {
+    access_next(h, NULL, addr, data, sizeof(word), we, type);
+    h->demand = 0;
+    h->accepted = now;
+    h->ready = now + h->demand_cycles;
+    return;
+  }
+
+  // Reads count the latency of every level they read from; a store only that of the entry level
+  if (we == WRITE) {
+    h->demand_cycles += entry->latency;
+  }
+
+  blockAddr = addr & ~(entry->block_size - 1);
+  pending = find_mshr(entry, blockAddr, now);
+  access_level(entry, addr, data, sizeof(word), we, type);
+  h->demand = 0;
+
+  if (pending != NULL) {
+    entry->mshr_merges++;
+    h->accepted = now;
+    h->ready = pending->ready > now + entry->latency ? pending->ready : now + entry->latency;
+  } else if (h->demand_cycles <= entry->latency) {
+    if (outstanding_mshrs(entry, now) != 0) {
+      entry->hits_under_miss++;
+    }
+    h->accepted = now;
+    h->ready = now + entry->latency;
+  } else if ((slot = mshr_slot(entry, now)) == NULL) {
+    // A blocking level takes nothing else until the miss is served
+    h->ready = now + h->demand_cycles;
+    h->accepted = h->ready;
+  } else {
+    if (slot->ready > now) {
+      entry->mshr_full_stalls++;
+      entry->mshr_stall_cycles += slot->ready - now;
+      start = slot->ready;
+    }
+    if (outstanding_mshrs(entry, start) != 0) {
+      entry->misses_under_miss++;
+    }
+    slot->block = blockAddr;
+    slot->ready = start + h->demand_cycles;
+    h->accepted = start;
+    h->ready = slot->ready;
+  }
+}
+
+/*
+  Entry point for every access to a hierarchy: instruction fetches start at
+  the L1 instruction cache when the L1 is split, loads and stores at the L1
+  data cache.  Any level that does not exist is skipped.  pc is the address
+  of the instruction making the access, for the per-PC profile.
+*/
+void access_hierarchy(cacheHierarchy* h, address pc, address addr, word* data, WriteEnable we, AccessType type)
+{
+  cacheLevel* entry = type == INSTRUCTION_FETCH ? h->instruction_cache : h->data_cache;
+  unsigned long long misses = entry ? entry->misses : 0;
+  unsigned long long dram_reads = h->dram_reads;
+
+  h->accesses[ACCESS_KIND(type, we)]++;
+  h->pc = pc;
+  if (h->timed) {
+    timed_access(h, entry, addr, (byte*)data, we, type);
+  } else {
+    access_next(h, entry, addr, (byte*)data, sizeof(word), we, type);
+  }
+
+  // With no cache at all every access is a miss
+  if (h->profile_pcs) {
+    profile_access(h, pc, type, entry == NULL || entry->misses != misses, h->dram_reads != dram_reads);
+  }
+}
+
+/*
+  Hands an access of the CPU or of a replayed trace to the analyses that are
+  recording; pc is the address of the instruction making it.
+*/
+void observe_access(address pc, address addr, WriteEnable we, AccessType type)
+{
+  if (stack_distance_active) {
+    record_stack_distance(addr, type);
+  }
+  if (sweep_recording) {
+    record_sweep_access(addr, we, type);
+  }
+  if (trace_recording) {
+    record_trace_access(pc, addr, we, type);
+  }
+}
+
+// The CPU's accesses go to the hierarchy of the core running, and to any analysis recording them
+void accessCache(address addr, word* data, WriteEnable we, AccessType type)
+{
+  // Loads and stores run after the PC moved past their instruction
+  address pc = type == INSTRUCTION_FETCH ? addr : PC - sizeof(instruction);
+
+  observe_access(pc, addr, we, type);
+  if (core_count > 1) {
+    coherent_access(pc, addr, data, we, type);
+  } else {
+    access_hierarchy(&memory_hierarchy, pc, addr, data, we, type);
   }
-}
\ No newline at end of file
+}
+
+/*
+  This is the primary function you are filling out,
+  You are free to add helper functions if you need them
+
+  @param addr 32-bit byte address
+  @param data a pointer to a SINGLE word (32-bits of data)
+  @param we   if we == READ, then data used to return
+              information back to CPU
+
+              if we == WRITE, then data used to
+              update Cache/DRAM
+*/
+void accessMemory(address addr, word* data, WriteEnable we)
+{
+  accessCache(addr, data, we, DATA_ACCESS);
+}
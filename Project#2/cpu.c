@@ -4,16 +4,49 @@
 word registers[32];
 word hilo[2];
 address PC;
+pipelineStats pipeline;
+
+/* Cycle the load in flight to each register has its data; see issue_timed() */
+static unsigned long long register_ready[32];
+
+/* The state of the cores not running at the moment; see switch_core() */
+typedef struct {
+  word registers[32];
+  word hilo[2];
+  address PC;
+  pipelineStats pipeline;
+  unsigned long long register_ready[32];
+} cpuContext;
+
+static cpuContext contexts[MAX_CORES];
+
+/* Non-zero for the cores that reached the end of the program */
+static int halted[MAX_CORES];
+
+/* An instruction as decoded by decode_inst(), and the PC it was fetched from */
+typedef struct _decodedInst {
+  address pc;
+  word inst;
+  unsigned int src;                         /* rs */
+  unsigned int tgt;                         /* rt */
+  unsigned int dst;                         /* rd */
+  unsigned int shamt;
+  word immed;                               /* extended, or shifted into place for jumps, branches and lui */
+  void (*execute)(const struct _decodedInst* di);
+} decodedInst;
+
+#define DECODE_CACHE_SIZE 4096              /* instructions, a power of two */
+static decodedInst decode_cache[DECODE_CACHE_SIZE];
 
 /******************************************************************************
    Nice Macros to simplify typing
  *****************************************************************************/
 
-#define rs (registers[getRs(inst)])
-#define rt (registers[getRt(inst)])
-#define rd (registers[getRd(inst)])
-#define jtarget ( (PC & 0xf0000000) | (getTarget(inst) << 2) )
-#define btarget (PC + (getSImmed(inst) << 2))
+#define rs (registers[di->src])
+#define rt (registers[di->tgt])
+#define rd (registers[di->dst])
+#define jtarget ( (PC & 0xf0000000) | di->immed )
+#define btarget (PC + di->immed)
 #define hi (hilo[0])
 #define lo (hilo[1])
 
@@ -53,9 +86,11 @@ unsigned int getTarget(const word instr){
   return instr & 0x03ffffff;
 }
 
-void disassemble_inst(word inst)
+/* Writes the assembly of the instruction inst stored at pc into buffer */
+void format_inst(char* buffer, word inst, address pc)
 {
-  char buffer[200];
+  address next_pc = pc + sizeof(instruction);
+
   switch(getOpcode(inst))
   {
   case 0: /* R-type */
@@ -142,16 +177,16 @@ void disassemble_inst(word inst)
     }
     break;
   case 2: /* j     */
-    sprintf(buffer, "j\t\t0x%.8X\n", (unsigned int)((PC & 0xf0000000) | getTarget(inst) << 2));
+    sprintf(buffer, "j\t\t0x%.8X\n", (unsigned int)((next_pc & 0xf0000000) | getTarget(inst) << 2));
     break;
   case 3: /* jal   */
-    sprintf(buffer, "jal\t0x%.8X\n", (unsigned int)((PC & 0xf0000000) | getTarget(inst) << 2));
+    sprintf(buffer, "jal\t0x%.8X\n", (unsigned int)((next_pc & 0xf0000000) | getTarget(inst) << 2));
     break;
   case 4: /* beq   */
-    sprintf(buffer, "beq\t$%u, $%u, 0x%.8X\n", getRs(inst), getRt(inst), (unsigned int)((getSImmed(inst) << 2) + PC));
+    sprintf(buffer, "beq\t$%u, $%u, 0x%.8X\n", getRs(inst), getRt(inst), (unsigned int)(((word)getSImmed(inst) << 2) + next_pc));
     break;
   case 5: /* bne   */
-    sprintf(buffer, "bne\t$%u, $%u, 0x%.8X\n", getRs(inst), getRt(inst), (unsigned int)((getSImmed(inst) << 2) + PC));
+    sprintf(buffer, "bne\t$%u, $%u, 0x%.8X\n", getRs(inst), getRt(inst), (unsigned int)(((word)getSImmed(inst) << 2) + next_pc));
     break;
   case 8: /* addi  */
     sprintf(buffer, "addi\t$%u, $%u, %d\n", getRt(inst), getRs(inst), getSImmed(inst));
@@ -195,13 +230,207 @@ void disassemble_inst(word inst)
   default:
     sprintf(buffer, "Unsupported instruction\n");
   }
+}
 
+/* Logs the assembly of inst, the instruction just fetched */
+void disassemble_inst(word inst)
+{
+  char buffer[200];
+
+  format_inst(buffer, inst, PC - sizeof(instruction));
   append_log(buffer);
 }
 
-void execute_inst(word inst)
+/******************************************************************************
+   Instruction execution
+
+   An instruction is decoded once into its register numbers, its immediate
+   (extended and shifted as the instruction uses it) and the handler that
+   executes it.  The decoded instructions are kept in a direct-mapped table
+   indexed by PC; an entry is used again only if it was decoded from the
+   same word at the same PC, so reloaded or rewritten code is decoded anew.
+   Only the decoding is skipped: every instruction is still fetched through
+   the caches.
+ *****************************************************************************/
+
+static void exec_sll(const decodedInst* di)
 {
-  char buffer[200];
+  rd = rt << di->shamt;
+}
+
+static void exec_srl(const decodedInst* di)
+{
+  rd = rt >> di->shamt;
+}
+
+static void exec_sra(const decodedInst* di)
+{
+  rd = (int)(rt) >> rs;
+}
+
+static void exec_sllv(const decodedInst* di)
+{
+  rd = rt << rs;
+}
+
+static void exec_srlv(const decodedInst* di)
+{
+  rd = rt >> rs;
+}
+
+static void exec_jr(const decodedInst* di)
+{
+  PC = rs;
+}
+
+static void exec_jalr(const decodedInst* di)
+{
+  rd = PC;
+  PC = rs;
+}
+
+static void exec_mfhi(const decodedInst* di)
+{
+  rd = hi;
+}
+
+static void exec_mflo(const decodedInst* di)
+{
+  rd = lo;
+}
+
+static void exec_mthi(const decodedInst* di)
+{
+  hi = rs;
+}
+
+static void exec_mtlo(const decodedInst* di)
+{
+  lo = rs;
+}
+
+static void exec_mult(const decodedInst* di)
+{
+  lo = rs * rt;
+}
+
+static void exec_div(const decodedInst* di)
+{
+  lo = rs / rt;
+  hi = rs % rt;
+}
+
+static void exec_add(const decodedInst* di)
+{
+  rd = rs + rt;
+}
+
+static void exec_sub(const decodedInst* di)
+{
+  rd = rs - rt;
+}
+
+static void exec_and(const decodedInst* di)
+{
+  rd = rs & rt;
+}
+
+static void exec_or(const decodedInst* di)
+{
+  rd = rs | rt;
+}
+
+static void exec_xor(const decodedInst* di)
+{
+  rd = rs ^ rt;
+}
+
+static void exec_slt(const decodedInst* di)
+{
+  rd = (rs & 0x80000000) ^ (rt & 0x80000000) ? rs >> 31 : rs < rt;
+}
+
+static void exec_j(const decodedInst* di)
+{
+  PC = jtarget;
+}
+
+static void exec_jal(const decodedInst* di)
+{
+  registers[31] = PC;
+  PC = jtarget;
+}
+
+static void exec_beq(const decodedInst* di)
+{
+  if(rs == rt)
+    PC = btarget;
+}
+
+static void exec_bne(const decodedInst* di)
+{
+  if(rs != rt)
+    PC = btarget;
+}
+
+static void exec_addi(const decodedInst* di)
+{
+  rt = rs + di->immed;
+}
+
+static void exec_slti(const decodedInst* di)
+{
+  rt = (rs & 0x80000000) ^ (di->immed & 0x80000000) ? rs >> 31 : rs < di->immed;
+}
+
+static void exec_andi(const decodedInst* di)
+{
+  rt = rs & di->immed;
+}
+
+static void exec_ori(const decodedInst* di)
+{
+  rt = rs | di->immed;
+}
+
+static void exec_lui(const decodedInst* di)
+{
+  rt = di->immed;
+}
+
+static void exec_lw(const decodedInst* di)
+{
+  accessMemory(rs + di->immed, &rt, READ);
+}
+
+static void exec_sw(const decodedInst* di)
+{
+  accessMemory(rs + di->immed, &rt, WRITE);
+}
+
+static void exec_done(const decodedInst* di)
+{
+  /* with several cores, the run goes on until every core is done */
+  halted[active_core] = 1;
+  if(processor_halted())
+    stop_run();
+}
+
+/* Unsupported instructions (lb, lbu, sb, ...) do nothing */
+static void exec_unsupported(const decodedInst* di)
+{
+}
+
+/* Fills in the fields and handler of di for inst */
+static void decode_inst(decodedInst* di, word inst)
+{
+  di->inst = inst;
+  di->src = getRs(inst);
+  di->tgt = getRt(inst);
+  di->dst = getRd(inst);
+  di->shamt = getShamt(inst);
+  di->immed = getSImmed(inst);
+  di->execute = exec_unsupported;
 
   switch(getOpcode(inst))
   {
@@ -209,169 +438,356 @@ void execute_inst(word inst)
     switch(getFunct(inst))
     {
     case 0: /* sll */
-      rd = rt << getShamt(inst);
+      di->execute = exec_sll;
       break;
     case 2: /* srl */
-      rd = rt >> getShamt(inst);
+      di->execute = exec_srl;
       break;
     case 3: /* sra */
-      rd = (int)(rt) >> rs;
+    case 7: /* srav */
+      di->execute = exec_sra;
       break;
     case 4: /* sllv */ 
-      rd = rt << rs;
+      di->execute = exec_sllv;
       break;
     case 6: /* srlv */
-      rd = rt >> rs;
-      break;
-    case 7: /* srav */
-      rd = (int)(rt) >> rs;
+      di->execute = exec_srlv;
       break;
     case 8: /* jr   */
-      PC = rs;
+      di->execute = exec_jr;
       break;
     case 9: /* jalr */
-      rd = PC;
-      PC = rs;
+      di->execute = exec_jalr;
       break;
     case 16: /* mfhi  */
-      rd = hi;
+      di->execute = exec_mfhi;
       break;
     case 17: /* mflo  */
-      rd = lo;
+      di->execute = exec_mflo;
       break;
     case 18: /* mthi  */
-      hi = rs;
+      di->execute = exec_mthi;
       break;
     case 19: /* mtlo  */
-      lo = rs;
+      di->execute = exec_mtlo;
       break;
     case 24: /* mult  */      
     case 25: /* multu */
-      lo = rs * rt;
+      di->execute = exec_mult;
       break;
     case 26: /* div   */
     case 27: /* divu  */
-      lo = rs / rt;
-      hi = rs % rt;
+      di->execute = exec_div;
       break;
     case 32: /* add   */
     case 33: /* addu  */
-      rd = rs + rt;
+      di->execute = exec_add;
       break;
     case 34: /* sub   */
     case 35: /* subu  */
-      rd = rs - rt;
+      di->execute = exec_sub;
       break;
     case 36: /* and   */
-      rd = rs & rt;
+      di->execute = exec_and;
       break;
     case 37: /* or    */
-      rd = rs | rt;
+      di->execute = exec_or;
       break;
     case 38: /* xor   */
-      rd = rs ^ rt;
+      di->execute = exec_xor;
       break;
     case 42: /* slt   */
     case 43: /* sltu  */
-      rd = (rs & 0x80000000) ^ (rt & 0x80000000) ? rs >> 31 : rs < rt;
-      break;
-    default:
-      sprintf(buffer, "Unsupported instruction\n");
+      di->execute = exec_slt;
       break;
     }
     break;
   case 2: /* j     */
-    PC = jtarget;
+    di->immed = getTarget(inst) << 2;
+    di->execute = exec_j;
     break;
   case 3: /* jal   */
-    registers[31] = PC;
-    PC = jtarget;
+    di->immed = getTarget(inst) << 2;
+    di->execute = exec_jal;
     break;
   case 4: /* beq   */
-    if(rs == rt)
-      PC = btarget;
+    di->immed = (word)getSImmed(inst) << 2;
+    di->execute = exec_beq;
     break;
   case 5: /* bne */
-    if(rs != rt)
-      PC = btarget;
+    di->immed = (word)getSImmed(inst) << 2;
+    di->execute = exec_bne;
     break;
   case 8: /* addi */
   case 9: /* addiu */
-    rt = rs + getSImmed(inst);
+    di->execute = exec_addi;
     break;
   case 10: /* slti  */
   case 11: /* sltiu */
-    rt = (rs & 0x80000000) ^ (getSImmed(inst) & 0x80000000) ? rs >> 31 : rs < getSImmed(inst);
+    di->execute = exec_slti;
     break;
   case 12: /* andi  */
-    rt = rs & getUImmed(inst);
+    di->immed = getUImmed(inst);
+    di->execute = exec_andi;
     break;
   case 13: /* ori */
-    rt = rs | getUImmed(inst);
+    di->immed = getUImmed(inst);
+    di->execute = exec_ori;
     break;
   case 15: /* lui */
-    rt = getUImmed(inst) << 16;
-    break;
-  case 32: /* lb */
-    sprintf(buffer, "Unsupported instruction, lb\n");
-    break;
-  case 36: /* lbu */
-    sprintf(buffer, "Unsupported instruction, lbu\n");
+    di->immed = getUImmed(inst) << 16;
+    di->execute = exec_lui;
     break;
   case 35: /* lw */
-    accessMemory(rs + getSImmed(inst), &rt, READ);
-    break;
-  case 40: /* sb */
-    sprintf(buffer, "Unsupported instruction, sb\n");
+    di->execute = exec_lw;
     break;
   case 43: /* sw */
-    accessMemory(rs + getSImmed(inst), &rt, WRITE);
+    di->execute = exec_sw;
     break;
   case 63:
-    stop_run();
+    di->execute = exec_done;
     break;
-  default:
-    sprintf(buffer, "Unsupported instruction\n");
+  }
+}
+
+/* returns the decoded instruction for inst, just fetched from pc */
+static const decodedInst* decoded_inst(address pc, word inst)
+{
+  decodedInst* di = &decode_cache[(pc / sizeof(instruction)) & (DECODE_CACHE_SIZE - 1)];
+
+  if(di->execute == NULL || di->pc != pc || di->inst != inst)
+  {
+    di->pc = pc;
+    decode_inst(di, inst);
   }
 
+  return di;
+}
+
+/* Executes an instruction decoded by decoded_inst() */
+static void execute_inst(const decodedInst* di)
+{
+  di->execute(di);
+
   /* Ensure $zero remains equal to 0 */
   registers[0] = 0;
 }
 
 void reinit_processor()
 {
+  cpuContext* c;
+  int core;
+
+  switch_core(0);
+  for(core = 1; core < MAX_CORES; core++)
+  {
+    c = &contexts[core];
+    memset(c, 0, sizeof(cpuContext));
+    c->PC = PROGRAM_START;
+    c->registers[26] = core;
+    c->registers[29] = STACK_START - core * CORE_STACK_SIZE;
+    c->registers[31] = PROGRAM_START;
+    c->pipeline.start = core_hierarchy(core)->cycle;
+  }
+  memset(halted, 0, sizeof(halted));
+
   PC = PROGRAM_START;
+  registers[26] = 0;
   registers[29] = STACK_START;
   registers[31] = PROGRAM_START;
+  reset_pipeline();
   refresh_register_display();
 }
 
-void step_processor()
+/* Restarts the pipeline timing at the current cycle of the hierarchy */
+void reset_pipeline()
+{
+  memset(&pipeline, 0, sizeof(pipeline));
+  memset(register_ready, 0, sizeof(register_ready));
+  pipeline.start = core_hierarchy(active_core)->cycle;
+}
+
+/* Saves the registers and pipeline of the core running, and loads those of core */
+void switch_core(int core)
+{
+  cpuContext* c;
+
+  if(core == active_core)
+    return;
+
+  c = &contexts[active_core];
+  memcpy(c->registers, registers, sizeof(registers));
+  memcpy(c->hilo, hilo, sizeof(hilo));
+  c->PC = PC;
+  c->pipeline = pipeline;
+  memcpy(c->register_ready, register_ready, sizeof(register_ready));
+
+  c = &contexts[core];
+  memcpy(registers, c->registers, sizeof(registers));
+  memcpy(hilo, c->hilo, sizeof(hilo));
+  PC = c->PC;
+  pipeline = c->pipeline;
+  memcpy(register_ready, c->register_ready, sizeof(register_ready));
+  active_core = core;
+}
+
+/* Registers inst reads (0 for none) and writes (0 for none) */
+static void inst_registers(word inst, unsigned int sources[2], unsigned int* dest)
+{
+  sources[0] = getRs(inst);
+  sources[1] = getRt(inst);
+  *dest = 0;
+
+  switch(getOpcode(inst))
+  {
+  case 0: /* R-type; jr, mult and div write no rd */
+    if(getFunct(inst) != 8 && (getFunct(inst) < 24 || getFunct(inst) > 27))
+      *dest = getRd(inst);
+    break;
+  case 2: /* j     */
+  case 3: /* jal   */
+    sources[0] = sources[1] = 0;
+    *dest = getOpcode(inst) == 3 ? 31 : 0;
+    break;
+  case 4: /* beq   */
+  case 5: /* bne   */
+  case 43: /* sw   */
+    break;
+  default: /* immediates and lw, from rs to rt */
+    sources[1] = 0;
+    *dest = getRt(inst);
+    break;
+  }
+}
+
+/*
+  In cycle mode, returns the cycle the instruction just fetched issues: once
+  its fetch is through (a hit's latency is hidden by the pipeline) and the
+  loads in flight to the registers it uses are done.  Its loads and stores
+  are made at that cycle.
+*/
+static unsigned long long issue_timed(word inst)
+{
+  cacheHierarchy* h = core_hierarchy(active_core);
+  unsigned int latency = h->instruction_cache != NULL ? h->instruction_cache->latency : 0;
+  unsigned long long fetched = h->ready - latency > h->accepted ? h->ready - latency : h->accepted;
+  unsigned long long issue = fetched > h->cycle ? fetched : h->cycle;
+  unsigned long long operands = issue;
+  unsigned int sources[2];
+  unsigned int dest;
+
+  inst_registers(inst, sources, &dest);
+  if(register_ready[sources[0]] > operands)
+    operands = register_ready[sources[0]];
+  if(register_ready[sources[1]] > operands)
+    operands = register_ready[sources[1]];
+  if(register_ready[dest] > operands)
+    operands = register_ready[dest];
+
+  pipeline.fetch_stalls += issue - h->cycle;
+  pipeline.load_use_stalls += operands - issue;
+  h->cycle = operands;
+  return operands;
+}
+
+/* Moves the cycle of the hierarchy past the instruction that issued at issue */
+static void retire_timed(word inst, unsigned long long issue)
+{
+  cacheHierarchy* h = core_hierarchy(active_core);
+
+  if(getOpcode(inst) == 35 || getOpcode(inst) == 43)
+  {
+    /* the pipeline waits for the cache to take the load or store, not for a
+       load's data until it is used */
+    pipeline.memory_stalls += h->accepted - issue;
+    issue = h->accepted;
+    if(getOpcode(inst) == 35 && getRt(inst) != 0)
+      register_ready[getRt(inst)] = h->ready;
+  }
+
+  pipeline.instructions++;
+  h->cycle = issue + 1;
+}
+
+/* Runs one instruction on the core running */
+static void step_core()
 {
   char buffer[200];
   word inst;
-
-  /* Flush previously drawn items */
-  flush_drawlist();
+  unsigned long long issue = 0;
 
   /* Fetch Instruction */
-  accessMemory(PC, &inst, READ);
+  accessCache(PC, &inst, READ, INSTRUCTION_FETCH);
   inst = ntohl(inst);
 
   /* Print PC */
-  sprintf(buffer, "[0x%08X]: 0x%08X\t", PC, inst);
-  append_log(buffer);
+  if(IS_LOGGING())
+  {
+    if(core_count > 1)
+    {
+      sprintf(buffer, "Core %d ", active_core);
+      append_log(buffer);
+    }
+    sprintf(buffer, "[0x%08X]: 0x%08X\t", PC, inst);
+    append_log(buffer);
+  }
 
   /* Increment PC */
   PC += sizeof(instruction); 
 
   /* Disassemble Instruction */
-  disassemble_inst(inst);
+  if(IS_LOGGING())
+    disassemble_inst(inst);
 
   /* Execute Instruction */
-  execute_inst(inst);
+  if(memory_hierarchy.timed)
+    issue = issue_timed(inst);
+  execute_inst(decoded_inst(PC - sizeof(instruction), inst));
+  if(memory_hierarchy.timed)
+    retire_timed(inst, issue);
   
   /* refresh registers and cache */
   refresh_register_display();
   refresh_cache_display();
 }
+
+/*
+  Runs one instruction on every core that has not reached the end of the
+  program, in order of their numbers, and leaves core 0 loaded for display
+*/
+void step_processor()
+{
+  int core;
+
+  /* Flush previously drawn items */
+  flush_drawlist();
+
+  if(core_count == 1)
+  {
+    step_core();
+    return;
+  }
+
+  for(core = 0; core < core_count; core++)
+  {
+    if(halted[core])
+      continue;
+    switch_core(core);
+    step_core();
+  }
+  switch_core(0);
+}
+
+/* returns non-zero once every core has reached the end of its program */
+int processor_halted(void)
+{
+  int core;
+
+  for(core = 0; core < core_count; core++)
+  {
+    if(!halted[core])
+      return 0;
+  }
+
+  return 1;
+}
@@ -0,0 +1,258 @@
+#include "tips.h"
+
+/******************************************************************************
+   DRAM timing
+
+   Without the model every transfer to or from DRAM takes dram_latency
+   cycles.  With it, an address is mapped to a channel, a bank of that
+   channel and a row of that bank:
+
+     row - consecutive rows go to consecutive channels, then banks, so the
+           blocks of a row stay together and hit the open row
+     block - consecutive blocks of MAX_BLOCK_SIZE bytes go to consecutive
+             channels, then banks, to spread streams over the banks
+     xor - as row, with the bank also XORed with the low bits of the row so
+           that rows a power of two apart do not keep conflicting in a bank
+
+   A request to an open row takes tCAS cycles; one to a closed bank tRCD +
+   tCAS, and one to a bank with another row open tRP + tRCD + tCAS.  Its data
+   then holds the bus of the channel for tBURST cycles.  Under the closed
+   page policy every row is closed after its access, in the background.
+
+   Requests wait in one queue and are served first-ready, first-come
+   first-served (FR-FCFS): the oldest request to an open row goes first,
+   else the oldest request.  Writes are posted and leave the hierarchy
+   right away; a read waits until it is served, so the latency it returns
+   includes the queued requests served before it.  Times are in the cycles
+   of the caller, which also tells the model when each request is made.
+ *****************************************************************************/
+
+typedef struct {
+  int open;
+  unsigned int row;
+  unsigned long long ready;         /* cycle the bank can start a request */
+} dramBank;
+
+typedef struct {
+  unsigned int channel;
+  unsigned int bank;
+  unsigned int row;
+  unsigned long long arrival;
+  unsigned long long order;
+} dramRequest;
+
+struct _dramTiming {
+  dramBank bank[MAX_DRAM_CHANNELS * MAX_DRAM_BANKS];
+  unsigned long long bus_free[MAX_DRAM_CHANNELS];
+  dramRequest queue[MAX_DRAM_QUEUE]; /* oldest first */
+  unsigned int count;
+  unsigned long long next_order;
+};
+
+static const struct {
+  const char* command;
+  const char* name;
+} mappings[DRAM_MAPPING_COUNT] = {
+  { "row", "Row interleaved" },
+  { "block", "Block interleaved" },
+  { "xor", "XOR bank interleaved" }
+};
+
+const char* dram_mapping_name(DramMapping mapping)
+{
+  return mapping < DRAM_MAPPING_COUNT ? mappings[mapping].name : "Unknown";
+}
+
+/* returns the mapping named command, or -1 */
+int find_dram_mapping(const char* command)
+{
+  int mapping;
+
+  for(mapping = MAP_ROW_INTERLEAVED; mapping < DRAM_MAPPING_COUNT; mapping++)
+  {
+    if(strcmp(command, mappings[mapping].command) == 0)
+      return mapping;
+  }
+
+  return -1;
+}
+
+/*
+  Empties the queue of a hierarchy's DRAM and closes its rows, as configured
+  by h->dram_config.  Called when the hierarchy is flushed.
+
+  returns 0 if successful, non-zero if it could not be allocated.
+*/
+int reset_dram_timing(cacheHierarchy* h)
+{
+  if(h->dram_timing == NULL && (h->dram_timing = (dramTiming*)malloc(sizeof(dramTiming))) == NULL)
+    return -1;
+
+  memset(h->dram_timing, 0, sizeof(dramTiming));
+  return 0;
+}
+
+void free_dram_timing(cacheHierarchy* h)
+{
+  free(h->dram_timing);
+  h->dram_timing = NULL;
+}
+
+static void map_address(const dramConfig* c, address addr, dramRequest* request)
+{
+  address x;
+
+  if(c->mapping == MAP_BLOCK_INTERLEAVED)
+    x = addr / MAX_BLOCK_SIZE;
+  else
+    x = addr / c->row_size;
+
+  request->channel = x % c->channels;
+  x /= c->channels;
+  request->bank = x % c->banks;
+  x /= c->banks;
+
+  if(c->mapping == MAP_BLOCK_INTERLEAVED)
+    request->row = x / (c->row_size / MAX_BLOCK_SIZE);
+  else
+    request->row = x;
+
+  if(c->mapping == MAP_XOR_INTERLEAVED)
+    request->bank ^= request->row % c->banks;
+}
+
+static dramBank* request_bank(cacheHierarchy* h, const dramRequest* request)
+{
+  return &h->dram_timing->bank[request->channel * h->dram_config.banks + request->bank];
+}
+
+/* returns the position in the queue of the request FR-FCFS serves next */
+static unsigned int next_request(cacheHierarchy* h)
+{
+  dramTiming* t = h->dram_timing;
+  dramBank* bank;
+  unsigned int i;
+
+  for(i = 0; i < t->count; i++)
+  {
+    bank = request_bank(h, &t->queue[i]);
+    if(bank->open && bank->row == t->queue[i].row)
+      return i;
+  }
+
+  return 0;
+}
+
+/* Serves the request at position i of the queue; returns the cycle its data is through */
+static unsigned long long serve_request(cacheHierarchy* h, unsigned int i)
+{
+  const dramConfig* c = &h->dram_config;
+  dramTiming* t = h->dram_timing;
+  dramRequest* request = &t->queue[i];
+  dramBank* bank = request_bank(h, request);
+  unsigned long long start = request->arrival > bank->ready ? request->arrival : bank->ready;
+  unsigned long long done;
+
+  if(bank->open && bank->row == request->row)
+  {
+    h->dram_row_hits++;
+    start += c->tCAS;
+  }
+  else if(bank->open)
+  {
+    h->dram_row_conflicts++;
+    start += c->tRP + c->tRCD + c->tCAS;
+  }
+  else
+  {
+    h->dram_row_misses++;
+    start += c->tRCD + c->tCAS;
+  }
+
+  if(start < t->bus_free[request->channel])
+    start = t->bus_free[request->channel];
+  done = start + c->tBURST;
+  t->bus_free[request->channel] = done;
+
+  if(c->page_policy == OPEN_PAGE)
+  {
+    bank->open = 1;
+    bank->row = request->row;
+    bank->ready = done;
+  }
+  else
+  {
+    bank->open = 0;
+    bank->ready = done + c->tRP;
+  }
+
+  if(i != 0)
+    h->dram_reordered++;
+  memmove(&t->queue[i], &t->queue[i + 1], (t->count - i - 1) * sizeof(dramRequest));
+  t->count--;
+  return done;
+}
+
+/*
+  Times one transfer to or from DRAM, requested at cycle now
+
+  returns the cycles until a read has its data, 0 for a write, or
+  h->dram_latency when the model is off.
+*/
+unsigned int dram_request(cacheHierarchy* h, address addr, WriteEnable we, unsigned long long now)
+{
+  dramTiming* t = h->dram_timing;
+  dramRequest* request;
+  dramBank* bank;
+  unsigned long long order;
+  unsigned long long done;
+  unsigned int i;
+
+  if(t == NULL)
+    return h->dram_latency;
+
+  /* the banks went on with the queue while the hierarchy was busy */
+  while(t->count != 0)
+  {
+    i = next_request(h);
+    bank = request_bank(h, &t->queue[i]);
+    if((t->queue[i].arrival > bank->ready ? t->queue[i].arrival : bank->ready) >= now)
+      break;
+    serve_request(h, i);
+  }
+
+  if(t->count == h->dram_config.queue_depth)
+    serve_request(h, next_request(h));
+
+  request = &t->queue[t->count++];
+  map_address(&h->dram_config, addr, request);
+  request->arrival = now;
+  request->order = order = t->next_order++;
+
+  if(we == WRITE)
+    return 0;
+
+  for(;;)
+  {
+    i = next_request(h);
+    if(t->queue[i].order == order)
+      break;
+    serve_request(h, i);
+  }
+
+  done = serve_request(h, i);
+  h->dram_read_cycles += done - now;
+  return (unsigned int)(done - now);
+}
+
+/* Average cycles of a read of DRAM so far, for the AMAT */
+double dram_read_latency(const cacheHierarchy* h)
+{
+  const dramConfig* c = &h->dram_config;
+
+  if(h->dram_timing == NULL)
+    return h->dram_latency;
+  if(h->dram_read_transfers == 0)
+    return c->tRCD + c->tCAS + c->tBURST;
+  return (double)h->dram_read_cycles / h->dram_read_transfers;
+}
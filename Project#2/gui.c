@@ -3,6 +3,7 @@
 #include <gtk/gtk.h>
 #include <gdk/gdkkeysyms.h>
 #include <glib.h>
+#include <pthread.h>
 
 /*****************************************************************************
   GUI related structs, variables, and macros
@@ -39,11 +40,8 @@ typedef struct _node
   gint y;
   gint width;
   gint height;
-  struct _node* next;
 } node;
 
-node* drawlist;
-
 /* Main GUI Panels */
 GtkWidget* main_window;
 GtkWidget* cache_canvas;
@@ -51,26 +49,26 @@ GtkWidget* register_canvas;
 GtkWidget* textbox_scroll_window;
 GtkWidget* textbox;
 GtkTextMark* mark;
+GtkWidget* stats_textbox;
 
 /* Configure dialog related variables */
 GtkWidget* assoc_entry;
 GtkWidget* index_entry;
 GtkWidget* block_entry;
-GtkWidget* random_policy_button;
-GtkWidget* lru_policy_button;
-GtkWidget* lfu_policy_button;
+GtkWidget* replacement_policy_button[REPLACEMENT_POLICY_COUNT];
 ReplacementPolicy panel_replacement_policy;
 GtkWidget* write_back_policy_button;
 GtkWidget* write_through_policy_button;
 MemorySyncPolicy panel_memory_sync_policy;
 GtkWidget* index_view_button;
 GtkWidget* assoc_view_button;
+GtkWidget* heatmap_view_button;
 CacheView panel_cache_view;
+gboolean panel_heatmap;
 
 /* Run Dialog related variables */
 GtkWidget* speed_slider;
-guint timer_id;            /* used for cache automation test */
-gboolean timer_active;
+GtkWidget* full_speed_button;
 
 /* Color */
 GdkColormap* cmap; 
@@ -104,6 +102,344 @@ PangoFontMetrics* metrics;
 gchar* cache_header_text;
 gchar* block_header_text;
 
+/******************************************************************************
+   Run mode and display snapshots
+
+   A run executes the program on a worker thread, at full speed or with a
+   delay between instructions, while the GTK main thread only draws.  The
+   worker never touches a widget: every FRAME_INTERVAL it copies the
+   registers, the cache, its highlights and the statistics into a snapshot,
+   and the main thread draws the latest snapshot on a timer of the same
+   interval.  Of the three snapshots, the main thread draws one, the worker
+   fills another, and the third is the latest published; the worker and
+   the main thread trade theirs for it with an atomic exchange, so neither
+   ever waits for the other.  The log messages of the worker are queued and
+   added to the log once per frame.
+
+   Outside of runs the main thread steps the program itself, and the
+   refresh functions copy the state straight into the snapshot drawn.
+ *****************************************************************************/
+
+#define FRAME_INTERVAL 40          /* ms between the frames of a run */
+#define MAX_HIGHLIGHTS 64          /* highlights the drawlist and a snapshot keep */
+#define FRESH_SNAPSHOT 4           /* set on latest_snapshot until the main thread takes it */
+
+/* A set of a level as the heatmap shows it */
+typedef struct {
+  unsigned int valid;                      /* ways holding a block */
+  unsigned long long hits;
+  unsigned long long misses;
+} heatCell;
+
+typedef struct {
+  unsigned int set_count;                  /* 0 for a level that does not exist */
+  unsigned int assoc;
+  heatCell* cells;                         /* MAX_LEVEL_SETS, allocated on first use */
+} heatLevel;
+
+typedef struct {
+  word registers[32];
+  address PC;
+  cacheSet cache[MAX_SETS];
+  node highlights[MAX_HIGHLIGHTS];
+  gint highlight_count;
+  heatLevel heat[LEVEL_COUNT];             /* only captured in the heatmap view */
+  char* stats;
+} guiSnapshot;
+
+static guiSnapshot snapshots[3];
+static gint drawn_snapshot = 0;            /* main thread */
+static gint filled_snapshot = 1;           /* worker */
+static volatile gint latest_snapshot = 2;
+
+static pthread_t worker;
+static gboolean worker_active;             /* from the start of a run until the worker is joined */
+static volatile gint worker_stop;
+static volatile gint worker_done;
+static volatile gint run_delay;            /* ms between instructions, 0 for full speed */
+static int run_logging;                    /* logging, restored after a run */
+static guint frame_id;
+
+/*
+  The log panel keeps the last LOG_LINES lines.  Messages are queued and
+  added to it together, once per frame of a run or once the main loop is
+  idle otherwise; the queue keeps no more than a panel of text.  The whole
+  log of the session also goes to log_file, for "Save Log".
+*/
+#define LOG_LINES 2000             /* lines the log panel keeps */
+#define LOG_PENDING_BYTES (LOG_LINES * 80)
+
+static pthread_mutex_t pending_log_lock = PTHREAD_MUTEX_INITIALIZER;
+static GString* pending_log;
+static FILE* log_file;
+static guint log_flush_id;
+
+/*
+  Repainting the cache display: only the rows whose block or highlight
+  changed since the last update are invalidated, by comparing the snapshot
+  with the cache as it was painted, and an expose only draws the rows in
+  its area.  Each row keeps its Pango layouts and their text.
+*/
+typedef struct {
+  PangoLayout* header;
+  PangoLayout* data;
+  gchar header_text[64];
+  gchar data_text[4 * MAX_BLOCK_SIZE];
+} rowLayout;
+
+#define ROW_EXPOSED(event, row) ((row) + line_height > (event)->area.y && (row) < (event)->area.y + (event)->area.height)
+
+static rowLayout row_layouts[MAX_SETS][MAX_ASSOC];
+static cacheSet painted_cache[MAX_SETS];
+static node painted_highlights[MAX_HIGHLIGHTS];
+static gint painted_highlight_count;
+static gboolean painted_valid;             /* FALSE to repaint the whole display */
+
+/*
+  The heatmap view draws every level of the hierarchy instead of the
+  blocks of the cache, one cell per set, for caches too large to read
+  block by block.  A cell gets darker with the accesses to its set, from
+  green for hits to red for misses, and the bar at its bottom shows the
+  ways holding a block.
+*/
+#define HEAT_COLUMNS 64            /* cells in a row of the heatmap */
+#define HEAT_CELL 8                /* pixels between cells */
+
+static gboolean heatmap;
+static GdkGC* heat_gc;
+
+/*
+  The highlights of the current step, in a ring of MAX_HIGHLIGHTS nodes
+  reused from step to step; past that many, the oldest are overwritten
+*/
+static node drawlist[MAX_HIGHLIGHTS];
+static gint drawlist_next;                 /* node the next highlight goes into */
+static gint drawlist_count;
+
+/* Puts slot in place of the latest snapshot, and returns the slot that was there */
+static gint exchange_snapshot(gint slot)
+{
+  gint latest;
+
+  do
+    latest = g_atomic_int_get(&latest_snapshot);
+  while(!g_atomic_int_compare_and_exchange(&latest_snapshot, latest, slot));
+
+  return latest;
+}
+
+/* returns the node for a new highlight */
+static node* new_highlight(void)
+{
+  node* item = &drawlist[drawlist_next];
+
+  drawlist_next = (drawlist_next + 1) % MAX_HIGHLIGHTS;
+  if(drawlist_count < MAX_HIGHLIGHTS)
+    drawlist_count++;
+
+  return item;
+}
+
+static void capture_registers(guiSnapshot* snapshot)
+{
+  memcpy(snapshot->registers, registers, sizeof(registers));
+  snapshot->PC = PC;
+}
+
+static char* stats_report(void);
+
+/* Copies the occupancy and the counters of each set of every level */
+static void capture_heat(guiSnapshot* snapshot)
+{
+  const cacheLevel* level;
+  heatCell* cell;
+  unsigned int i, w;
+  gint id;
+
+  for(id = L1I; id < LEVEL_COUNT; id++)
+  {
+    level = &memory_hierarchy.level[id];
+    snapshot->heat[id].set_count = LEVEL_ENABLED(level) ? level->set_count : 0;
+    snapshot->heat[id].assoc = level->assoc;
+    if(snapshot->heat[id].set_count == 0)
+      continue;
+
+    if(snapshot->heat[id].cells == NULL)
+      snapshot->heat[id].cells = g_new(heatCell, MAX_LEVEL_SETS);
+    for(i = 0; i < level->set_count; i++)
+    {
+      cell = &snapshot->heat[id].cells[i];
+      cell->valid = 0;
+      for(w = 0; w < level->assoc; w++)
+	cell->valid += (level->set[i].block[w].valid == VALID);
+      cell->hits = level->set[i].hits;
+      cell->misses = level->set[i].misses;
+    }
+  }
+}
+static void queue_cache_changes(void);
+static void free_row_layouts(void);
+
+static void capture_cache(guiSnapshot* snapshot)
+{
+  gint i;
+
+  memcpy(snapshot->cache, cache, sizeof(cache));
+  if(heatmap)
+    capture_heat(snapshot);
+
+  /* newest first */
+  for(i = 0; i < drawlist_count; i++)
+    snapshot->highlights[i] = drawlist[(drawlist_next + MAX_HIGHLIGHTS - 1 - i) % MAX_HIGHLIGHTS];
+  snapshot->highlight_count = drawlist_count;
+
+  free(snapshot->stats);
+  snapshot->stats = stats_report();
+}
+
+/* Shows the statistics of the snapshot drawn */
+static void show_stats(void)
+{
+  GtkTextBuffer* buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(stats_textbox));
+
+  if(snapshots[drawn_snapshot].stats != NULL)
+    gtk_text_buffer_set_text(buffer, snapshots[drawn_snapshot].stats, -1);
+}
+
+/* Publishes the state of the run as the latest snapshot; worker only */
+static void publish_snapshot(void)
+{
+  capture_registers(&snapshots[filled_snapshot]);
+  capture_cache(&snapshots[filled_snapshot]);
+  filled_snapshot = exchange_snapshot(filled_snapshot | FRESH_SNAPSHOT) & ~FRESH_SNAPSHOT;
+}
+
+/*
+  Adds the messages logged since the last flush to the log panel, and
+  drops its oldest lines past LOG_LINES
+*/
+static void flush_pending_log(void)
+{
+  GtkTextBuffer* buffer;
+  GtkTextIter start;
+  GtkTextIter iter;
+  gint lines;
+
+  pthread_mutex_lock(&pending_log_lock);
+  if(pending_log != NULL && pending_log->len != 0)
+  {
+    buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(textbox));
+    gtk_text_buffer_get_end_iter(buffer, &iter);
+    gtk_text_buffer_insert(buffer, &iter, pending_log->str, pending_log->len);
+    g_string_truncate(pending_log, 0);
+
+    if((lines = gtk_text_buffer_get_line_count(buffer)) > LOG_LINES)
+    {
+      gtk_text_buffer_get_start_iter(buffer, &start);
+      gtk_text_buffer_get_iter_at_line(buffer, &iter, lines - LOG_LINES);
+      gtk_text_buffer_delete(buffer, &start, &iter);
+    }
+    gtk_text_view_scroll_to_mark(GTK_TEXT_VIEW(textbox), mark, 0, FALSE, 0, 0);
+  }
+  pthread_mutex_unlock(&pending_log_lock);
+}
+
+static gboolean flush_log_when_idle(gpointer data)
+{
+  log_flush_id = 0;
+  flush_pending_log();
+  return FALSE;
+}
+
+static void* run_worker(void* data)
+{
+  GTimer* timer = g_timer_new();
+  gint delay;
+
+  while(!g_atomic_int_get(&worker_stop))
+  {
+    step_processor();
+
+    if((delay = g_atomic_int_get(&run_delay)) != 0)
+      g_usleep(delay * 1000);
+    if(g_timer_elapsed(timer, NULL) * 1000 >= FRAME_INTERVAL)
+    {
+      publish_snapshot();
+      g_timer_start(timer);
+    }
+  }
+
+  g_timer_destroy(timer);
+  g_atomic_int_set(&worker_done, TRUE);
+  return NULL;
+}
+
+/* Joins the worker once it has stopped, and shows the final state */
+static void finish_run(void)
+{
+  pthread_join(worker, NULL);
+  worker_active = FALSE;
+  logging = run_logging;
+
+  if(frame_id != 0)
+  {
+    g_source_remove(frame_id);
+    frame_id = 0;
+  }
+
+  flush_pending_log();
+  refresh_register_display();
+  refresh_cache_display();
+}
+
+/* Draws the latest snapshot of a run, if there is a new one */
+static gboolean draw_frame(gpointer data)
+{
+  flush_pending_log();
+
+  if(g_atomic_int_get(&latest_snapshot) & FRESH_SNAPSHOT)
+  {
+    drawn_snapshot = exchange_snapshot(drawn_snapshot) & ~FRESH_SNAPSHOT;
+    gtk_widget_queue_draw(register_canvas);
+    queue_cache_changes();
+    show_stats();
+  }
+
+  if(g_atomic_int_get(&worker_done))
+  {
+    frame_id = 0;
+    finish_run();
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Starts running the program on the worker, unless it already runs */
+static void start_run(void)
+{
+  if(worker_active)
+    return;
+
+  /* the log of every instruction would only hold a full speed run back */
+  run_logging = logging;
+  if(g_atomic_int_get(&run_delay) == 0)
+    logging = 0;
+
+  worker_stop = FALSE;
+  worker_done = FALSE;
+  worker_active = TRUE;
+  if(pthread_create(&worker, NULL, run_worker, NULL) != 0)
+  {
+    worker_active = FALSE;
+    logging = run_logging;
+    append_log("Unable to start the run\n");
+    return;
+  }
+
+  frame_id = g_timeout_add(FRAME_INTERVAL, draw_frame, NULL);
+}
+
 /******************************************************************************
    Register display related functions
  *****************************************************************************/
@@ -122,6 +458,7 @@ gboolean draw_registers(GtkWidget *widget, GdkEventExpose *event, gpointer data)
     " PC: %08x"
   };
 
+  guiSnapshot* shown = &snapshots[drawn_snapshot];
   gint i;
   gchar buffer[200];
   gsize buffer_size;
@@ -144,7 +481,7 @@ gboolean draw_registers(GtkWidget *widget, GdkEventExpose *event, gpointer data)
   /* Display registers */
   for(i = 0; i < 8; i++)
   {
-    buffer_size = sprintf(buffer, register_display[i], registers[i], registers[i + 8], registers[i + 16], registers[i+24]);
+    buffer_size = sprintf(buffer, register_display[i], shown->registers[i], shown->registers[i + 8], shown->registers[i + 16], shown->registers[i+24]);
 
     pango_layout_set_text(pango, buffer, buffer_size);
 
@@ -155,7 +492,7 @@ gboolean draw_registers(GtkWidget *widget, GdkEventExpose *event, gpointer data)
   }
 
   /* Display PC */
-  buffer_size = sprintf(buffer, register_display[i], PC);
+  buffer_size = sprintf(buffer, register_display[i], shown->PC);
   pango_layout_set_text(pango, buffer, buffer_size);
   gdk_draw_layout(widget->window, 
 		  widget->style->fg_gc[GTK_WIDGET_STATE(widget)],
@@ -174,8 +511,12 @@ gboolean draw_registers(GtkWidget *widget, GdkEventExpose *event, gpointer data)
 
 void refresh_register_display()
 {
-  if(IS_GUI_ACTIVE())
+  /* during a run, the worker publishes the registers with the cache */
+  if(IS_GUI_ACTIVE() && !worker_active)
+  {
+    capture_registers(&snapshots[drawn_snapshot]);
     gtk_widget_queue_draw(register_canvas);
+  }
 }
 
 GtkWidget* build_register_panel()
@@ -227,8 +568,7 @@ gboolean log_event(GtkWidget *widget, GdkEventExpose *event, gpointer data)
 
 void append_log(char* msg)
 {
-  GtkTextBuffer* buffer;
-  GtkTextIter iter;
+  gchar* cut;
 
   if(!(IS_GUI_ACTIVE()))
   {
@@ -236,13 +576,71 @@ void append_log(char* msg)
      return;
   }
 
-  /* Gets buffer */
-  buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(textbox));
-  gtk_text_buffer_get_end_iter(buffer, &iter);
+  /* Queue msg, keeping only the lines the panel would keep */
+  pthread_mutex_lock(&pending_log_lock);
+  g_string_append(pending_log, msg);
+  if(pending_log->len > LOG_PENDING_BYTES &&
+     (cut = strchr(pending_log->str + pending_log->len - LOG_PENDING_BYTES, '\n')) != NULL)
+    g_string_erase(pending_log, 0, cut + 1 - pending_log->str);
+  if(log_file != NULL)
+    fputs(msg, log_file);
+  pthread_mutex_unlock(&pending_log_lock);
+
+  /* the worker of a run leaves its messages for the next frame */
+  if(!worker_active && log_flush_id == 0)
+    log_flush_id = g_idle_add(flush_log_when_idle, NULL);
+}
+
+/* Copies the whole log of the session to filename */
+static void save_log(const char* filename)
+{
+  gchar buffer[4096];
+  gchar message[300];
+  size_t size;
+  FILE* out;
+
+  if(log_file == NULL || (out = fopen(filename, "w")) == NULL)
+  {
+    snprintf(message, sizeof(message), "Unable to save the log to %s\n", filename);
+    append_log(message);
+    return;
+  }
 
-  /* Inserts msg and scrolls to new insertion */
-  gtk_text_buffer_insert(buffer, &iter, msg, -1);
-  gtk_text_view_scroll_to_mark(GTK_TEXT_VIEW(textbox), mark, 0, FALSE, 0, 0);
+  pthread_mutex_lock(&pending_log_lock);
+  rewind(log_file);
+  while((size = fread(buffer, 1, sizeof(buffer), log_file)) != 0)
+    fwrite(buffer, 1, size, out);
+  fseek(log_file, 0, SEEK_END);
+  pthread_mutex_unlock(&pending_log_lock);
+
+  snprintf(message, sizeof(message), "%s to %s\n", (fclose(out) == 0 ? "Log saved" : "Unable to save the log"), filename);
+  append_log(message);
+}
+
+gboolean save_log_button_listener(GtkWidget *widget, GdkEventExpose *event, gpointer data)
+{
+  GtkWidget *dialog;
+  char *filename;
+
+  dialog = gtk_file_chooser_dialog_new ("Save Log",
+					GTK_WINDOW(main_window),
+					GTK_FILE_CHOOSER_ACTION_SAVE,
+					GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+					GTK_STOCK_SAVE, GTK_RESPONSE_ACCEPT,
+					NULL);
+  gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(dialog), TRUE);
+  gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(dialog), "tips.log");
+
+  if (gtk_dialog_run (GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT)
+  {
+    filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+    save_log(filename);
+    g_free (filename);
+  }
+
+  gtk_widget_destroy (dialog);
+
+  return TRUE;
 }
 
 GtkWidget* build_log_panel()
@@ -251,7 +649,14 @@ GtkWidget* build_log_panel()
   GtkTextIter iter;
   GtkWidget* frame;
   GtkWidget* window;
+  GtkWidget* box;
+  GtkWidget* button_box;
+  GtkWidget* save_button;
   
+  pending_log = g_string_new(NULL);
+  if((log_file = tmpfile()) != NULL)
+    fputs("TIPS v2 started\n", log_file);
+
   /* Build textbox */
   textbox = gtk_text_view_new();
   gtk_text_view_set_editable(GTK_TEXT_VIEW(textbox), FALSE);
@@ -268,13 +673,86 @@ GtkWidget* build_log_panel()
   gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(window), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
   gtk_container_add(GTK_CONTAINER(window), textbox);
 
+  /* Build save button below the textbox */
+  save_button = gtk_button_new_with_label("Save Log...");
+  g_signal_connect(G_OBJECT(save_button), "clicked", G_CALLBACK(save_log_button_listener), NULL);
+  button_box = gtk_hbox_new(FALSE, 0);
+  gtk_box_pack_end(GTK_BOX(button_box), save_button, FALSE, FALSE, 0);
+
+  box = gtk_vbox_new(FALSE, 0);
+  gtk_box_pack_start(GTK_BOX(box), window, TRUE, TRUE, 0);
+  gtk_box_pack_start(GTK_BOX(box), button_box, FALSE, FALSE, 0);
+
   /* Build frame around textbox */
   frame = gtk_frame_new("Execution Log");
-  gtk_container_add(GTK_CONTAINER(frame), window);
+  gtk_container_add(GTK_CONTAINER(frame), box);
   
   return frame;
 }
 
+/******************************************************************************
+   Statistics Panel related functions
+ *****************************************************************************/
+
+/*
+  Returns the report of "print stats" and the per-set counters of the L1,
+  for the statistics panel; NULL if it could not be made.  The caller
+  frees it.
+*/
+static char* stats_report(void)
+{
+  FILE* report;
+  char* text;
+  long length;
+
+  if((report = tmpfile()) == NULL)
+    return NULL;
+
+  report_stats(&memory_hierarchy, report);
+  fprintf(report, "\n");
+  report_set_stats(&memory_hierarchy.level[L1D], report);
+  fprintf(report, "\n");
+  report_level_buffers(&memory_hierarchy.level[L1D], report);
+
+  length = ftell(report);
+  rewind(report);
+  if((text = (char*)malloc(length + 1)) != NULL)
+  {
+    length = fread(text, 1, length, report);
+    text[length] = '\0';
+  }
+
+  fclose(report);
+  return text;
+}
+
+GtkWidget* build_stats_panel()
+{
+  PangoFontDescription* stats_fontdesc;
+  GtkWidget* frame;
+  GtkWidget* window;
+  char buffer[20];
+
+  /* Build textbox */
+  stats_textbox = gtk_text_view_new();
+  gtk_text_view_set_editable(GTK_TEXT_VIEW(stats_textbox), FALSE);
+  sprintf(buffer, "Monospace %d", GLOBAL_FONT_SIZE);
+  stats_fontdesc = pango_font_description_from_string(buffer);
+  gtk_widget_modify_font(stats_textbox, stats_fontdesc);
+  pango_font_description_free(stats_fontdesc);
+
+  /* Place textbox into frame */
+  window = gtk_scrolled_window_new(NULL, NULL);
+  gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(window), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+  gtk_container_add(GTK_CONTAINER(window), stats_textbox);
+
+  /* Build frame around textbox */
+  frame = gtk_frame_new("Cache Statistics");
+  gtk_container_add(GTK_CONTAINER(frame), window);
+
+  return frame;
+}
+
 /******************************************************************************
    Cache Display related functions
  *****************************************************************************/
@@ -292,6 +770,9 @@ void configure_cache_drawing_parameters(GtkWidget* widget)
   if(layout != NULL)
     g_object_unref(layout);
 
+  free_row_layouts();
+  painted_valid = FALSE;
+
   /* Init base offsets */
   base_x_offset = 15;
   base_y_offset = 15;
@@ -330,8 +811,8 @@ void configure_cache_drawing_parameters(GtkWidget* widget)
   pango_layout_get_pixel_size(layout, NULL, &cache_header_height);
 
   /* Init block header size information */
-  block_header_text = "  %2d  %d %d %s\t%s\t%08X   ";
-  buffer_size = sprintf(buffer, block_header_text, 0, cache[0].block[0].valid, cache[0].block[0].dirty, lru_to_string(0, 0), lfu_to_string(0,0), cache[0].block[0].tag);
+  block_header_text = "  %2d  %d %d %u\t%u\t%08X   ";
+  buffer_size = sprintf(buffer, block_header_text, 0, cache[0].block[0].valid, cache[0].block[0].dirty, cache[0].block[0].lru.value, cache[0].block[0].accessCount, cache[0].tag[0]);
   pango_layout_set_text(layout, buffer, buffer_size);
   pango_layout_get_pixel_size(layout, &block_header_width, NULL);
 
@@ -351,6 +832,212 @@ void configure_cache_drawing_parameters(GtkWidget* widget)
   horizontal_line_width = block_header_width + block_data_width + byte_width;
 }
 
+/* x of the byte at offset in a row of the cache display */
+static gint offset_x(unsigned int offset)
+{
+#ifdef CYGWIN
+  return base_x_offset + block_header_width + (offset * byte_width) + ((offset / 4) * (char_width * 3)) + (((offset / 2) * char_width) - ((offset / 4) * char_width));
+#else
+  return base_x_offset + block_header_width + (offset * byte_width) + ((offset / 4) * char_width);
+#endif
+}
+
+/* y of the row of block assoc_num of set set_num in the cache display */
+static gint row_y(unsigned int set_num, unsigned int assoc_num)
+{
+  switch(view)
+  {
+  case INDEX:
+    return base_y_offset + cache_header_height + set_num * (line_height + (line_height * assoc)) + (assoc_num * line_height);
+  case ASSOC:
+    return base_y_offset + 
+           (assoc_num * (cache_header_height + line_height + cache_unit_height + ((set_count / 4) * line_height))) + 
+           cache_header_height + 
+           (set_num * line_height) + 
+           ((set_num / 4) * line_height);
+  default:
+    printf("Invalid arrange mode");
+    exit(1);
+  }
+}
+
+/* Draws the offsets above the first row of a cache unit at y */
+static void draw_offset_headers(GtkWidget* widget, gint y)
+{
+  gchar buffer[4];
+  gsize buffer_size;
+  gint o;
+
+  for(o = 0; o < block_size; o += 4)
+  {
+    buffer_size = sprintf(buffer, "%02X", o);
+    pango_layout_set_text(layout, buffer, buffer_size);
+    gdk_draw_layout(widget->window,
+		    widget->style->fg_gc[GTK_WIDGET_STATE(widget)],
+		    offset_x(o), 
+		    y,
+		    layout);
+  }
+}
+
+/*
+  Draws block s of set b at y, from the layouts kept for its row; their
+  text is only set again when the block changed since it was last drawn
+*/
+static void draw_cache_row(GtkWidget* widget, const guiSnapshot* shown, gint b, gint s, gint y)
+{
+  rowLayout* row = &row_layouts[b][s];
+  const cacheBlock* block = &shown->cache[b].block[s];
+  gchar text[sizeof(row->data_text)];
+  gint length = 0;
+  gint o;
+
+  if(row->header == NULL)
+  {
+    row->header = gtk_widget_create_pango_layout(widget, NULL);
+    row->data = gtk_widget_create_pango_layout(widget, NULL);
+    pango_layout_set_font_description(row->header, fontdesc);
+    pango_layout_set_font_description(row->data, fontdesc);
+    row->header_text[0] = '\0';
+    row->data_text[0] = '\0';
+  }
+
+  sprintf(text, block_header_text, b, block->valid, block->dirty, block->lru.value, block->accessCount, shown->cache[b].tag[s]);
+  if(strcmp(text, row->header_text) != 0)
+  {
+    strcpy(row->header_text, text);
+    pango_layout_set_text(row->header, text, -1);
+  }
+
+  /* the bytes, spaced as offset_x() places them */
+  for(o = 0; o < block_size; o++)
+  {
+    length += sprintf(text + length, "%02X", block->data[o]);
+#ifdef CYGWIN
+    if(((o + 1) % 4) == 0)
+      length += sprintf(text + length, "   ");
+    else if((o + 1) % 2 == 0)
+      length += sprintf(text + length, " ");
+#else
+    if(((o + 1) % 4) == 0)
+      length += sprintf(text + length, " ");
+#endif
+  }
+  if(strcmp(text, row->data_text) != 0)
+  {
+    strcpy(row->data_text, text);
+    pango_layout_set_text(row->data, text, length);
+  }
+
+  gdk_draw_layout(widget->window, 
+		  widget->style->fg_gc[GTK_WIDGET_STATE(widget)],
+		  base_x_offset,
+		  y,
+		  row->header);
+  gdk_draw_layout(widget->window, 
+		  widget->style->fg_gc[GTK_WIDGET_STATE(widget)],
+		  base_x_offset + block_header_width,
+		  y,
+		  row->data);
+}
+
+static void free_row_layouts(void)
+{
+  gint b, s;
+
+  for(b = 0; b < MAX_SETS; b++)
+  {
+    for(s = 0; s < MAX_ASSOC; s++)
+    {
+      if(row_layouts[b][s].header != NULL)
+      {
+	g_object_unref(row_layouts[b][s].header);
+	g_object_unref(row_layouts[b][s].data);
+	row_layouts[b][s].header = NULL;
+	row_layouts[b][s].data = NULL;
+      }
+    }
+  }
+}
+
+/* Invalidates the row of block assoc_num of set set_num */
+static void queue_cache_row(unsigned int set_num, unsigned int assoc_num)
+{
+  gtk_widget_queue_draw_area(cache_canvas, base_x_offset - 1, row_y(set_num, assoc_num) - 1, horizontal_line_width + 2, line_height + 2);
+}
+
+/* Invalidates the row a highlight was drawn on */
+static void queue_highlight(const node* highlight)
+{
+  gtk_widget_queue_draw_area(cache_canvas, base_x_offset - 1, highlight->y - 1, horizontal_line_width + 2, line_height + 2);
+}
+
+/*
+  Invalidates the rows of the cache display that the snapshot drawn changed
+  since the last call, and the rows of the old and new highlights; all of
+  it when the cache or its layout changed
+*/
+static void queue_cache_changes(void)
+{
+  const guiSnapshot* shown = &snapshots[drawn_snapshot];
+  const cacheBlock* block;
+  const cacheBlock* old;
+  gint b, s, i;
+
+  if(heatmap)
+  {
+    /* only the cells in view are drawn */
+    gtk_widget_queue_draw(cache_canvas);
+    painted_valid = FALSE;
+    return;
+  }
+
+  if(!painted_valid || !base_display_variables_initialized)
+  {
+    gtk_widget_queue_draw(cache_canvas);
+    painted_valid = base_display_variables_initialized;
+  }
+  else
+  {
+    for(b = 0; b < set_count; b++)
+    {
+      for(s = 0; s < assoc; s++)
+      {
+	block = &shown->cache[b].block[s];
+	old = &painted_cache[b].block[s];
+	if(block->valid != old->valid || block->dirty != old->dirty || block->lru.value != old->lru.value ||
+	   block->accessCount != old->accessCount || shown->cache[b].tag[s] != painted_cache[b].tag[s] ||
+	   memcmp(block->data, old->data, block_size) != 0)
+	  queue_cache_row(b, s);
+      }
+    }
+
+    for(i = 0; i < painted_highlight_count; i++)
+      queue_highlight(&painted_highlights[i]);
+    for(i = 0; i < shown->highlight_count; i++)
+      queue_highlight(&shown->highlights[i]);
+  }
+
+  memcpy(painted_cache, shown->cache, sizeof(painted_cache));
+  memcpy(painted_highlights, shown->highlights, shown->highlight_count * sizeof(node));
+  painted_highlight_count = shown->highlight_count;
+}
+
+/*
+  Finds the sets [first, last) whose rows may lie in the exposed area, for
+  rows that start at top in groups of sets_per_group sets group_height high
+*/
+static void exposed_sets(const GdkEventExpose* event, gint top, gint sets_per_group, gint group_height, gint* first, gint* last)
+{
+  gint low = event->area.y - top;
+  gint high = event->area.y + event->area.height - top;
+
+  *first = (low <= 0) ? 0 : MIN(set_count, (low / group_height) * sets_per_group);
+  *last = (high <= 0) ? 0 : MIN(set_count, ((high / group_height) + 1) * sets_per_group);
+  if(*last < *first)
+    *last = *first;
+}
+
 gboolean draw_cache_display_index(GtkWidget *widget, GdkEventExpose *event, gpointer data)
 {
   gint s;
@@ -359,10 +1046,13 @@ gboolean draw_cache_display_index(GtkWidget *widget, GdkEventExpose *event, gpoi
 
   gint x_offset;
   gint y_offset;
+  gint first, last;
+  gint height;
 
   gchar buffer[250];
   gsize buffer_size;
 
+  guiSnapshot* shown = &snapshots[drawn_snapshot];
   node* current;
 
   /* Get information about height and width of characters */
@@ -413,54 +1103,18 @@ gboolean draw_cache_display_index(GtkWidget *widget, GdkEventExpose *event, gpoi
 		horizontal_line_width,
 		y_offset - (line_height / 2));
 
-  for(b = 0; b < set_count; b++)
+  draw_offset_headers(widget, y_offset - (2 * line_height));
+
+  /* Only the sets in the exposed area are laid out */
+  exposed_sets(event, y_offset, 1, (assoc + 1) * line_height, &first, &last);
+  for(b = first; b < last; b++)
   {
+    y_offset = row_y(b, 0);
     for(s = 0; s < assoc; s++)
     {
-      buffer_size = sprintf(buffer, block_header_text, b, cache[b].block[s].valid, cache[b].block[s].dirty, lru_to_string(b, s), lfu_to_string(b, s), cache[b].block[s].tag);
-      pango_layout_set_text(layout, buffer, buffer_size);
-      gdk_draw_layout(widget->window, 
-		      widget->style->fg_gc[GTK_WIDGET_STATE(widget)],
-		      x_offset,
-		      y_offset,
-		      layout);      
-      x_offset += block_header_width;
-
-      for(o = 0; o < block_size; o++)
-      {
-	/* Print offset headers */
-	if(b == 0 && s == 0 && ((o % 4) == 0))
-	{
-	  buffer_size = sprintf(buffer, "%02X", o);
-	  pango_layout_set_text(layout, buffer, buffer_size);
-	  gdk_draw_layout(widget->window,
-			  widget->style->fg_gc[GTK_WIDGET_STATE(widget)],
-			  x_offset, 
-			  y_offset - (2 * line_height),
-			  layout);
-	}
-
-	buffer_size = sprintf(buffer, "%02X", cache[b].block[s].data[o]);
-	pango_layout_set_text(layout, buffer, buffer_size);
-	gdk_draw_layout(widget->window, 
-			widget->style->fg_gc[GTK_WIDGET_STATE(widget)],
-			x_offset,
-			y_offset,
-			layout);
-	x_offset += byte_width;
-
-#ifdef CYGWIN
-	if(((o + 1) % 4) == 0)
-	  x_offset += (3 * char_width);
-	else if((o + 1) % 2 == 0)
-	  x_offset += char_width;
-#else
-	if(((o + 1) % 4) == 0)
-	  x_offset += char_width;
-#endif
-      }
+      if(ROW_EXPOSED(event, y_offset))
+	draw_cache_row(widget, shown, b, s, y_offset);
       y_offset += line_height;
-      x_offset = base_x_offset;
     }
 
     /* Draw horizontal dividing line */
@@ -470,13 +1124,11 @@ gboolean draw_cache_display_index(GtkWidget *widget, GdkEventExpose *event, gpoi
 		  y_offset + (line_height / 2),
 		  horizontal_line_width,
 		  y_offset + (line_height / 2));
-    y_offset += line_height;
-    x_offset = base_x_offset;
   }
+  height = row_y(set_count, 0);
 
   /* Draw highlights first */
-  current = drawlist;
-  while(current != NULL)
+  for(current = shown->highlights; current < shown->highlights + shown->highlight_count; current++)
   {
     switch(current->type)
     {
@@ -505,7 +1157,7 @@ gboolean draw_cache_display_index(GtkWidget *widget, GdkEventExpose *event, gpoi
 
       for(o = current->block_offset; o < current->block_offset + sizeof(instruction); o++)
       {
-	buffer_size = sprintf(buffer, "%02X", cache[current->block_index].block[current->unit_index].data[o]);
+	buffer_size = sprintf(buffer, "%02X", shown->cache[current->block_index].block[current->unit_index].data[o]);
 	pango_layout_set_text(layout, buffer, buffer_size);
 	gdk_draw_layout_with_colors(widget->window, 
 				    widget->style->fg_gc[GTK_WIDGET_STATE(widget)],
@@ -537,10 +1189,9 @@ gboolean draw_cache_display_index(GtkWidget *widget, GdkEventExpose *event, gpoi
       printf("Invalid type for highlight block\n");
       exit(1);      
     }
-    current = current->next;
   }
 
-  gtk_widget_set_size_request(widget, 400, y_offset);
+  gtk_widget_set_size_request(widget, 400, height);
 
   return TRUE;
 
@@ -554,10 +1205,13 @@ gboolean draw_cache_display_assoc (GtkWidget *widget, GdkEventExpose *event, gpo
 
   gint x_offset;
   gint y_offset;
+  gint first, last;
+  gint height;
 
   gchar buffer[250];
   gsize buffer_size;
 
+  guiSnapshot* shown = &snapshots[drawn_snapshot];
   node* current;
 
   /* Get information about height and width of characters */
@@ -609,72 +1263,32 @@ gboolean draw_cache_display_assoc (GtkWidget *widget, GdkEventExpose *event, gpo
 		  horizontal_line_width,
 		  y_offset - (line_height / 2));
 
-    for(b = 0; b < set_count; b++)
-    {      
-      buffer_size = sprintf(buffer, block_header_text, b, cache[b].block[s].valid, cache[b].block[s].dirty, lru_to_string(b, s), lfu_to_string(b, s), cache[b].block[s].tag);
-      pango_layout_set_text(layout, buffer, buffer_size);
-      gdk_draw_layout(widget->window, 
-		      widget->style->fg_gc[GTK_WIDGET_STATE(widget)],
-		      x_offset,
-		      y_offset,
-		      layout);      
-      x_offset += block_header_width;
-
-      for(o = 0; o < block_size; o++)
-      {
-	/* Print offset headers */
-	if(b == 0 && ((o % 4) == 0))
-	{
-	  buffer_size = sprintf(buffer, "%02X", o);
-	  pango_layout_set_text(layout, buffer, buffer_size);
-	  gdk_draw_layout(widget->window,
-			  widget->style->fg_gc[GTK_WIDGET_STATE(widget)],
-			  x_offset, 
-			  y_offset - (2 * line_height),
-			  layout);
-	}
+    draw_offset_headers(widget, y_offset - (2 * line_height));
 
-	buffer_size = sprintf(buffer, "%02X", cache[b].block[s].data[o]);
-	pango_layout_set_text(layout, buffer, buffer_size);
-	gdk_draw_layout(widget->window, 
-			widget->style->fg_gc[GTK_WIDGET_STATE(widget)],
-			x_offset,
-			y_offset,
-			layout);
-	x_offset += byte_width;
-
-#ifdef CYGWIN
-	if(((o + 1) % 4) == 0)
-	  x_offset += (3 * char_width);
-	else if((o + 1) % 2 == 0)
-	  x_offset += char_width;
-#else
-	if(((o + 1) % 4) == 0)
-	  x_offset += char_width;
-#endif
-      }
+    /* Only the sets in the exposed area are laid out */
+    exposed_sets(event, y_offset, 4, 5 * line_height, &first, &last);
+    for(b = first; b < last; b++)
+    {      
+      y_offset = row_y(b, s);
+      if(ROW_EXPOSED(event, y_offset))
+	draw_cache_row(widget, shown, b, s, y_offset);
       
       /* Draw horizontal dividing line */
       y_offset += line_height;
       if(((b+1) % 4) == 0)
-      {
 	gdk_draw_line(widget->window,
 		      widget->style->fg_gc[GTK_WIDGET_STATE(widget)],
 		      base_x_offset,
 		      y_offset + (line_height / 2),
 		      horizontal_line_width,
 		      y_offset + (line_height / 2));
-
-	y_offset += line_height;
-      }
-      x_offset = base_x_offset;
     }
-    y_offset += line_height;
+    y_offset = row_y(0, s + 1) - cache_header_height;
   }
+  height = y_offset;
 
   /* Draw highlights first */
-  current = drawlist;
-  while(current != NULL)
+  for(current = shown->highlights; current < shown->highlights + shown->highlight_count; current++)
   {
     switch(current->type)
     {
@@ -703,7 +1317,7 @@ gboolean draw_cache_display_assoc (GtkWidget *widget, GdkEventExpose *event, gpo
 
       for(o = current->block_offset; o < current->block_offset + sizeof(instruction); o++)
       {
-	buffer_size = sprintf(buffer, "%02X", cache[current->block_index].block[current->unit_index].data[o]);
+	buffer_size = sprintf(buffer, "%02X", shown->cache[current->block_index].block[current->unit_index].data[o]);
 	pango_layout_set_text(layout, buffer, buffer_size);
 	gdk_draw_layout_with_colors(widget->window, 
 				    widget->style->fg_gc[GTK_WIDGET_STATE(widget)],
@@ -735,17 +1349,110 @@ gboolean draw_cache_display_assoc (GtkWidget *widget, GdkEventExpose *event, gpo
       printf("Invalid type for highlight block\n");
       exit(1);      
     }
-    current = current->next;
   }
 
-  gtk_widget_set_size_request(widget, 400, y_offset);
+  gtk_widget_set_size_request(widget, 400, height);
 
   return TRUE;
 
 }
 
+/* Sets the colour of a heatmap cell from the accesses to its set */
+static void set_heat_color(const heatCell* cell, unsigned long long max_accesses)
+{
+  unsigned long long accesses = cell->hits + cell->misses;
+  GdkColor color;
+  double intensity, miss_share;
+
+  if(accesses == 0)
+  {
+    color.red = color.green = color.blue = 0xe000;
+  }
+  else
+  {
+    intensity = 0.25 + 0.75 * (double)accesses / max_accesses;
+    miss_share = (double)cell->misses / accesses;
+    color.red = 0xffff - (guint16)(intensity * (1.0 - miss_share) * 0xffff);
+    color.green = 0xffff - (guint16)(intensity * miss_share * 0xffff);
+    color.blue = 0xffff - (guint16)(intensity * 0xffff);
+  }
+  gdk_gc_set_rgb_fg_color(heat_gc, &color);
+}
+
+gboolean draw_cache_heatmap(GtkWidget *widget, GdkEventExpose *event, gpointer data)
+{
+  const heatLevel* heat;
+  unsigned long long max_accesses;
+  gchar buffer[250];
+  gsize buffer_size;
+  gint text_height;
+  gint y_offset;
+  gint rows, row, first, last;
+  gint x, bar;
+  unsigned int i;
+  gint id;
+
+  if(base_display_variables_initialized == FALSE)
+  {
+    configure_cache_drawing_parameters(widget);
+    base_display_variables_initialized = TRUE;
+  }
+  if(heat_gc == NULL)
+    heat_gc = gdk_gc_new(widget->window);
+
+  y_offset = base_y_offset;
+  buffer_size = sprintf(buffer, "  One cell per set: darker for more accesses, green for hits, red for misses;\n  the bar shows the ways holding a block\n");
+  pango_layout_set_text(layout, buffer, buffer_size);
+  gdk_draw_layout(widget->window, widget->style->fg_gc[GTK_WIDGET_STATE(widget)], base_x_offset, y_offset, layout);
+  pango_layout_get_pixel_size(layout, NULL, &text_height);
+  y_offset += text_height + line_height;
+
+  for(id = L1I; id < LEVEL_COUNT; id++)
+  {
+    heat = &snapshots[drawn_snapshot].heat[id];
+    if(heat->set_count == 0)
+      continue;
+
+    buffer_size = sprintf(buffer, "  %s: %u sets x %u ways", memory_hierarchy.level[id].name, heat->set_count, heat->assoc);
+    pango_layout_set_text(layout, buffer, buffer_size);
+    gdk_draw_layout(widget->window, widget->style->fg_gc[GTK_WIDGET_STATE(widget)], base_x_offset, y_offset, layout);
+    y_offset += 2 * line_height;
+
+    max_accesses = 1;
+    for(i = 0; i < heat->set_count; i++)
+      max_accesses = MAX(max_accesses, heat->cells[i].hits + heat->cells[i].misses);
+
+    /* Only the rows of cells in the exposed area are drawn */
+    rows = (heat->set_count + HEAT_COLUMNS - 1) / HEAT_COLUMNS;
+    first = MAX(0, (event->area.y - y_offset) / HEAT_CELL);
+    last = MIN(rows, (event->area.y + event->area.height - y_offset) / HEAT_CELL + 1);
+    for(row = first; row < last; row++)
+    {
+      for(i = row * HEAT_COLUMNS; i < heat->set_count && i < (row + 1) * HEAT_COLUMNS; i++)
+      {
+	x = base_x_offset + (i % HEAT_COLUMNS) * HEAT_CELL;
+	set_heat_color(&heat->cells[i], max_accesses);
+	gdk_draw_rectangle(widget->window, heat_gc, TRUE, x, y_offset + row * HEAT_CELL, HEAT_CELL - 1, HEAT_CELL - 1);
+
+	bar = (HEAT_CELL - 1) * heat->cells[i].valid / heat->assoc;
+	if(bar != 0)
+	  gdk_draw_rectangle(widget->window, widget->style->fg_gc[GTK_WIDGET_STATE(widget)], TRUE,
+			     x, y_offset + row * HEAT_CELL + HEAT_CELL - 3, bar, 2);
+      }
+    }
+    y_offset += rows * HEAT_CELL + line_height;
+  }
+
+  gtk_widget_set_size_request(widget, base_x_offset + HEAT_COLUMNS * HEAT_CELL, y_offset);
+
+  return TRUE;
+}
+
 gboolean draw_cache_display (GtkWidget *widget, GdkEventExpose *event, gpointer data)
 {
+  if(heatmap)
+    return draw_cache_heatmap(widget, event, data);
+
   switch(view)
   {
   case ASSOC:
@@ -762,20 +1469,19 @@ gboolean draw_cache_display (GtkWidget *widget, GdkEventExpose *event, gpointer
 
 void refresh_cache_display()
 {
-  if(IS_GUI_ACTIVE())
-    gtk_widget_queue_draw(cache_canvas);
+  /* during a run, the worker publishes the cache on its own */
+  if(IS_GUI_ACTIVE() && !worker_active)
+  {
+    capture_cache(&snapshots[drawn_snapshot]);
+    queue_cache_changes();
+    show_stats();
+  }
 }
 
 void flush_drawlist()
 {
-  node* current;
-
-  while(drawlist != NULL)
-  {
-    current = drawlist;
-    drawlist = current->next;
-    free(current);
-  }
+  drawlist_next = 0;
+  drawlist_count = 0;
 }
 
 GtkWidget* build_drawing_panel()
@@ -800,69 +1506,39 @@ GtkWidget* build_drawing_panel()
    Replacement policy related functions
 *****************************************************************************/
 
-gboolean random_listener(GtkWidget* widget, gpointer data)
+gboolean replacement_policy_listener(GtkWidget* widget, gpointer data)
 {
   if(GTK_TOGGLE_BUTTON(widget)->active)
-    panel_replacement_policy = RANDOM;
+    panel_replacement_policy = (ReplacementPolicy)GPOINTER_TO_INT(data);
 
   return TRUE;
 }
 
-gboolean lru_listener(GtkWidget* widget, gpointer data)
-{
-  if(GTK_TOGGLE_BUTTON(widget)->active)
-    panel_replacement_policy = LRU;
-
-  return TRUE;
-}
-
-gboolean lfu_listener(GtkWidget* widget, gpointer data)
-{
-  if(GTK_TOGGLE_BUTTON(widget)->active)
-    panel_replacement_policy = LFU;
-
-  return TRUE;
-} 
-
 GtkWidget* build_replace_policy_panel(void)
 {
   GtkWidget* frame;
   GtkWidget* box;
+  GSList* group;
+  gint p;
 
   box = gtk_vbox_new(FALSE, 0);
 
-  /* Build Random Policy radio button */
-  random_policy_button = gtk_radio_button_new_with_label(NULL, "Random");
-  g_signal_connect(G_OBJECT(random_policy_button), "clicked", G_CALLBACK(random_listener), NULL);
-
-  /* Build LRU Policy radio button */
-  lru_policy_button = gtk_radio_button_new_with_label(gtk_radio_button_get_group(GTK_RADIO_BUTTON(random_policy_button)), "LRU");
-  g_signal_connect(G_OBJECT(lru_policy_button), "clicked", G_CALLBACK(lru_listener), NULL);
-
-  /* Build LFU Policy radio button */
-  lfu_policy_button = gtk_radio_button_new_with_label(gtk_radio_button_get_group(GTK_RADIO_BUTTON(random_policy_button)), "LFU");
-  g_signal_connect(G_OBJECT(lfu_policy_button), "clicked", G_CALLBACK(lfu_listener), NULL);
-
-  /* Pack the radio buttons */
-  gtk_box_pack_start(GTK_BOX(box), lfu_policy_button, TRUE, TRUE, 0);
-  gtk_box_pack_start(GTK_BOX(box), lru_policy_button, TRUE, TRUE, 0);
-  gtk_box_pack_start(GTK_BOX(box), random_policy_button, TRUE, TRUE, 0);
+  /* Build and pack one radio button per policy */
+  group = NULL;
+  for(p = 0; p < REPLACEMENT_POLICY_COUNT; p++)
+  {
+    replacement_policy_button[p] = gtk_radio_button_new_with_label(group, replacement_policies[p].name);
+    group = gtk_radio_button_get_group(GTK_RADIO_BUTTON(replacement_policy_button[p]));
+    g_signal_connect(G_OBJECT(replacement_policy_button[p]), "clicked", G_CALLBACK(replacement_policy_listener), GINT_TO_POINTER(p));
+    gtk_box_pack_start(GTK_BOX(box), replacement_policy_button[p], TRUE, TRUE, 0);
+  }
 
   /* Initialize radio buttons */
-  switch(panel_replacement_policy = policy)
-  {
-  case(RANDOM):
-    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(random_policy_button), TRUE);
-    break;
-  case(LRU):
-    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(lru_policy_button), TRUE);
-    break;
-  case(LFU):
-    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(lfu_policy_button), TRUE);
-    break;
-  default:
+  panel_replacement_policy = policy;
+  if(policy < REPLACEMENT_POLICY_COUNT)
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(replacement_policy_button[policy]), TRUE);
+  else
     printf("Impossible situation with policy: %u", policy);
-  }
 
   /* Pack radio buttons */
   frame = gtk_frame_new("Replacement Policy");
@@ -938,7 +1614,10 @@ GtkWidget* build_memory_sync_policy_panel(void)
 gboolean assoc_view_listener(GtkWidget* widget, gpointer data)
 {
   if(GTK_TOGGLE_BUTTON(widget)->active)
+  {
     panel_cache_view = ASSOC;
+    panel_heatmap = FALSE;
+  }
 
   return TRUE;
 }
@@ -946,7 +1625,18 @@ gboolean assoc_view_listener(GtkWidget* widget, gpointer data)
 gboolean index_view_listener(GtkWidget* widget, gpointer data)
 {
   if(GTK_TOGGLE_BUTTON(widget)->active)
+  {
     panel_cache_view = INDEX;
+    panel_heatmap = FALSE;
+  }
+
+  return TRUE;
+}
+
+gboolean heatmap_view_listener(GtkWidget* widget, gpointer data)
+{
+  if(GTK_TOGGLE_BUTTON(widget)->active)
+    panel_heatmap = TRUE;
 
   return TRUE;
 }
@@ -966,9 +1656,14 @@ GtkWidget* build_arrange_panel(void)
   assoc_view_button = gtk_radio_button_new_with_label(gtk_radio_button_get_group(GTK_RADIO_BUTTON(index_view_button)), "Associativity Based");
   g_signal_connect(G_OBJECT(assoc_view_button), "clicked", G_CALLBACK(assoc_view_listener), NULL);
 
+  /* Build Heatmap radio button */
+  heatmap_view_button = gtk_radio_button_new_with_label(gtk_radio_button_get_group(GTK_RADIO_BUTTON(index_view_button)), "Heatmap of All Levels");
+  g_signal_connect(G_OBJECT(heatmap_view_button), "clicked", G_CALLBACK(heatmap_view_listener), NULL);
+
   /* Pack the radio buttons */
   gtk_box_pack_start(GTK_BOX(box), index_view_button, TRUE, TRUE, 0);
   gtk_box_pack_start(GTK_BOX(box), assoc_view_button, TRUE, TRUE, 0);
+  gtk_box_pack_start(GTK_BOX(box), heatmap_view_button, TRUE, TRUE, 0);
 
   /* Initialize radio buttons */
   switch(panel_cache_view = view)
@@ -983,6 +1678,8 @@ GtkWidget* build_arrange_panel(void)
     printf("Impossible situation with cache view: %u", view);
     exit(1);
   }
+  if((panel_heatmap = heatmap))
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(heatmap_view_button), TRUE);
 
   /* Pack radio buttons */
   frame = gtk_frame_new("Cache View Basis");
@@ -1183,14 +1880,15 @@ gboolean configure_button_listener(GtkWidget *widget, GdkEventExpose *event, gpo
     validate_cache_parameters(atoi(gtk_entry_get_text(GTK_ENTRY(index_entry))),
 			      atoi(gtk_entry_get_text(GTK_ENTRY(assoc_entry))),
 			      atoi(gtk_entry_get_text(GTK_ENTRY(block_entry))));
-    assert(panel_replacement_policy == RANDOM || panel_replacement_policy == LRU || panel_replacement_policy == LFU);
+    assert(panel_replacement_policy >= 0 && panel_replacement_policy < REPLACEMENT_POLICY_COUNT);
     policy = panel_replacement_policy;
     assert(panel_memory_sync_policy == WRITE_BACK || panel_memory_sync_policy == WRITE_THROUGH);
     memory_sync_policy = panel_memory_sync_policy;
     assert(panel_cache_view == INDEX || panel_cache_view == ASSOC);
     view = panel_cache_view;
+    heatmap = panel_heatmap;
 
-    sprintf(buffer, "Cache parameters changed:\n + set count = %d\n + associativity = %d\n + block size = %d\n + replacement policy = %s\n + memory sync policy = %s\n", set_count, assoc, block_size, (policy == RANDOM ? "Random" : (policy == LRU ? "LRU" : "LFU")), (memory_sync_policy == WRITE_BACK ? "Write Back" : "Write Through"));
+    sprintf(buffer, "Cache parameters changed:\n + set count = %d\n + associativity = %d\n + block size = %d\n + replacement policy = %s\n + memory sync policy = %s\n", set_count, assoc, block_size, replacement_policies[policy].name, (memory_sync_policy == WRITE_BACK ? "Write Back" : "Write Through"));
     append_log(buffer);
     configure_cache_drawing_parameters(cache_canvas);
     flush_cache();
@@ -1276,47 +1974,33 @@ gboolean step_button_listener(GtkWidget *widget, GdkEventExpose *event, gpointer
   return TRUE;
 }
 
-gboolean call_step_processor(gpointer data)
+/* Applies the speed of the run dialog, to the run going on or the next one */
+static void set_run_delay(void)
 {
-  step_processor();
-  return TRUE;
+  if(gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(full_speed_button)))
+    g_atomic_int_set(&run_delay, 0);
+  else
+    g_atomic_int_set(&run_delay, (gint)gtk_range_get_value(GTK_RANGE(speed_slider)));
 }
 
 gboolean start_button_listener(GtkWidget *widget, GdkEventExpose *event, gpointer data)
 {
-  if(timer_active == FALSE)
-  {
-    timer_id = g_timeout_add(gtk_range_get_value(GTK_RANGE(speed_slider)), call_step_processor, NULL);
-    timer_active = TRUE;
-  }
-  else
-  {
-    g_source_remove(timer_id);
-    timer_id = g_timeout_add(gtk_range_get_value(GTK_RANGE(speed_slider)), call_step_processor, NULL);
-  }
-
+  set_run_delay();
+  start_run();
   return TRUE;
 }
 
 gboolean speed_slider_listener(GtkWidget *widget, GdkEventExpose *event, gpointer data)
 {
-  if(timer_active == TRUE)
-  {
-    stop_run();
-    timer_id = g_timeout_add(gtk_range_get_value(GTK_RANGE(speed_slider)), call_step_processor, NULL);
-    timer_active = TRUE;
-  }
-
+  set_run_delay();
   return TRUE;
 }
 
+/* Asks the run to stop; the worker calls it at the end of the program */
 void stop_run()
 {
-  if(timer_active == TRUE)
-  {
-    g_source_remove(timer_id);
-    timer_active = FALSE;
-  }
+  if(worker_active)
+    g_atomic_int_set(&worker_stop, TRUE);
 }
 
 gboolean stop_button_listener(GtkWidget *widget, GdkEventExpose *event, gpointer data)
@@ -1351,23 +2035,26 @@ gboolean run_button_listener(GtkWidget *widget, GdkEventExpose *event, gpointer
   max_speed_label = gtk_label_new(buffer);
   gtk_range_set_value(GTK_RANGE(speed_slider), 1000);
   gtk_widget_set_size_request(speed_slider, 200, 40);
+  full_speed_button = gtk_check_button_new_with_label("Full speed");
   start_button = gtk_button_new_with_label("Start");
   stop_button = gtk_button_new_with_label("Stop");
 
   /* Give widgets some functionality */
   gtk_signal_connect(GTK_OBJECT(GTK_HSCALE(speed_slider)->scale.range.adjustment), "value_changed", GTK_SIGNAL_FUNC(speed_slider_listener), NULL);  
+  g_signal_connect(G_OBJECT(full_speed_button), "toggled", G_CALLBACK(speed_slider_listener), NULL);
   g_signal_connect(G_OBJECT(start_button), "clicked", G_CALLBACK(start_button_listener), NULL);
   g_signal_connect(G_OBJECT(stop_button), "clicked", G_CALLBACK(stop_button_listener), NULL);
   
   /* Arrange widgets that will gointo dialog */
-  run_panel = gtk_table_new(20, 4, FALSE);
-  gtk_table_attach_defaults(GTK_TABLE(run_panel), gtk_label_new("To start the test, click on \"Start\".\nIf you want to change speed you must click \"Start\" again."), 0, 20, 0, 2);
+  run_panel = gtk_table_new(20, 5, FALSE);
+  gtk_table_attach_defaults(GTK_TABLE(run_panel), gtk_label_new("To start the test, click on \"Start\".\nThe speed can be changed while the test runs."), 0, 20, 0, 2);
   gtk_table_attach_defaults(GTK_TABLE(run_panel), min_speed_label, 0, 1, 2, 3);
   gtk_table_attach_defaults(GTK_TABLE(run_panel), speed_slider, 1, 19, 2, 3);
   gtk_table_attach_defaults(GTK_TABLE(run_panel), max_speed_label, 19, 20, 2, 3);
-  gtk_table_attach_defaults(GTK_TABLE(run_panel), start_button, 0, 10, 3, 4);
-  gtk_table_attach_defaults(GTK_TABLE(run_panel), stop_button, 10, 20, 3, 4);
-  gtk_widget_set_size_request(run_panel, 400, 160);
+  gtk_table_attach_defaults(GTK_TABLE(run_panel), full_speed_button, 0, 20, 3, 4);
+  gtk_table_attach_defaults(GTK_TABLE(run_panel), start_button, 0, 10, 4, 5);
+  gtk_table_attach_defaults(GTK_TABLE(run_panel), stop_button, 10, 20, 4, 5);
+  gtk_widget_set_size_request(run_panel, 400, 190);
 
   /* Place widgets into dialog and display */
   gtk_container_add(GTK_CONTAINER(GTK_DIALOG(dialog)->vbox), run_panel);
@@ -1376,10 +2063,10 @@ gboolean run_button_listener(GtkWidget *widget, GdkEventExpose *event, gpointer
   /* Block for user response */
   gtk_dialog_run(GTK_DIALOG(dialog));
 
-  if(timer_active == TRUE)
+  if(worker_active)
   {
-    g_source_remove(timer_id);
-    timer_active = FALSE;
+    stop_run();
+    finish_run();
   }
 
   gtk_widget_destroy(dialog);
@@ -1405,6 +2092,11 @@ gboolean reset_cache_button_listener(GtkWidget *widget, GdkEventExpose *event, g
 gboolean reset_output_button_listener(GtkWidget *widget, GdkEventExpose *event, gpointer data)
 {
   GtkTextBuffer* buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(textbox));
+
+  /* messages not shown yet are cleared too; the saved log keeps them */
+  pthread_mutex_lock(&pending_log_lock);
+  g_string_truncate(pending_log, 0);
+  pthread_mutex_unlock(&pending_log_lock);
   gtk_text_buffer_set_text(buffer, "--Output Cleared--\n", -1);
 
   return TRUE;
@@ -1506,12 +2198,22 @@ GtkWidget* build_button_panel()
 void exit_program(GtkWidget* widget, gpointer data)
 {
   /* free data */
+  free_row_layouts();
   if(fontdesc != NULL)
     pango_font_description_free(fontdesc);
 
   if(layout != NULL)
     g_object_unref(layout);
 
+  if(heat_gc != NULL)
+    g_object_unref(heat_gc);
+
+  pthread_mutex_lock(&pending_log_lock);
+  if(log_file != NULL)
+    fclose(log_file);
+  log_file = NULL;
+  pthread_mutex_unlock(&pending_log_lock);
+
   gtk_main_quit();
 }
 
@@ -1541,8 +2243,10 @@ int build_gui(int argc, char** argv)
   GtkWidget* regcache_vpaned;
 
   GtkWidget* reglog_hpaned;
+  GtkWidget* logstats_hpaned;
   GtkWidget* register_panel;
   GtkWidget* log_panel;
+  GtkWidget* stats_panel;
 
   GtkWidget* button_panel;
 
@@ -1552,8 +2256,7 @@ int build_gui(int argc, char** argv)
   layout = NULL;
   fontdesc = NULL;
   base_display_variables_initialized = FALSE;
-  timer_active = FALSE;
-  drawlist = NULL;
+  flush_drawlist();
 
   /* Initialize window */
   main_window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
@@ -1570,10 +2273,15 @@ int build_gui(int argc, char** argv)
   /* Build panels */
   register_panel = build_register_panel();
   log_panel = build_log_panel();
+  stats_panel = build_stats_panel();
+
+  logstats_hpaned = gtk_hpaned_new();
+  gtk_paned_add1(GTK_PANED(logstats_hpaned), log_panel);
+  gtk_paned_add2(GTK_PANED(logstats_hpaned), stats_panel);
 
   reglog_hpaned = gtk_hpaned_new();
   gtk_paned_add1(GTK_PANED(reglog_hpaned), register_panel);
-  gtk_paned_add2(GTK_PANED(reglog_hpaned), log_panel);
+  gtk_paned_add2(GTK_PANED(reglog_hpaned), logstats_hpaned);
 
   drawing_panel = build_drawing_panel();
   button_panel = build_button_panel();
@@ -1584,7 +2292,8 @@ int build_gui(int argc, char** argv)
 
   /* Set sizes of panels */
   gtk_widget_set_size_request(register_panel, WINDOW_DEFAULT_WIDTH * .50, WINDOW_DEFAULT_HEIGHT * .25);
-  gtk_widget_set_size_request(log_panel, WINDOW_DEFAULT_WIDTH * .50, WINDOW_DEFAULT_HEIGHT * .25);
+  gtk_widget_set_size_request(log_panel, WINDOW_DEFAULT_WIDTH * .25, WINDOW_DEFAULT_HEIGHT * .25);
+  gtk_widget_set_size_request(stats_panel, WINDOW_DEFAULT_WIDTH * .25, WINDOW_DEFAULT_HEIGHT * .25);
   gtk_widget_set_size_request(drawing_panel, WINDOW_DEFAULT_WIDTH, WINDOW_DEFAULT_HEIGHT * .68);
 
   /* Place panels into window */  
@@ -1593,6 +2302,8 @@ int build_gui(int argc, char** argv)
 
   /* Display window */
   gtk_widget_show_all(main_window);    
+  refresh_register_display();
+  refresh_cache_display();
 
   /* Load file if any */
   if(argc >= 2)
@@ -1609,41 +2320,21 @@ int build_gui(int argc, char** argv)
 
 void highlight_block(unsigned int set_num, unsigned int assoc_num) 
 { 
-  node* new_item;
+  node* new_item = new_highlight();
 
-  new_item = (node*)(malloc(sizeof(node)));
   new_item->type = HIGHLIGHT_BLOCK;
   new_item->x = base_x_offset;
 
-  switch(view)
-  {
-  case INDEX:
-    new_item->y = base_y_offset + cache_header_height + set_num * (line_height + (line_height * assoc)) + (assoc_num * line_height);
-    break;
-  case ASSOC:
-    new_item->y = base_y_offset + 
-                  (assoc_num * (cache_header_height + line_height + cache_unit_height + ((set_count / 4) * line_height))) + 
-                  cache_header_height + 
-                  (set_num * line_height) + 
-                  ((set_num / 4) * line_height);
-    break;
-  default:
-    printf("Invalid arrange mode");
-    exit(1);
-  }    
+  new_item->y = row_y(set_num, assoc_num);
       
   new_item->width = horizontal_line_width;
   new_item->height = line_height;
-  new_item->next = drawlist;
-
-  drawlist = new_item;
 }
 
 void highlight_offset(unsigned int set_num, unsigned int assoc_num, unsigned int offset, CacheAction action)
 {
-  node* new_item;
+  node* new_item = new_highlight();
 
-  new_item = (node*)(malloc(sizeof(node)));
   new_item->type = HIGHLIGHT_OFFSET;
   new_item->unit_index = assoc_num;
   new_item->block_index = set_num;
@@ -1664,33 +2355,14 @@ void highlight_offset(unsigned int set_num, unsigned int assoc_num, unsigned int
     exit(1);
   }
 
+  new_item->x = offset_x(offset);
 #ifdef CYGWIN
-  new_item->x = base_x_offset + block_header_width + (offset * byte_width) + ((offset / 4) * (char_width * 3)) + (((offset / 2) * char_width) - ((offset / 4) * char_width));
   new_item->width = (sizeof(instruction) * byte_width) + char_width;
 #else
-  new_item->x = base_x_offset + block_header_width + (offset * byte_width) + ((offset / 4) * char_width);
   new_item->width = (sizeof(instruction) * byte_width);
 #endif
 
-  switch(view)
-  {
-  case INDEX:
-    new_item->y = base_y_offset + cache_header_height + set_num * (line_height + (line_height * assoc)) + (assoc_num * line_height);
-    break;
-  case ASSOC:
-    new_item->y = base_y_offset + 
-                  (assoc_num * (cache_header_height + line_height + cache_unit_height + ((set_count / 4) * line_height))) + 
-                  cache_header_height + 
-                  (set_num * line_height) + 
-                  ((set_num / 4) * line_height);
-    break;
-  default:
-    printf("Invalid arrange mode");
-    exit(1);
-  }    
+  new_item->y = row_y(set_num, assoc_num);
 
   new_item->height = line_height;
-  new_item->next = drawlist;
-
-  drawlist = new_item; 
 }
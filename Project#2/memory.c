@@ -8,68 +8,522 @@ unsigned int assoc;
 ReplacementPolicy policy;
 MemorySyncPolicy memory_sync_policy;
 
+/* Define Cache Hierarchy of the simulated CPU */
+cacheHierarchy memory_hierarchy = {
+  .level = {
+    { .name = "L1I", .latency = 1 },
+    { .name = "L1D", .latency = 1 },
+    { .name = "L2", .latency = 10 },
+    { .name = "L3", .latency = 30 }
+  },
+  .displayed = 1,
+  .classify_misses = 1,
+  .profile_pcs = 1,
+  .dram = accessDRAM,
+  .random_state = 1,
+  .dram_latency = 100
+};
+
+unsigned int uint_log2(unsigned int w);
 
 void init_memory() 
 {
+  init_tag_match();
+  configure_physical_memory(DEFAULT_PHYSICAL_PAGES);
   flush_cache();
 }
 
-void flush_cache() 
+const char* inclusion_name(InclusionPolicy inclusion)
+{
+  switch(inclusion)
+  {
+  case NON_INCLUSIVE:
+    return "Non-inclusive";
+  case INCLUSIVE:
+    return "Inclusive";
+  case EXCLUSIVE:
+    return "Exclusive";
+  default:
+    return "Unknown";
+  }
+}
+
+/* returns the first existing level of h from first to last, else NULL */
+static cacheLevel* first_enabled_level(cacheHierarchy* h, CacheLevelId first, CacheLevelId last)
+{
+  int id;
+
+  for(id = first; id <= last; id++)
+  {
+    if(LEVEL_ENABLED(&h->level[id]))
+      return &h->level[id];
+  }
+
+  return NULL;
+}
+
+/* returns 0 if every existing level above lower uses blocks no larger than max */
+static int upper_blocks_fit(cacheHierarchy* h, cacheLevel* lower, unsigned int max, int exact)
+{
+  int id;
+  cacheLevel* upper;
+
+  for(id = L1I; id < LEVEL_COUNT; id++)
+  {
+    upper = &h->level[id];
+    if(!LEVEL_ENABLED(upper) || upper == lower || upper->next == NULL)
+      continue;
+
+    /* walk down from upper to see whether it sits above lower */
+    while(upper->next != NULL && upper->next != lower)
+      upper = upper->next;
+    if(upper->next != lower)
+      continue;
+
+    if(h->level[id].block_size > max || (exact && h->level[id].block_size != max))
+      return -1;
+  }
+
+  return 0;
+}
+
+/*
+  Connects the existing levels of a hierarchy to each other: L1I and L1D
+  miss into the first of L2/L3, L2 into L3, and the last level into DRAM.
+*/
+void link_hierarchy(cacheHierarchy* h)
+{
+  char buffer[200];
+  cacheLevel* level;
+  int id;
+
+  h->level[L3].next = NULL;
+  h->level[L2].next = first_enabled_level(h, L3, L3);
+  h->level[L1D].next = first_enabled_level(h, L2, L3);
+  h->level[L1I].next = first_enabled_level(h, L2, L3);
+
+  for(id = L1I; id < LEVEL_COUNT; id++)
+  {
+    level = &h->level[id];
+    level->hierarchy = h;
+    if(!LEVEL_ENABLED(level))
+      continue;
+
+    level->offset_bits = uint_log2(level->block_size);
+    level->index_bits = uint_log2(level->set_count);
+
+    /* Inclusion is only kept by whole blocks: an inclusive level must have
+       blocks at least as large as the levels above it, an exclusive level
+       blocks of exactly the same size */
+    if((level->inclusion == INCLUSIVE && upper_blocks_fit(h, level, level->block_size, 0) != 0) ||
+       (level->inclusion == EXCLUSIVE && upper_blocks_fit(h, level, level->block_size, 1) != 0))
+    {
+      if(h->displayed)
+      {
+	sprintf(buffer, "%s block size does not allow a %s policy; using Non-inclusive\n", level->name, inclusion_name(level->inclusion));
+	append_log(buffer);
+      }
+      level->inclusion = NON_INCLUSIVE;
+    }
+  }
+
+  /* Blocks move into an exclusive level whole, so the level above it
+     cannot leave sectors out */
+  for(id = L1I; id < LEVEL_COUNT; id++)
+  {
+    level = &h->level[id];
+    if(LEVEL_ENABLED(level) && SECTOR_SIZE(level) < level->block_size && level->next != NULL && level->next->inclusion == EXCLUSIVE)
+    {
+      if(h->displayed)
+      {
+	sprintf(buffer, "%s cannot be sectored above an Exclusive level; using whole blocks\n", level->name);
+	append_log(buffer);
+      }
+      level->sector_size = 0;
+    }
+  }
+
+  h->instruction_cache = first_enabled_level(h, L1I, L3);
+  h->data_cache = first_enabled_level(h, L1D, L3);
+}
+
+/*
+  Links the hierarchy of the simulated CPU, after copying the L1 parameters
+  set through the configuration dialog/command into its L1D level.
+*/
+void link_cache_levels()
+{
+  cacheLevel* level = &memory_hierarchy.level[L1D];
+
+  level->set_count = set_count;
+  level->assoc = assoc;
+  level->block_size = block_size;
+  level->policy = policy;
+  level->memory_sync_policy = memory_sync_policy;
+  level->inclusion = NON_INCLUSIVE;
+  level->set = cache;
+
+  link_hierarchy(&memory_hierarchy);
+}
+
+/*
+  Changes the parameters of one level of a hierarchy, allocating its sets.
+  Flushes the whole hierarchy.
+
+  returns 0 if successful, non-zero if the level could not be allocated.
+*/
+int configure_hierarchy_level(cacheHierarchy* h, CacheLevelId id, int set_count_value, int assoc_value, int block_size_value, ReplacementPolicy p, MemorySyncPolicy m, InclusionPolicy inclusion)
+{
+  cacheLevel* level = &h->level[id];
+  unsigned int old_set_count = level->set_count;
+
+  validate_level_parameters(level, set_count_value, assoc_value, block_size_value);
+  level->policy = p;
+  level->memory_sync_policy = m;
+  level->inclusion = (id == L1I || id == L1D) ? NON_INCLUSIVE : inclusion;
+
+  if(level->set == NULL || level->set_count != old_set_count)
+  {
+    free(level->set);
+    level->set = NULL;
+    if(level->set_count != 0 && (level->set = (cacheSet*)malloc(level->set_count * sizeof(cacheSet))) == NULL)
+    {
+      level->set_count = 0;
+      flush_hierarchy(h);
+      return -1;
+    }
+  }
+
+  flush_hierarchy(h);
+  return 0;
+}
+
+/*
+  Sets the prefetcher of one level of a hierarchy.  Flushes the whole
+  hierarchy.
+
+  returns 0 if successful, non-zero if the prefetcher could not be allocated.
+*/
+int configure_prefetcher(cacheHierarchy* h, CacheLevelId id, const prefetchConfig* config)
+{
+  cacheLevel* level = &h->level[id];
+
+  level->prefetch = *config;
+  flush_hierarchy(h);
+
+  return (level->prefetch.kind != PREFETCH_NONE && LEVEL_ENABLED(level) && level->prefetcher == NULL) ? -1 : 0;
+}
+
+/*
+  Sets whether write misses allocate in one level of a hierarchy, and the
+  size of its sectors (0 for whole blocks).  Flushes the whole hierarchy.
+
+  returns 0 if successful, non-zero if the sector size is not valid.
+*/
+int configure_write_policy(cacheHierarchy* h, CacheLevelId id, AllocationPolicy allocation, unsigned int sector_size)
+{
+  cacheLevel* level = &h->level[id];
+
+  if(sector_size != 0 && (sector_size < sizeof(word) || sector_size > MAX_BLOCK_SIZE || (sector_size & (sector_size - 1)) != 0))
+    return -1;
+
+  level->allocation = allocation;
+  level->sector_size = sector_size;
+  flush_hierarchy(h);
+  return 0;
+}
+
+/*
+  Sets the size of the victim cache and write buffer of one level of a
+  hierarchy; 0 removes them.  Flushes the whole hierarchy.
+
+  returns 0 if successful, non-zero if they could not be allocated.
+*/
+int configure_level_buffers(cacheHierarchy* h, CacheLevelId id, unsigned int victim_lines, unsigned int write_buffer_depth)
+{
+  cacheLevel* level = &h->level[id];
+
+  level->victim_lines = victim_lines;
+  level->write_buffer_depth = write_buffer_depth;
+  flush_hierarchy(h);
+
+  if(!LEVEL_ENABLED(level))
+    return 0;
+  return ((victim_lines != 0 && level->inclusion != EXCLUSIVE && SECTOR_SIZE(level) == level->block_size && level->victim == NULL) ||
+	  (write_buffer_depth != 0 && level->write_buffer == NULL)) ? -1 : 0;
+}
+
+/*
+  Sets the number of MSHRs of one level of a hierarchy; 0 makes it block on
+  every miss in cycle mode.  Flushes the whole hierarchy.
+
+  returns 0 if successful, non-zero if they could not be allocated.
+*/
+int configure_mshrs(cacheHierarchy* h, CacheLevelId id, unsigned int mshrs)
+{
+  cacheLevel* level = &h->level[id];
+
+  level->mshrs = mshrs;
+  flush_hierarchy(h);
+
+  return (mshrs != 0 && LEVEL_ENABLED(level) && level->mshr == NULL) ? -1 : 0;
+}
+
+/*
+  Sets the DRAM timing model of a hierarchy; channels of 0 turns it off.
+  Flushes the whole hierarchy.
+
+  returns 0 if successful, non-zero if the configuration is not valid or
+  could not be allocated.
+*/
+int configure_dram_timing(cacheHierarchy* h, const dramConfig* config)
+{
+  if(config->channels != 0 &&
+     (config->channels > MAX_DRAM_CHANNELS || (config->channels & (config->channels - 1)) != 0 ||
+      config->banks == 0 || config->banks > MAX_DRAM_BANKS || (config->banks & (config->banks - 1)) != 0 ||
+      config->row_size < MAX_BLOCK_SIZE || (config->row_size & (config->row_size - 1)) != 0 ||
+      config->queue_depth == 0 || config->queue_depth > MAX_DRAM_QUEUE || config->mapping >= DRAM_MAPPING_COUNT))
+    return -1;
+
+  h->dram_config = *config;
+  flush_hierarchy(h);
+
+  return (h->dram_config.channels != 0 && h->dram_timing == NULL) ? -1 : 0;
+}
+
+/*
+  Changes the parameters of one level of the hierarchy of the simulated CPU;
+  the L1D level is the one shown in the cache display.  Flushes the whole
+  hierarchy.
+
+  returns 0 if successful, non-zero if the level could not be allocated.
+*/
+int configure_level(CacheLevelId id, int set_count_value, int assoc_value, int block_size_value, ReplacementPolicy p, MemorySyncPolicy m, InclusionPolicy inclusion)
+{
+  if(id != L1D)
+    return configure_hierarchy_level(&memory_hierarchy, id, set_count_value, assoc_value, block_size_value, p, m, inclusion);
+
+  validate_cache_parameters(set_count_value, assoc_value, block_size_value);
+  policy = p;
+  memory_sync_policy = m;
+  flush_cache();
+  return 0;
+}
+
+static void flush_level(cacheLevel* level, unsigned int sets)
 {
   int set_index;
   int block_index;
 
   /* for each set */
-  for( set_index=0; set_index < set_count; set_index++ )
+  for( set_index=0; set_index < sets; set_index++ )
   {
     /* for each block in the set */
-    for( block_index=0; block_index < assoc; block_index++ ) 
+    for( block_index=0; block_index < MAX_ASSOC; block_index++ ) 
     {
-      cache[set_index].block[block_index].valid = INVALID;
-      cache[set_index].block[block_index].dirty = VIRGIN;
-      init_lru(set_index, block_index);
-      init_lfu(set_index, block_index);
+      level->set[set_index].tag[block_index] = INVALID_TAG;
+      level->set[set_index].block[block_index].valid = INVALID;
+      level->set[set_index].block[block_index].dirty = VIRGIN;
+      level->set[set_index].block[block_index].accessCount = 0;
+      level->set[set_index].block[block_index].lru.value = 0;
+      level->set[set_index].block[block_index].sector_valid = 0;
+      level->set[set_index].block[block_index].sector_dirty = 0;
+      level->set[set_index].block[block_index].prefetched = 0;
+      replacement_policies[level->policy].init(level, set_index, block_index);
     }
+    level->set[set_index].hits = 0;
+    level->set[set_index].misses = 0;
+    memset(level->set[set_index].miss_classes, 0, sizeof(level->set[set_index].miss_classes));
   }
+
+  if(level->hierarchy->classify_misses && LEVEL_ENABLED(level))
+    reset_miss_classifier(level);
+  else
+    free_miss_classifier(level);
+
+  if(level->prefetch.kind != PREFETCH_NONE && LEVEL_ENABLED(level))
+    reset_prefetcher(level);
+  else
+    free_prefetcher(level);
+
+  if((level->victim_lines != 0 || level->write_buffer_depth != 0) && LEVEL_ENABLED(level))
+    reset_level_buffers(level);
+  else
+    free_level_buffers(level);
+
+  if(level->mshrs != 0 && LEVEL_ENABLED(level))
+    reset_mshrs(level);
+  else
+    free_mshrs(level);
+
+  level->hits = 0;
+  level->misses = 0;
+  memset(level->kind_hits, 0, sizeof(level->kind_hits));
+  memset(level->kind_misses, 0, sizeof(level->kind_misses));
+  memset(level->miss_classes, 0, sizeof(level->miss_classes));
+  level->evictions = 0;
+  level->write_backs = 0;
+  level->write_throughs = 0;
+  level->back_invalidations = 0;
+  level->sector_misses = 0;
+  level->prefetches = 0;
+  level->useful_prefetches = 0;
+  level->late_prefetches = 0;
+  level->useless_prefetches = 0;
+  level->prefetch_lead = 0;
+  level->victim_hits = 0;
+  level->victim_evictions = 0;
+  level->buffered_writes = 0;
+  level->merged_writes = 0;
+  level->write_buffer_drains = 0;
+  level->full_drains = 0;
+  level->read_drains = 0;
+  level->hits_under_miss = 0;
+  level->misses_under_miss = 0;
+  level->mshr_merges = 0;
+  level->mshr_full_stalls = 0;
+  level->mshr_stall_cycles = 0;
 }
 
-static int translateAddress(address virtual_addr, address* physical_addr)
+/* Empties every level of a hierarchy and resets its counters */
+void flush_hierarchy(cacheHierarchy* h)
 {
-  static struct PageTableEntry {
-    word virtual_page_number;
-    word physical_page_number;
-  } pagetable[PAGE_TABLE_SIZE] =
-    { {PROGRAM_START / PHYSICAL_PAGE_SIZE, 0},
-      {GLOBAL_START / PHYSICAL_PAGE_SIZE, 1},
-      {0x00000000 / PHYSICAL_PAGE_SIZE, 2},
-      {STACK_START / PHYSICAL_PAGE_SIZE, 3}
-    };
+  int id;
+
+  link_hierarchy(h);
+
+  for(id = L1I; id < LEVEL_COUNT; id++)
+  {
+    /* every set of cache[] is flushed, not only those of the current
+       configuration, so that no stale tag can match after a reconfigure */
+    if(h->level[id].set == cache)
+      flush_level(&h->level[id], MAX_SETS);
+    else if(h->level[id].set != NULL)
+      flush_level(&h->level[id], h->level[id].set_count);
+  }
+
+  if(h->profile_pcs)
+    reset_pc_profile(h);
+  else
+    free_pc_profile(h);
+
+  if(h->dram_config.channels != 0)
+    reset_dram_timing(h);
+  else
+    free_dram_timing(h);
+
+  memset(h->accesses, 0, sizeof(h->accesses));
+  h->dram_reads = 0;
+  h->dram_writes = 0;
+  h->dram_read_transfers = 0;
+  h->dram_write_transfers = 0;
+  h->dram_read_cycles = 0;
+  h->dram_row_hits = 0;
+  h->dram_row_misses = 0;
+  h->dram_row_conflicts = 0;
+  h->dram_reordered = 0;
 
-  word i;
-  word virtual_page;
-  word offset;
+  /* the other cores of the CPU follow its hierarchy */
+  if(h == &memory_hierarchy)
+    flush_cores();
+}
 
-  virtual_page = virtual_addr / PHYSICAL_PAGE_SIZE;
-  offset = virtual_addr % PHYSICAL_PAGE_SIZE;
+/* Releases the sets allocated by configure_hierarchy_level() */
+void free_hierarchy(cacheHierarchy* h)
+{
+  int id;
 
-  for(i = 0; i < PAGE_TABLE_SIZE; i++)
+  for(id = L1I; id < LEVEL_COUNT; id++)
   {
-    if(pagetable[i].virtual_page_number == virtual_page)
-    {
-      *physical_addr = pagetable[i].physical_page_number * PHYSICAL_PAGE_SIZE + offset;
-      return 0;
-    }
+    free_miss_classifier(&h->level[id]);
+    free_prefetcher(&h->level[id]);
+    free_level_buffers(&h->level[id]);
+    free_mshrs(&h->level[id]);
+    if(h->level[id].set != cache)
+      free(h->level[id].set);
+    h->level[id].set = NULL;
+    h->level[id].set_count = 0;
+  }
+  free_pc_profile(h);
+  free_dram_timing(h);
+}
+
+/*
+  Configures the levels of h like those of source, without their contents;
+  h must be zeroed or configured before.  Write allocation, sectors,
+  latencies, prefetchers, victim caches, write buffers, MSHRs, the DRAM
+  timing, miss classification and profiling are copied too; its DRAM backend,
+  cycle mode and display state are left as they are.
+
+  returns 0 if successful, non-zero if a level could not be allocated.
+*/
+int copy_hierarchy_config(cacheHierarchy* h, const cacheHierarchy* source)
+{
+  const cacheLevel* level;
+  int error = 0;
+  int id;
+
+  h->classify_misses = source->classify_misses;
+  h->profile_pcs = source->profile_pcs;
+  h->dram_config = source->dram_config;
+  for(id = L1I; id < LEVEL_COUNT; id++)
+  {
+    level = &source->level[id];
+    h->level[id].name = level->name;
+    h->level[id].latency = level->latency;
+    h->level[id].prefetch = level->prefetch;
+    h->level[id].allocation = level->allocation;
+    h->level[id].sector_size = level->sector_size;
+    h->level[id].victim_lines = level->victim_lines;
+    h->level[id].write_buffer_depth = level->write_buffer_depth;
+    h->level[id].mshrs = level->mshrs;
+    if(configure_hierarchy_level(h, id, level->set_count, level->assoc, level->block_size, level->policy, level->memory_sync_policy, level->inclusion) != 0)
+      error = -1;
   }
 
-  append_log("Unable to access memory address\n");
-  return -1;
+  h->dram_latency = source->dram_latency;
+  return error;
+}
+
+void flush_cache() 
+{
+  link_cache_levels();
+  flush_hierarchy(&memory_hierarchy);
+  flush_tlbs();
+}
+
+/* Physical memory, physical_pages pages of PHYSICAL_PAGE_SIZE bytes; see vmem.c for the mapping */
+static byte* DRAM;
+static unsigned int DRAM_size;
+
+/*
+  Sets the size of physical memory in pages, and clears it: every page is
+  unmapped, so the program has to be loaded again.
+
+  returns 0 if successful, non-zero if pages is out of range or the memory
+  could not be allocated.
+*/
+int configure_physical_memory(unsigned int pages)
+{
+  byte* memory;
+
+  if(pages == 0 || pages > MAX_PHYSICAL_PAGES)
+    return -1;
+  if((memory = (byte*)calloc(pages, PHYSICAL_PAGE_SIZE)) == NULL)
+    return -1;
+
+  free(DRAM);
+  DRAM = memory;
+  DRAM_size = pages * PHYSICAL_PAGE_SIZE;
+  reset_page_table(pages);
+  return 0;
 }
 
 int accessDRAM(address addr, byte* data, TransferUnit mode, WriteEnable flag)
 {
-  static byte DRAM[PHYSICAL_PAGE_COUNT * PHYSICAL_PAGE_SIZE];
   static char* reading = "Accessing";
   static char* writing = "Updating";
+  static char* ignoring = "Ignoring";
 #ifdef CYGWIN
   static instruction self_branch = 0xffff0010;
 #else
@@ -104,12 +558,14 @@ int accessDRAM(address addr, byte* data, TransferUnit mode, WriteEnable flag)
     break;
   default:
     append_log("Invalid transfer mode for accessDRAM\nDefaulting to moving only 1 byte");
+    transfer_size = 1;
     error = 1;
   }
 
   /* Convert virtual address into physical address */
-  if(translateAddress(addr, &phys_addr) == -1)
+  if(translate_address(addr, &phys_addr) != 0)
   {    
+    append_log("Unable to access memory address\n");
     if(flag == READ && mode == WORD_SIZE)
       memcpy(data, &self_branch, sizeof(instruction));
     return -1;
@@ -128,15 +584,70 @@ int accessDRAM(address addr, byte* data, TransferUnit mode, WriteEnable flag)
     break;
   default:
     append_log("Invalid flag for accessDRAM\n");
+    memory_action = ignoring;
     error = 1;
   }
 
   /* Announce memory access */
-  sprintf(buffer, "%s %u bytes at 0x%08X\n", memory_action, transfer_size, addr);
-  if(!IS_GUI_ACTIVE())
-    printf(buffer);
-  else
-    append_log(buffer);
+  if(IS_LOGGING())
+  {
+    sprintf(buffer, "%s %u bytes at 0x%08X\n", memory_action, transfer_size, addr);
+    if(!IS_GUI_ACTIVE())
+      printf(buffer);
+    else
+      append_log(buffer);
+  }
 
   return error;
 }
+
+/*
+  Reads size bytes of DRAM without logging the access or touching the caches,
+  for the reports that show what is stored at an address
+
+  returns 0 if successful, non-zero if the address is not mapped.
+*/
+int peekDRAM(address addr, byte* data, unsigned int size)
+{
+  address phys_addr;
+
+  if(lookup_address(addr, &phys_addr) != 0 || phys_addr + size > DRAM_size)
+    return -1;
+
+  memcpy(data, DRAM + phys_addr, size);
+  return 0;
+}
+
+/*
+  Writes size bytes to DRAM from addr on without logging the access or
+  touching the caches, translating each page of the range once, for loading
+  programs.  Nothing is written, nor any page mapped, unless every page of
+  the range fits in physical memory.
+
+  returns 0 if successful, non-zero if physical memory is too small.
+*/
+int loadDRAM(address addr, const byte* data, unsigned int size)
+{
+  address phys_addr;
+  unsigned int chunk;
+
+  if(check_free_pages(addr, size) != 0)
+    return -1;
+
+  while(size > 0)
+  {
+    if(translate_address(addr, &phys_addr) != 0)
+      return -1;
+
+    chunk = PHYSICAL_PAGE_SIZE - (addr & (PHYSICAL_PAGE_SIZE - 1));
+    if(chunk > size)
+      chunk = size;
+    memcpy(DRAM + phys_addr, data, chunk);
+
+    addr += chunk;
+    data += chunk;
+    size -= chunk;
+  }
+
+  return 0;
+}
@@ -0,0 +1,225 @@
+#include "tips.h"
+
+/******************************************************************************
+   Miss classification
+
+   Every miss of a level is put in one of the three Cs:
+
+     compulsory - the block was never accessed in the level before
+     capacity - a fully associative LRU cache of the same number of blocks
+                would have missed too
+     conflict - the fully associative cache would have hit, so the miss is
+                due to the mapping of blocks to sets
+
+   Each level keeps every block it has seen in a table, which doubles as the
+   shadow fully associative cache: the blocks in it are chained in LRU order.
+   Table entries never move, so the chain links are indices; only the hash
+   index over them is rebuilt as the table grows.
+ *****************************************************************************/
+
+typedef struct {
+  address block;                    /* address >> offset bits */
+  int prev;                         /* shadow LRU chain, towards the MRU end */
+  int next;                         /* shadow LRU chain, towards the LRU end */
+  int cached;                       /* non-zero while in the shadow cache */
+} seenBlock;
+
+struct _missClassifier {
+  seenBlock* blocks;
+  unsigned int block_count;
+  unsigned int block_capacity;
+  int* index;                       /* hash of block to entry, -1 if empty */
+  unsigned int index_capacity;
+  int mru;
+  int lru;
+  unsigned int cached_count;
+  unsigned int shadow_capacity;     /* blocks the level holds */
+};
+
+static unsigned int hash_block(address block, unsigned int capacity)
+{
+  return (block * 2654435761u) & (capacity - 1);
+}
+
+/* returns the entry of a block, -1 if it was never seen */
+static int find_block(missClassifier* c, address block)
+{
+  unsigned int i;
+
+  if(c->index_capacity == 0)
+    return -1;
+
+  i = hash_block(block, c->index_capacity);
+  while(c->index[i] >= 0)
+  {
+    if(c->blocks[c->index[i]].block == block)
+      return c->index[i];
+    i = (i + 1) & (c->index_capacity - 1);
+  }
+
+  return -1;
+}
+
+static void index_block(missClassifier* c, int entry)
+{
+  unsigned int i = hash_block(c->blocks[entry].block, c->index_capacity);
+
+  while(c->index[i] >= 0)
+    i = (i + 1) & (c->index_capacity - 1);
+  c->index[i] = entry;
+}
+
+/* returns a new entry for a block, -1 if out of memory */
+static int add_block(missClassifier* c, address block)
+{
+  seenBlock* grown_blocks;
+  int* grown_index;
+  unsigned int capacity;
+  unsigned int i;
+
+  if(c->block_count == c->block_capacity)
+  {
+    capacity = c->block_capacity ? 2 * c->block_capacity : 1024;
+    if((grown_blocks = (seenBlock*)realloc(c->blocks, capacity * sizeof(seenBlock))) == NULL)
+      return -1;
+    c->blocks = grown_blocks;
+    c->block_capacity = capacity;
+  }
+
+  /* keep the hash index at most half full */
+  if(2 * (c->block_count + 1) > c->index_capacity)
+  {
+    capacity = c->index_capacity ? 2 * c->index_capacity : 2048;
+    if((grown_index = (int*)malloc(capacity * sizeof(int))) == NULL)
+      return -1;
+    free(c->index);
+    c->index = grown_index;
+    c->index_capacity = capacity;
+    memset(c->index, 0xff, capacity * sizeof(int));
+    for(i = 0; i < c->block_count; i++)
+      index_block(c, i);
+  }
+
+  c->blocks[c->block_count].block = block;
+  c->blocks[c->block_count].cached = 0;
+  index_block(c, c->block_count);
+  return c->block_count++;
+}
+
+static void unlink_block(missClassifier* c, int entry)
+{
+  seenBlock* b = &c->blocks[entry];
+
+  if(b->prev >= 0)
+    c->blocks[b->prev].next = b->next;
+  else
+    c->mru = b->next;
+  if(b->next >= 0)
+    c->blocks[b->next].prev = b->prev;
+  else
+    c->lru = b->prev;
+  b->cached = 0;
+  c->cached_count--;
+}
+
+static void push_mru(missClassifier* c, int entry)
+{
+  seenBlock* b = &c->blocks[entry];
+
+  b->prev = -1;
+  b->next = c->mru;
+  if(c->mru >= 0)
+    c->blocks[c->mru].prev = entry;
+  else
+    c->lru = entry;
+  c->mru = entry;
+  b->cached = 1;
+  c->cached_count++;
+}
+
+/*
+  Empties the classifier of a level, sized for its current configuration.
+  Called when the level is flushed.
+
+  returns 0 if successful, non-zero if it could not be allocated.
+*/
+int reset_miss_classifier(cacheLevel* level)
+{
+  missClassifier* c = level->classifier;
+
+  if(c == NULL && (c = level->classifier = (missClassifier*)calloc(1, sizeof(missClassifier))) == NULL)
+    return -1;
+
+  c->block_count = 0;
+  if(c->index != NULL)
+    memset(c->index, 0xff, c->index_capacity * sizeof(int));
+  c->mru = -1;
+  c->lru = -1;
+  c->cached_count = 0;
+  c->shadow_capacity = level->set_count * level->assoc;
+  return 0;
+}
+
+void free_miss_classifier(cacheLevel* level)
+{
+  if(level->classifier == NULL)
+    return;
+
+  free(level->classifier->blocks);
+  free(level->classifier->index);
+  free(level->classifier);
+  level->classifier = NULL;
+}
+
+/*
+  Updates the classifier with a lookup of addr in level
+
+  returns the class of the miss if hit is zero; MISS_CLASS_COUNT for hits,
+  or when the lookup could not be classified.
+*/
+MissClass classify_lookup(cacheLevel* level, address addr, int hit)
+{
+  missClassifier* c = level->classifier;
+  address block = addr >> level->offset_bits;
+  MissClass result;
+  int entry;
+
+  if(c == NULL)
+    return MISS_CLASS_COUNT;
+
+  if((entry = find_block(c, block)) < 0)
+  {
+    if((entry = add_block(c, block)) < 0)
+      return MISS_CLASS_COUNT;
+    result = COMPULSORY;
+  }
+  else if(!c->blocks[entry].cached)
+    result = CAPACITY;
+  else
+  {
+    result = CONFLICT;
+    unlink_block(c, entry);
+  }
+
+  /* the shadow cache now holds the block as its most recently used */
+  push_mru(c, entry);
+  if(c->cached_count > c->shadow_capacity)
+    unlink_block(c, c->lru);
+
+  return hit ? MISS_CLASS_COUNT : result;
+}
+
+const char* miss_class_name(MissClass miss_class)
+{
+  switch(miss_class)
+  {
+  case COMPULSORY:
+    return "Compulsory";
+  case CAPACITY:
+    return "Capacity";
+  case CONFLICT:
+    return "Conflict";
+  default:
+    return "Unknown";
+  }
+}
@@ -0,0 +1,447 @@
+#include "tips.h"
+
+/******************************************************************************
+   Multicore coherence
+
+   With more than one core, every core runs the loaded program with its own
+   registers and its own private hierarchy, configured like the hierarchy of
+   core 0 (memory_hierarchy, the one displayed), in front of the one shared
+   DRAM.  A step runs one instruction on each core in turn, core 0 first, so
+   that runs are repeatable (see cpu.c).
+
+   The hierarchies are kept coherent by invalidation, at the granularity of
+   the largest block of any level.  The state of a block in a core follows
+   from what its caches hold:
+
+     M - a level holds it dirty (no other core holds it)
+     E - it is held clean and no other core holds it (MESI only)
+     S - it is held clean, maybe by other cores too
+     I - no level holds it
+
+   A load or fetch of a block the core does not hold issues BusRd: a core
+   holding it modified writes it back and keeps it shared.  A store issues
+   BusRdX when the core does not hold the block, and BusUpgr when it holds it
+   shared; both invalidate every other copy, once dirty ones are written
+   back.  MSI has no E state, so a store to any clean copy issues BusUpgr,
+   where MESI upgrades an exclusive copy silently.  Prefetches and other
+   reads of DRAM outside a request also have dirty copies elsewhere written
+   back first, so no core ever reads stale data.
+
+   On a snooping bus every other core looks up every transaction.  With a
+   directory, a request goes to the directory, which forwards it to the cores
+   holding the block only, and each of them answers.
+
+   A miss of a block the core lost to the store of another core is a
+   coherence miss.  It is true sharing if another core wrote the word it
+   accesses since, else false sharing, and both are counted per block in an
+   open addressing hash table, like the per-PC profile.
+ *****************************************************************************/
+
+int core_count = 1;
+int active_core;
+
+typedef enum {BUS_READ, BUS_READ_EXCLUSIVE, BUS_UPGRADE} BusTransaction;
+
+typedef struct {
+  unsigned long long bus_reads;
+  unsigned long long bus_read_exclusives;
+  unsigned long long bus_upgrades;
+  unsigned long long silent_upgrades;   /* stores to E blocks */
+  unsigned long long invalidated;       /* copies lost to the stores of other cores */
+  unsigned long long interventions;     /* dirty copies written back for other cores */
+  unsigned long long coherence_misses;
+  unsigned long long true_sharing;
+  unsigned long long false_sharing;
+} coreCoherence;
+
+typedef struct {
+  address block;
+  int used;
+  unsigned int lost;                    /* bit c set while core c's copy is lost to a store */
+  unsigned int written[MAX_CORES];      /* words other cores stored to since core c lost it */
+  unsigned long long invalidations;
+  unsigned long long true_sharing;
+  unsigned long long false_sharing;
+} sharedBlock;
+
+/* core 0 runs on memory_hierarchy */
+static cacheHierarchy hierarchies[MAX_CORES];
+
+static CoherenceProtocol protocol = MESI;
+static int directory;
+static unsigned int coherence_block;
+static int snooping;
+
+static coreCoherence cores[MAX_CORES];
+static unsigned long long snoops;
+static unsigned long long directory_messages;
+
+static sharedBlock* blocks;
+static unsigned int block_capacity;
+static unsigned int block_count;
+
+cacheHierarchy* core_hierarchy(int core)
+{
+  return core == 0 ? &memory_hierarchy : &hierarchies[core];
+}
+
+/*
+  Backs the DRAM of every core: a read first has the other cores write back
+  any dirty copy of its block, for the reads no request covered.  Reads made
+  while a core is snooped do not snoop in turn; the block they read is not
+  the one being snooped.
+*/
+static int coherent_dram(address addr, byte* data, TransferUnit mode, WriteEnable flag)
+{
+  address block = addr & ~(coherence_block - 1);
+  int core;
+
+  if(flag == READ && !snooping)
+  {
+    snooping = 1;
+    for(core = 0; core < core_count; core++)
+    {
+      if(core != active_core && (snoop_hierarchy(core_hierarchy(core), block, coherence_block, SNOOP_CLEAN) & SNOOP_DIRTY))
+	cores[core].interventions++;
+    }
+    snooping = 0;
+  }
+
+  return accessDRAM(addr, data, mode, flag);
+}
+
+static void reset_shared_blocks(void)
+{
+  free(blocks);
+  blocks = NULL;
+  block_capacity = 0;
+  block_count = 0;
+}
+
+static sharedBlock* find_block(sharedBlock* entries, unsigned int capacity, address block)
+{
+  unsigned int i = ((block / coherence_block) * 2654435761u) & (capacity - 1);
+
+  while(entries[i].used && entries[i].block != block)
+    i = (i + 1) & (capacity - 1);
+
+  return &entries[i];
+}
+
+/* returns the entry of block, adding it if add is set, or NULL */
+static sharedBlock* shared_block(address block, int add)
+{
+  sharedBlock* entries;
+  sharedBlock* entry;
+  unsigned int capacity;
+  unsigned int i;
+
+  if(block_capacity != 0)
+  {
+    entry = find_block(blocks, block_capacity, block);
+    if(entry->used || !add)
+      return entry->used ? entry : NULL;
+  }
+  else if(!add)
+    return NULL;
+
+  /* keeps the table at most half full */
+  if(2 * (block_count + 1) > block_capacity)
+  {
+    capacity = block_capacity ? 2 * block_capacity : 1024;
+    if((entries = (sharedBlock*)calloc(capacity, sizeof(sharedBlock))) == NULL)
+      return NULL;
+    for(i = 0; i < block_capacity; i++)
+    {
+      if(blocks[i].used)
+	*find_block(entries, capacity, blocks[i].block) = blocks[i];
+    }
+    free(blocks);
+    blocks = entries;
+    block_capacity = capacity;
+  }
+
+  entry = find_block(blocks, block_capacity, block);
+  entry->used = 1;
+  entry->block = block;
+  block_count++;
+  return entry;
+}
+
+/* returns the largest block of any level of the hierarchy of core 0 */
+static unsigned int largest_block(void)
+{
+  unsigned int size = sizeof(word);
+  int id;
+
+  for(id = L1I; id < LEVEL_COUNT; id++)
+  {
+    if(LEVEL_ENABLED(&memory_hierarchy.level[id]) && memory_hierarchy.level[id].block_size > size)
+      size = memory_hierarchy.level[id].block_size;
+  }
+
+  return size;
+}
+
+/*
+  Configures the hierarchies of the other cores like that of core 0 and
+  empties them, and clears the coherence counters.  Called whenever the
+  hierarchy of core 0 is flushed.
+*/
+void flush_cores(void)
+{
+  cacheHierarchy* h;
+  int core;
+
+  coherence_block = largest_block();
+  memset(cores, 0, sizeof(cores));
+  snoops = 0;
+  directory_messages = 0;
+  reset_shared_blocks();
+
+  memory_hierarchy.dram = core_count > 1 ? coherent_dram : accessDRAM;
+  for(core = 1; core < MAX_CORES; core++)
+  {
+    h = &hierarchies[core];
+    if(core >= core_count)
+    {
+      free_hierarchy(h);
+      continue;
+    }
+
+    h->dram = coherent_dram;
+    h->timed = memory_hierarchy.timed;
+    if(h->random_state == 0)
+      h->random_state = 1;
+    copy_hierarchy_config(h, &memory_hierarchy);
+  }
+}
+
+/*
+  Sets the number of cores, and restarts all of them at the start of the
+  program with empty caches.
+
+  returns 0 if successful, non-zero if count is out of range or the caches
+  of the cores could not be allocated.
+*/
+int configure_cores(int count)
+{
+  int core;
+  int id;
+
+  if(count < 1 || count > MAX_CORES)
+    return -1;
+
+  core_count = count;
+  flush_cache();
+  reinit_processor();
+
+  for(core = 1; core < core_count; core++)
+  {
+    for(id = L1I; id < LEVEL_COUNT; id++)
+    {
+      if(LEVEL_ENABLED(&memory_hierarchy.level[id]) && !LEVEL_ENABLED(&hierarchies[core].level[id]))
+	return -1;
+    }
+  }
+
+  return 0;
+}
+
+/* Sets the protocol and whether requests go through a directory; flushes the cache */
+void configure_coherence(CoherenceProtocol p, int use_directory)
+{
+  protocol = p;
+  directory = use_directory;
+  flush_cache();
+}
+
+/*
+  Puts a transaction of the active core on the bus, or sends it to the
+  directory, and has the other cores act on their copies of block
+*/
+static void bus_request(BusTransaction transaction, address block)
+{
+  SnoopAction action = transaction == BUS_READ ? SNOOP_CLEAN : SNOOP_INVALIDATE;
+  sharedBlock* shared = NULL;
+  unsigned int holders = 0;
+  int found;
+  int core;
+
+  switch(transaction)
+  {
+  case BUS_READ:
+    cores[active_core].bus_reads++;
+    break;
+  case BUS_READ_EXCLUSIVE:
+    cores[active_core].bus_read_exclusives++;
+    break;
+  case BUS_UPGRADE:
+    cores[active_core].bus_upgrades++;
+    break;
+  }
+
+  snooping = 1;
+  for(core = 0; core < core_count; core++)
+  {
+    if(core == active_core)
+      continue;
+
+    found = snoop_hierarchy(core_hierarchy(core), block, coherence_block, action);
+    if(!(found & SNOOP_HELD))
+      continue;
+
+    holders++;
+    if(found & SNOOP_DIRTY)
+      cores[core].interventions++;
+    if(action == SNOOP_INVALIDATE)
+    {
+      cores[core].invalidated++;
+      if(shared == NULL && (shared = shared_block(block, 1)) == NULL)
+	continue;
+      shared->invalidations++;
+      shared->lost |= 1u << core;
+      shared->written[core] = 0;
+    }
+  }
+  snooping = 0;
+
+  if(directory)
+    directory_messages += 2 + 2 * holders;
+  else
+    snoops += core_count - 1;
+}
+
+/* returns non-zero if a core other than the active one holds block */
+static int held_elsewhere(address block)
+{
+  int core;
+
+  for(core = 0; core < core_count; core++)
+  {
+    if(core != active_core && (snoop_hierarchy(core_hierarchy(core), block, coherence_block, SNOOP_PROBE) & SNOOP_HELD))
+      return 1;
+  }
+
+  return 0;
+}
+
+/*
+  Makes an access of the active core through its hierarchy, after the
+  coherence requests it needs.  pc is as in access_hierarchy().
+*/
+void coherent_access(address pc, address addr, word* data, WriteEnable we, AccessType type)
+{
+  cacheHierarchy* h = core_hierarchy(active_core);
+  address block = addr & ~(coherence_block - 1);
+  unsigned int word_bit = 1u << ((addr - block) / sizeof(word));
+  unsigned int me = 1u << active_core;
+  int held = snoop_hierarchy(h, block, coherence_block, SNOOP_PROBE);
+  sharedBlock* shared = shared_block(block, 0);
+  int core;
+
+  if(shared != NULL && (shared->lost & me))
+  {
+    if(!(held & SNOOP_HELD))
+    {
+      cores[active_core].coherence_misses++;
+      if(shared->written[active_core] & word_bit)
+      {
+	cores[active_core].true_sharing++;
+	shared->true_sharing++;
+      }
+      else
+      {
+	cores[active_core].false_sharing++;
+	shared->false_sharing++;
+      }
+    }
+    shared->lost &= ~me;
+  }
+
+  if(!(held & SNOOP_HELD))
+    bus_request(we == READ ? BUS_READ : BUS_READ_EXCLUSIVE, block);
+  else if(we == WRITE && !(held & SNOOP_DIRTY))
+  {
+    if(protocol == MSI || held_elsewhere(block))
+      bus_request(BUS_UPGRADE, block);
+    else
+      cores[active_core].silent_upgrades++;
+  }
+
+  /* the words stored to a block tell the cores that lost it why they did */
+  if(we == WRITE && (shared = shared_block(block, 0)) != NULL)
+  {
+    for(core = 0; core < core_count; core++)
+    {
+      if(shared->lost & (1u << core))
+	shared->written[core] |= word_bit;
+    }
+  }
+
+  access_hierarchy(h, pc, addr, data, we, type);
+}
+
+static int compare_sharing(const void* a, const void* b)
+{
+  const sharedBlock* x = *(const sharedBlock* const*)a;
+  const sharedBlock* y = *(const sharedBlock* const*)b;
+
+  if(x->false_sharing != y->false_sharing)
+    return x->false_sharing < y->false_sharing ? 1 : -1;
+  if(x->invalidations != y->invalidations)
+    return x->invalidations < y->invalidations ? 1 : -1;
+  return x->block < y->block ? -1 : (x->block > y->block);
+}
+
+/* Prints the coherence traffic of every core, and the count blocks with the most false sharing */
+void report_coherence(unsigned int count, FILE* out)
+{
+  const coreCoherence* c;
+  const cacheHierarchy* h;
+  sharedBlock** sorted;
+  unsigned int n = 0;
+  unsigned int i;
+  int core;
+
+  if(core_count == 1)
+  {
+    fprintf(out, "Only one core is running\n");
+    return;
+  }
+
+  fprintf(out, "%d cores, %s over a %s, %u byte coherence blocks\n", core_count, (protocol == MSI ? "MSI" : "MESI"),
+	  (directory ? "directory" : "snooping bus"), coherence_block);
+  fprintf(out, "\nCore       BusRd     BusRdX    BusUpgr     Silent  Invalidated  Interventions  Coherence Misses  True Sharing  False Sharing  Data Misses\n");
+  for(core = 0; core < core_count; core++)
+  {
+    c = &cores[core];
+    h = core_hierarchy(core);
+    fprintf(out, "%4d  %9llu  %9llu  %9llu  %9llu  %11llu  %13llu  %16llu  %12llu  %13llu  %11llu\n", core, c->bus_reads,
+	    c->bus_read_exclusives, c->bus_upgrades, c->silent_upgrades, c->invalidated, c->interventions, c->coherence_misses,
+	    c->true_sharing, c->false_sharing, (h->data_cache == NULL ? 0 : h->data_cache->misses));
+  }
+
+  if(directory)
+    fprintf(out, "\nDirectory: %llu messages\n", directory_messages);
+  else
+    fprintf(out, "\nBus: %llu snoops\n", snoops);
+
+  if(block_count == 0)
+    return;
+  if((sorted = (sharedBlock**)malloc(block_count * sizeof(sharedBlock*))) == NULL)
+    return;
+  for(i = 0; i < block_capacity; i++)
+  {
+    if(blocks[i].used)
+      sorted[n++] = &blocks[i];
+  }
+  qsort(sorted, n, sizeof(sharedBlock*), compare_sharing);
+
+  fprintf(out, "\nBlock     Invalidations  True Sharing  False Sharing\n");
+  for(i = 0; i < n && i < count; i++)
+    fprintf(out, "%08x  %13llu  %12llu  %13llu\n", sorted[i]->block, sorted[i]->invalidations, sorted[i]->true_sharing,
+	    sorted[i]->false_sharing);
+
+  free(sorted);
+}
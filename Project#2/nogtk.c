@@ -0,0 +1,25 @@
+#include "tips.h"
+
+/******************************************************************************
+   Display without GTK
+
+   Stands in for gui.c in the build without GTK (make tips-nogui), for
+   machines that have no display or no GTK.  tips.h turns the refresh,
+   highlight and drawlist hooks into nothing when NO_GUI is defined, so
+   only the log, the end of a run and the request for a GUI are left.
+ *****************************************************************************/
+
+void append_log(char* msg)
+{
+  fputs(msg, stdout);
+}
+
+void stop_run()
+{
+}
+
+int build_gui(int argc, char** argv)
+{
+  printf("%s was built without the GUI; use -nogui or -batch\n", program_name);
+  return -1;
+}
@@ -2,6 +2,7 @@
 #include <signal.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <time.h>
 
 /******************************************************************************
    String Tokenizer definitions
@@ -108,7 +109,7 @@ void display_cache()
     {
       for(s = 0; s < assoc; s++)
       {
-	printf("%2d  %d %d  %s\t%s\t%08x    ", b, cache[b].block[s].valid, cache[b].block[s].dirty, lru_to_string(b, s), lfu_to_string(b, s), cache[b].block[s].tag);
+	printf("%2d  %d %d  %s\t%s\t%08x    ", b, cache[b].block[s].valid, cache[b].block[s].dirty, lru_to_string(b, s), lfu_to_string(b, s), cache[b].tag[s]);
 	for(o = 0; o < block_size; o++)
 	{
 	  printf("%02x", cache[b].block[s].data[o]);
@@ -133,7 +134,7 @@ void display_cache()
 
       for(b = 0; b < set_count; b++)
       {
-	printf("%2d  %d %d  %s\t%s\t%08x    ", b, cache[b].block[s].valid, cache[b].block[s].dirty, lru_to_string(b, s), lfu_to_string(b, s), cache[b].block[s].tag);
+	printf("%2d  %d %d  %s\t%s\t%08x    ", b, cache[b].block[s].valid, cache[b].block[s].dirty, lru_to_string(b, s), lfu_to_string(b, s), cache[b].tag[s]);
 	for(o = 0; o < block_size; o++)
 	{
 	  printf("%02x", cache[b].block[s].data[o]);
@@ -157,6 +158,7 @@ void display_cache()
     exit(1);
   }
 
+  report_level_buffers(&memory_hierarchy.level[L1D], stdout);
 }
 
 void display_help()
@@ -174,9 +176,17 @@ void display_help()
   printf("config <set_count> <assoc> <block_size> <Replacement Policy> <Sync Policy> --\n");
   printf("  Set cache to have <set_count> sets (i.e. number of unique indexes), <assoc>\n");
   printf("  blocks per setm with each block to have size <block_size>. <Replacment\n");
-  printf("  Policy> is either 'lru' for LRU, 'r' for RANDOM, or 'lfu' for LFU.\n");
+  printf("  Policy> is 'lru' for LRU, 'r' for RANDOM, 'lfu' for LFU with aging, 'plru'\n");
+  printf("  for tree pseudo-LRU, 'srrip' or 'brrip' for static or bimodal RRIP, or\n");
+  printf("  'fifo' for FIFO.\n");
   printf("  <Sync Policy> is either 'wb' for WRITE_BACK or 'wt' for WRITE_THROUGH\n");
   printf("\n");
+  printf("config <level> <set_count> <assoc> <block_size> <Replacement Policy> <Sync Policy>\n");
+  printf("  [<Inclusion Policy>] -- Same as above for one level of the hierarchy. <level>\n");
+  printf("  is 'l1i', 'l1d', 'l2' or 'l3'; configuring 'l1i' splits the L1 cache, and a\n");
+  printf("  <set_count> of 0 removes the level. <Inclusion Policy> of 'l2' and 'l3'\n");
+  printf("  towards the levels above is 'ni' (default), 'incl' or 'excl'\n");
+  printf("\n");
   printf("view <mode> -- change how cache is drawn. <mode> is either 'index' for\n");
   printf("  index-based view of cache or 'assoc' for associativity-based view\n");
   printf("\n");
@@ -189,6 +199,114 @@ void display_help()
   printf("\n");
   printf("print cache -- Print the current cache state\n");
   printf("\n");
+  printf("print hierarchy -- Print the levels of the cache hierarchy and their hit rates\n");
+  printf("\n");
+  printf("print stats [<level>] -- Print the hits and misses of every level by kind of\n");
+  printf("  access, evictions, write-backs, DRAM traffic and the average memory access\n");
+  printf("  time; with a <level> ('l1i', 'l1d', 'l2' or 'l3'), the hits and misses of\n");
+  printf("  each of its sets\n");
+  printf("\n");
+  printf("print profile [<count>] -- Print the <count> instructions (default 20) whose\n");
+  printf("  accesses missed the most since the last flush, with their load/store and\n");
+  printf("  fetch misses in the first level and their reads of DRAM\n");
+  printf("\n");
+  printf("print timing -- Print the cycles and stalls of the pipeline and the use of\n");
+  printf("  the MSHRs in cycle mode\n");
+  printf("\n");
+  printf("timing <on|off> -- Turn cycle mode on or off. In cycle mode an in-order\n");
+  printf("  pipeline issues one instruction per cycle, stalling on fetch misses and\n");
+  printf("  on the use of loads in flight, and the L1 levels serve hits and further\n");
+  printf("  misses under their outstanding misses. Flushes the cache\n");
+  printf("\n");
+  printf("mshr <level> <count> -- Give a level <count> miss status holding registers\n");
+  printf("  for cycle mode; 0 (default) makes it block on every miss\n");
+  printf("\n");
+  printf("cores <count> -- Run the program on <count> cores (up to %d), each with\n", MAX_CORES);
+  printf("  private caches configured like those above, kept coherent over the shared\n");
+  printf("  DRAM. A step runs one instruction on every core in turn; core <n> has its\n");
+  printf("  number in $k0 and its stack %d bytes below that of core <n> - 1. Restarts\n", CORE_STACK_SIZE);
+  printf("  the cores and flushes the cache; registers shown are those of core 0\n");
+  printf("\n");
+  printf("coherence <protocol> [<interconnect>] -- Keep the caches of the cores coherent\n");
+  printf("  with 'msi' or 'mesi' (default), over a 'snoop'ing bus (default) or through\n");
+  printf("  a 'directory'. Flushes the cache\n");
+  printf("\n");
+  printf("print coherence [<count>] -- Print the bus transactions, invalidations and\n");
+  printf("  coherence misses of every core, and the <count> blocks (default 10) with\n");
+  printf("  the most false sharing\n");
+  printf("\n");
+  printf("memory <KB> -- Set the size of physical memory (default %d KB). Pages are\n",
+	 DEFAULT_PHYSICAL_PAGES * (PHYSICAL_PAGE_SIZE / 1024));
+  printf("  mapped on first touch through a two-level page table. Clears memory, so\n");
+  printf("  load the program again\n");
+  printf("\n");
+  printf("tlb <sets> <assoc> [<l2 sets> <l2 assoc>] | tlb off -- Translate DRAM\n");
+  printf("  addresses through a TLB of <sets> sets of <assoc> entries (default 8 x 4),\n");
+  printf("  optionally backed by a second level TLB\n");
+  printf("\n");
+  printf("print vm -- Print the TLB hits and misses, page walks and page faults\n");
+  printf("\n");
+  printf("latency <level> <cycles> -- Set the hit latency of a level, or of 'dram', used\n");
+  printf("  for the average memory access time\n");
+  printf("\n");
+  printf("dram <option>=<value> ... | dram off -- Time DRAM by its banks and open rows\n");
+  printf("  instead of a fixed latency. Options are channels=<count> (default 1),\n");
+  printf("  banks=<per channel> (8), row=<bytes> (2048), trcd=, tcas=, trp=<cycles>\n");
+  printf("  (14 each), tburst=<cycles> (4), queue=<requests> (16), page=<'open' or\n");
+  printf("  'closed'> and map=<'row', 'block' or 'xor'> interleaving\n");
+  printf("\n");
+  printf("prefetch <level> <prefetcher> [<option>=<value> ...] -- Attach a\n");
+  printf("  prefetcher to a level: 'nextline', 'stride' (PC-indexed), 'stream' or\n");
+  printf("  'off'. Options are degree=<blocks per prefetch> (default 1),\n");
+  printf("  distance=<blocks or strides ahead> (default 1) and buffer=<lines> to put\n");
+  printf("  prefetched blocks into a prefetch buffer instead of the cache\n");
+  printf("\n");
+  printf("victim <level> <lines> -- Give a level a fully associative victim cache of\n");
+  printf("  <lines> blocks, searched on a miss before the level below; 0 removes it\n");
+  printf("\n");
+  printf("writebuffer <level> <depth> -- Give a level a coalescing write buffer of\n");
+  printf("  <depth> blocks for the writes it sends down; 0 removes it\n");
+  printf("\n");
+  printf("allocate <level> <policy> -- Whether write misses bring the block into a\n");
+  printf("  level: 'wa' (write-allocate, default) or 'nwa' (no-write-allocate, the\n");
+  printf("  write goes around the level)\n");
+  printf("\n");
+  printf("sector <level> <bytes> -- Move the blocks of a level to and from the level\n");
+  printf("  below in sectors of <bytes>, each with its own valid and dirty bit; 0 for\n");
+  printf("  whole blocks\n");
+  printf("\n");
+  printf("stackdist <block_size> [<accesses>] -- Start an LRU stack distance analysis of\n");
+  printf("  the accesses that follow, for caches of <block_size> byte blocks. <accesses>\n");
+  printf("  is 'all' (default), 'inst' for instruction fetches or 'data' for loads and\n");
+  printf("  stores\n");
+  printf("\n");
+  printf("stackdist off -- Stop the stack distance analysis\n");
+  printf("\n");
+  printf("print mrc -- Print the miss ratio curves of the stack distance analysis for\n");
+  printf("  every cache size and associativity\n");
+  printf("\n");
+  printf("trace record <file> -- Stream every access that follows (address, read or\n");
+  printf("  write, instruction or data, PC) to <file>\n");
+  printf("\n");
+  printf("trace stop -- Close the trace being recorded\n");
+  printf("\n");
+  printf("trace replay <file> [<format>] -- Run the accesses of a trace through the\n");
+  printf("  configured caches without the CPU, and print the hit rates. <format> is\n");
+  printf("  'tips', 'din' for DineroIV or 'lackey' for Valgrind's lackey; by default it\n");
+  printf("  is guessed. Active recorders (stackdist, sweep record, trace record) also\n");
+  printf("  see the replayed accesses.\n");
+  printf("\n");
+  printf("sweep record -- Record the accesses that follow for a design space sweep\n");
+  printf("\n");
+  printf("sweep stop -- Stop recording accesses\n");
+  printf("\n");
+  printf("sweep run [<option>=<value> ...] -- Replay the recorded accesses against\n");
+  printf("  every configuration of the L1 cache, on top of the current L2/L3, in\n");
+  printf("  parallel. Options are sets=<min>:<max>, assoc=<min>:<max> and\n");
+  printf("  block=<min>:<max> (powers of two), policy=<policy>,... and sync=<policy>,...\n");
+  printf("  as in config, threads=<count> (default: one per processor), format=csv or\n");
+  printf("  format=json, and file=<name> to write the table to a file\n");
+  printf("\n");
   printf("reset cpu -- Reset the PC and $sp back to startup values\n");
   printf("\n");
   printf("reset cache -- Flush the cache\n");
@@ -196,6 +314,24 @@ void display_help()
   printf("reinit -- does \"reset cpu\" and \"reset cache\" commands\n");
   printf("\n");
   printf("help -- List top-level commands\n");
+  printf("\n");
+  printf("To run a program at full speed and print only its statistics, start TIPS with\n");
+  printf("  %s -batch [-c \"<command>\"]... [-max <instructions>] <file> [-c \"<command>\"]...\n", program_name);
+  printf("  where the commands before <file> configure the caches\n");
+}
+
+/* returns the level named by a command argument, or -1 */
+static int parse_level(const char* name)
+{
+  if(strcmp(name, "l1i") == 0)
+    return L1I;
+  else if(strcmp(name, "l1d") == 0)
+    return L1D;
+  else if(strcmp(name, "l2") == 0)
+    return L2;
+  else if(strcmp(name, "l3") == 0)
+    return L3;
+  return -1;
 }
 
 void configure_cache(StringTokenizer* tokenizer)
@@ -205,10 +341,20 @@ void configure_cache(StringTokenizer* tokenizer)
   int block;
   ReplacementPolicy p;
   MemorySyncPolicy m;
+  InclusionPolicy inclusion;
+  CacheLevelId id;
+  cacheLevel* level;
   char* command;
 
-  /* Get index */
+  /* Get level, if any; the L1 data cache is configured by default */
   command = nextToken(tokenizer);
+  id = L1D;
+  if(parse_level(command) >= 0)
+    id = parse_level(command);
+  if(isalpha(command[0]))
+    command = nextToken(tokenizer);
+
+  /* Get index */
   if(strlen(command) != 0)
     index = atoi(command);
   else
@@ -241,13 +387,7 @@ void configure_cache(StringTokenizer* tokenizer)
   command = nextToken(tokenizer);
   if(strlen(command) != 0)
   {
-    if(strcmp(command, "lru") == 0)
-      p = LRU;
-    else if(strcmp(command, "r") == 0)
-      p = RANDOM;
-    else if(strcmp(command, "lfu") == 0)
-      p = LFU;
-    else
+    if((p = find_replacement_policy(command)) == -1)
     {
       printf("Invalid parameter for Replacement Policy\n");
       return;
@@ -279,12 +419,784 @@ void configure_cache(StringTokenizer* tokenizer)
     return;
   }
 
-  validate_cache_parameters(index, assoc, block);      
-  policy = p;
-  memory_sync_policy = m;
+  /* Get inclusion policy, if any */
+  command = nextToken(tokenizer);
+  inclusion = NON_INCLUSIVE;
+  if(strlen(command) != 0)
+  {
+    if(strcmp(command, "ni") == 0)
+      inclusion = NON_INCLUSIVE;
+    else if(strcmp(command, "incl") == 0)
+      inclusion = INCLUSIVE;
+    else if(strcmp(command, "excl") == 0)
+      inclusion = EXCLUSIVE;
+    else
+    {
+      printf("Invalid parameter for Inclusion Policy\n");
+      return;
+    }
+  }
+
+  if(configure_level(id, index, assoc, block, p, m, inclusion) != 0)
+  {
+    printf("Unable to allocate the %s cache\n", memory_hierarchy.level[id].name);
+    return;
+  }
+
+  level = &memory_hierarchy.level[id];
+  printf("\n%s cache parameters changed:\n + set count = %d\n + associativity = %d\n + block size = %d\n + replacement policy = %s\n + memory sync policy = %s\n", level->name, level->set_count, level->assoc, level->block_size, replacement_policies[level->policy].name, (level->memory_sync_policy == WRITE_BACK ? "Write Back" : "Write Through"));
+  if(id == L2 || id == L3)
+    printf(" + inclusion policy = %s\n", inclusion_name(level->inclusion));
+}
+
+void display_stats(StringTokenizer* tokenizer)
+{
+  char* command = nextToken(tokenizer);
+
+  if(strlen(command) == 0)
+    report_stats(&memory_hierarchy, stdout);
+  else if(parse_level(command) >= 0)
+    report_set_stats(&memory_hierarchy.level[parse_level(command)], stdout);
+  else
+    printf("Invalid level: %s\n", command);
+}
+
+void display_profile(StringTokenizer* tokenizer)
+{
+  char* command = nextToken(tokenizer);
+  int count = 20;
+
+  if(strlen(command) != 0 && (count = atoi(command)) <= 0)
+  {
+    printf("Invalid count: %s\n", command);
+    return;
+  }
+
+  report_pc_profile(&memory_hierarchy, count, stdout);
+}
+
+void display_dram(const dramConfig* config)
+{
+  printf("DRAM: %u channel(s) of %u banks, %u byte rows, tRCD %u, tCAS %u, tRP %u, tBURST %u, queue of %u, %s page, %s\n",
+	 config->channels, config->banks, config->row_size, config->tRCD, config->tCAS, config->tRP, config->tBURST,
+	 config->queue_depth, (config->page_policy == OPEN_PAGE ? "open" : "closed"), dram_mapping_name(config->mapping));
+}
+
+void configure_latency(StringTokenizer* tokenizer)
+{
+  char* command = nextToken(tokenizer);
+  unsigned int* latency;
+  const char* name;
+  int id = parse_level(command);
+
+  if(id >= 0)
+  {
+    latency = &memory_hierarchy.level[id].latency;
+    name = memory_hierarchy.level[id].name;
+  }
+  else if(strcmp(command, "dram") == 0)
+  {
+    latency = &memory_hierarchy.dram_latency;
+    name = "DRAM";
+  }
+  else
+  {
+    printf("Invalid level: %s\n", command);
+    return;
+  }
+
+  command = nextToken(tokenizer);
+  if(strlen(command) == 0 || atoi(command) < 0)
+  {
+    printf("Please specify a latency in cycles.\n");
+    return;
+  }
+
+  *latency = atoi(command);
+  printf("%s latency is now %u cycles\n", name, *latency);
+}
+
+void configure_dram(StringTokenizer* tokenizer)
+{
+  dramConfig config = { 1, 8, 2048, 14, 14, 14, 4, 16, OPEN_PAGE, MAP_ROW_INTERLEAVED };
+  char option[200];
+  char* value;
+  char* command;
+  int error = 0;
+  int mapping;
+
+  if(memory_hierarchy.dram_config.channels != 0)
+    config = memory_hierarchy.dram_config;
+
+  while(strlen(command = nextToken(tokenizer)) != 0)
+  {
+    strcpy(option, command);
+    if((value = strchr(option, '=')) == NULL)
+      value = option + strlen(option);
+    else
+      *value++ = '\0';
+
+    if(strcmp(option, "off") == 0)
+      config.channels = 0;
+    else if(strcmp(option, "channels") == 0)
+      error = (config.channels = atoi(value)) < 1;
+    else if(strcmp(option, "banks") == 0)
+      error = (config.banks = atoi(value)) < 1;
+    else if(strcmp(option, "row") == 0)
+      error = (config.row_size = atoi(value)) < 1;
+    else if(strcmp(option, "trcd") == 0)
+      error = (int)(config.tRCD = atoi(value)) < 0;
+    else if(strcmp(option, "tcas") == 0)
+      error = (int)(config.tCAS = atoi(value)) < 0;
+    else if(strcmp(option, "trp") == 0)
+      error = (int)(config.tRP = atoi(value)) < 0;
+    else if(strcmp(option, "tburst") == 0)
+      error = (int)(config.tBURST = atoi(value)) < 0;
+    else if(strcmp(option, "queue") == 0)
+      error = (config.queue_depth = atoi(value)) < 1;
+    else if(strcmp(option, "page") == 0 && strcmp(value, "open") == 0)
+      config.page_policy = OPEN_PAGE;
+    else if(strcmp(option, "page") == 0 && strcmp(value, "closed") == 0)
+      config.page_policy = CLOSED_PAGE;
+    else if(strcmp(option, "map") == 0 && (mapping = find_dram_mapping(value)) >= 0)
+      config.mapping = mapping;
+    else
+      error = 1;
+
+    if(error)
+    {
+      printf("Invalid DRAM option: %s\n", command);
+      return;
+    }
+  }
+
+  if(configure_dram_timing(&memory_hierarchy, &config) != 0)
+  {
+    printf("Invalid DRAM timing: up to %d channels and %d banks, and rows of at least %d bytes, all powers of two,\n"
+	   "with a queue of 1 to %d requests\n", MAX_DRAM_CHANNELS, MAX_DRAM_BANKS, MAX_BLOCK_SIZE, MAX_DRAM_QUEUE);
+    return;
+  }
+
+  if(config.channels == 0)
+    printf("DRAM takes %u cycles per transfer\n", memory_hierarchy.dram_latency);
+  else
+    display_dram(&config);
+}
+
+void configure_timing(StringTokenizer* tokenizer)
+{
+  char* command = nextToken(tokenizer);
+
+  if(strcmp(command, "on") == 0)
+    memory_hierarchy.timed = 1;
+  else if(strcmp(command, "off") == 0)
+    memory_hierarchy.timed = 0;
+  else
+  {
+    printf("Please specify 'on' or 'off'.\n");
+    return;
+  }
+
+  flush_cache();
+  reset_pipeline();
+  printf("Cycle mode is %s\n", (memory_hierarchy.timed ? "on" : "off"));
+}
+
+void configure_core_count(StringTokenizer* tokenizer)
+{
+  char* command = nextToken(tokenizer);
+  int count = atoi(command);
+
+  if(strlen(command) == 0 || count < 1 || count > MAX_CORES)
+  {
+    printf("Please specify a number of cores from 1 to %d.\n", MAX_CORES);
+    return;
+  }
+
+  if(configure_cores(count) != 0)
+  {
+    printf("Unable to allocate the caches of the cores\n");
+    return;
+  }
+
+  printf("%d core(s) restarted at the start of the program\n", count);
+}
+
+void configure_protocol(StringTokenizer* tokenizer)
+{
+  char* command = nextToken(tokenizer);
+  CoherenceProtocol protocol;
+  int directory = 0;
+
+  if(strcmp(command, "msi") == 0)
+    protocol = MSI;
+  else if(strcmp(command, "mesi") == 0)
+    protocol = MESI;
+  else
+  {
+    printf("Please specify 'msi' or 'mesi'.\n");
+    return;
+  }
+
+  command = nextToken(tokenizer);
+  if(strcmp(command, "directory") == 0)
+    directory = 1;
+  else if(strlen(command) != 0 && strcmp(command, "snoop") != 0)
+  {
+    printf("Invalid interconnect: %s\n", command);
+    return;
+  }
+
+  configure_coherence(protocol, directory);
+  printf("Coherence is %s over a %s\n", (protocol == MSI ? "MSI" : "MESI"), (directory ? "directory" : "snooping bus"));
+}
+
+void display_coherence(StringTokenizer* tokenizer)
+{
+  char* command = nextToken(tokenizer);
+  int count = 10;
+
+  if(strlen(command) != 0 && (count = atoi(command)) <= 0)
+  {
+    printf("Invalid count: %s\n", command);
+    return;
+  }
+
+  report_coherence(count, stdout);
+}
+
+void configure_memory(StringTokenizer* tokenizer)
+{
+  char* command = nextToken(tokenizer);
+  int kilobytes = atoi(command);
+
+  if(strlen(command) == 0 || kilobytes <= 0 || (kilobytes * 1024) % PHYSICAL_PAGE_SIZE != 0 ||
+     configure_physical_memory(kilobytes * 1024 / PHYSICAL_PAGE_SIZE) != 0)
+  {
+    printf("Please specify a size in KB that is a multiple of %d, up to %d.\n", PHYSICAL_PAGE_SIZE / 1024,
+	   MAX_PHYSICAL_PAGES / 1024 * (PHYSICAL_PAGE_SIZE / 1024) * 1024);
+    return;
+  }
+
+  printf("Physical memory is now %d KB; load the program again\n", kilobytes);
+}
+
+void configure_tlbs(StringTokenizer* tokenizer)
+{
+  int values[4] = { 0, 0, 0, 0 };
+  char* command;
+  int i;
+
+  for(i = 0; i < 4; i++)
+  {
+    command = nextToken(tokenizer);
+    if(strlen(command) == 0)
+      break;
+    if(i == 0 && strcmp(command, "off") == 0)
+      continue;
+    if((values[i] = atoi(command)) <= 0)
+    {
+      printf("Invalid TLB size: %s\n", command);
+      return;
+    }
+  }
+
+  if(i == 1 && values[0] != 0)
+  {
+    printf("Please specify the sets and ways of the TLB.\n");
+    return;
+  }
+  if(i == 3)
+  {
+    printf("Please specify the sets and ways of the second level TLB.\n");
+    return;
+  }
+
+  if(configure_tlb(TLB_L1, values[0], values[1]) != 0 || configure_tlb(TLB_L2, values[2], values[3]) != 0)
+  {
+    printf("TLB sets must be a power of two\n");
+    return;
+  }
+
+  if(values[0] == 0)
+    printf("TLB removed; every transfer walks the page table\n");
+  else if(values[2] == 0)
+    printf("TLB now has %d sets of %d entries\n", values[0], values[1]);
+  else
+    printf("TLB now has %d sets of %d entries, backed by %d sets of %d\n", values[0], values[1], values[2], values[3]);
+}
+
+void configure_mshr(StringTokenizer* tokenizer)
+{
+  cacheLevel* level;
+  int count;
+  char* command = nextToken(tokenizer);
+  int id = parse_level(command);
+
+  if(id < 0)
+  {
+    printf("Invalid level: %s\n", command);
+    return;
+  }
+  level = &memory_hierarchy.level[id];
+
+  command = nextToken(tokenizer);
+  count = atoi(command);
+  if(strlen(command) == 0 || count < 0 || count > MAX_MSHRS)
+  {
+    printf("Please specify a number of MSHRs from 0 to %d.\n", MAX_MSHRS);
+    return;
+  }
+
+  if(configure_mshrs(&memory_hierarchy, id, count) != 0)
+  {
+    printf("Unable to allocate the %s MSHRs\n", level->name);
+    return;
+  }
+
+  if(count == 0)
+    printf("%s blocks on every miss\n", level->name);
+  else
+    printf("%s now has %d MSHRs\n", level->name, count);
+}
+
+void configure_prefetch(StringTokenizer* tokenizer)
+{
+  prefetchConfig config = { PREFETCH_NONE, 1, 1, 0 };
+  cacheLevel* level;
+  char option[200];
+  char* value;
+  int error = 0;
+  int kind;
+  char* command = nextToken(tokenizer);
+  int id = parse_level(command);
+
+  if(id < 0)
+  {
+    printf("Invalid level: %s\n", command);
+    return;
+  }
+
+  command = nextToken(tokenizer);
+  if((kind = find_prefetcher(command)) < 0)
+  {
+    printf("Invalid prefetcher: %s\n", command);
+    return;
+  }
+  config.kind = kind;
+
+  while(strlen(command = nextToken(tokenizer)) != 0)
+  {
+    strcpy(option, command);
+    if((value = strchr(option, '=')) == NULL)
+      value = option + strlen(option);
+    else
+      *value++ = '\0';
+
+    if(strcmp(option, "degree") == 0)
+      error = (config.degree = atoi(value)) < 1 || config.degree > MAX_PREFETCH_DEGREE;
+    else if(strcmp(option, "distance") == 0)
+      error = (config.distance = atoi(value)) < 1;
+    else if(strcmp(option, "buffer") == 0)
+      error = atoi(value) < 0 || (config.buffer_lines = atoi(value)) > MAX_PREFETCH_BUFFER_LINES;
+    else
+      error = 1;
+
+    if(error)
+    {
+      printf("Invalid prefetch option: %s\n", command);
+      return;
+    }
+  }
+
+  level = &memory_hierarchy.level[id];
+  if(configure_prefetcher(&memory_hierarchy, id, &config) != 0)
+  {
+    printf("Unable to allocate the %s prefetcher\n", level->name);
+    return;
+  }
+
+  if(config.kind == PREFETCH_NONE)
+    printf("%s prefetcher turned off\n", level->name);
+  else
+    printf("%s prefetcher: %s, degree %u, distance %u, into %s\n", level->name, prefetcher_name(config.kind),
+	   config.degree, config.distance, (config.buffer_lines == 0 ? "the cache" : "a prefetch buffer"));
+}
+
+void configure_buffers(StringTokenizer* tokenizer, int write_buffer)
+{
+  cacheLevel* level;
+  unsigned int victim_lines;
+  unsigned int write_buffer_depth;
+  int size;
+  char* command = nextToken(tokenizer);
+  int id = parse_level(command);
+
+  if(id < 0)
+  {
+    printf("Invalid level: %s\n", command);
+    return;
+  }
+  level = &memory_hierarchy.level[id];
+
+  command = nextToken(tokenizer);
+  size = atoi(command);
+  if(strlen(command) == 0 || size < 0 || size > (write_buffer ? MAX_WRITE_BUFFER_DEPTH : MAX_VICTIM_LINES))
+  {
+    printf("Please specify a size from 0 to %d.\n", (write_buffer ? MAX_WRITE_BUFFER_DEPTH : MAX_VICTIM_LINES));
+    return;
+  }
+
+  victim_lines = write_buffer ? level->victim_lines : (unsigned int)size;
+  write_buffer_depth = write_buffer ? (unsigned int)size : level->write_buffer_depth;
+  if(configure_level_buffers(&memory_hierarchy, id, victim_lines, write_buffer_depth) != 0)
+  {
+    printf("Unable to allocate the %s %s\n", level->name, (write_buffer ? "write buffer" : "victim cache"));
+    return;
+  }
+
+  if(size == 0)
+    printf("%s %s removed\n", level->name, (write_buffer ? "write buffer" : "victim cache"));
+  else if(!write_buffer && level->inclusion == EXCLUSIVE)
+    printf("%s victim cache of %d lines is unused while the level is exclusive\n", level->name, size);
+  else
+    printf("%s %s now has %d %s\n", level->name, (write_buffer ? "write buffer" : "victim cache"), size, (write_buffer ? "entries" : "lines"));
+}
+
+void configure_allocation(StringTokenizer* tokenizer, int sector)
+{
+  cacheLevel* level;
+  AllocationPolicy allocation;
+  unsigned int sector_size;
+  int size;
+  char* command = nextToken(tokenizer);
+  int id = parse_level(command);
+
+  if(id < 0)
+  {
+    printf("Invalid level: %s\n", command);
+    return;
+  }
+  level = &memory_hierarchy.level[id];
+  allocation = level->allocation;
+  sector_size = level->sector_size;
+
+  command = nextToken(tokenizer);
+  if(sector)
+  {
+    size = atoi(command);
+    if(strlen(command) == 0 || size < 0)
+    {
+      printf("Please specify a sector size in bytes, or 0 for whole blocks.\n");
+      return;
+    }
+    sector_size = (unsigned int)size;
+  }
+  else if(strcmp(command, "wa") == 0)
+    allocation = WRITE_ALLOCATE;
+  else if(strcmp(command, "nwa") == 0)
+    allocation = NO_WRITE_ALLOCATE;
+  else
+  {
+    printf("Invalid allocation policy: %s\n", command);
+    return;
+  }
+
+  if(configure_write_policy(&memory_hierarchy, id, allocation, sector_size) != 0)
+  {
+    printf("Sectors must be a power of two from %u to %u bytes.\n", (unsigned int)sizeof(word), MAX_BLOCK_SIZE);
+    return;
+  }
+
+  if(!sector)
+    printf("%s is now %s\n", level->name, (allocation == WRITE_ALLOCATE ? "write-allocate" : "no-write-allocate"));
+  else if(!LEVEL_ENABLED(level) || SECTOR_SIZE(level) == level->block_size)
+    printf("%s moves whole blocks\n", level->name);
+  else
+    printf("%s now moves %u byte sectors\n", level->name, SECTOR_SIZE(level));
+}
+
+void display_hierarchy(cacheHierarchy* h)
+{
+  int id;
+  cacheLevel* level;
+  unsigned long long accesses;
+
+  printf("\nLevel  Sets  Assoc  Block  Replace  Sync  Inclusion      Next       Hits     Misses  Miss Rate  Write-backs  Back-inval\n");
+  for(id = L1I; id < LEVEL_COUNT; id++)
+  {
+    level = &h->level[id];
+    if(!LEVEL_ENABLED(level))
+    {
+      printf("%-5s  (none)\n", level->name);
+      continue;
+    }
+
+    accesses = level->hits + level->misses;
+    printf("%-5s  %4u  %5u  %5u  %-7s  %-4s  %-13s  %-4s  %9llu  %9llu  %8.2f%%  %11llu  %10llu\n",
+	   level->name, level->set_count, level->assoc, level->block_size,
+	   replacement_policies[level->policy].name, (level->memory_sync_policy == WRITE_BACK ? "WB" : "WT"),
+	   inclusion_name(level->inclusion), (level->next == NULL ? "DRAM" : level->next->name),
+	   level->hits, level->misses, (accesses == 0 ? 0.0 : 100.0 * level->misses / accesses),
+	   level->write_backs, level->back_invalidations);
+  }
+
+  printf("\nInstruction fetches start at %s, loads and stores at %s\n",
+	 (h->instruction_cache == NULL ? "DRAM" : h->instruction_cache->name),
+	 (h->data_cache == NULL ? "DRAM" : h->data_cache->name));
+  for(id = L1I; id < LEVEL_COUNT; id++)
+  {
+    level = &h->level[id];
+    if(LEVEL_ENABLED(level) && level->prefetch.kind != PREFETCH_NONE)
+      printf("%s prefetcher: %s, degree %u, distance %u, %s\n", level->name, prefetcher_name(level->prefetch.kind),
+	     level->prefetch.degree, level->prefetch.distance, (level->prefetch.buffer_lines == 0 ? "into the cache" : "into a prefetch buffer"));
+    if(level->victim != NULL)
+      printf("%s victim cache: %u lines\n", level->name, level->victim_lines);
+    if(level->write_buffer != NULL)
+      printf("%s write buffer: %u entries\n", level->name, level->write_buffer_depth);
+    if(h->timed && LEVEL_ENABLED(level) && (level == h->instruction_cache || level == h->data_cache))
+      printf("%s MSHRs: %u\n", level->name, level->mshrs);
+    if(LEVEL_ENABLED(level) && level->allocation == NO_WRITE_ALLOCATE)
+      printf("%s does not allocate on write misses\n", level->name);
+    if(LEVEL_ENABLED(level) && SECTOR_SIZE(level) < level->block_size)
+      printf("%s sectors: %u bytes\n", level->name, SECTOR_SIZE(level));
+  }
+  if(h->dram_config.channels != 0)
+    display_dram(&h->dram_config);
+  printf("DRAM traffic: %llu bytes read in %llu transfers, %llu bytes written in %llu transfers\n",
+	 h->dram_reads, h->dram_read_transfers, h->dram_writes, h->dram_write_transfers);
+}
+
+void configure_stack_distance(StringTokenizer* tokenizer)
+{
+  char* command = nextToken(tokenizer);
+  int block;
+  AccessType filter = DATA_ACCESS;
+  int filter_active = 0;
+
+  if(strcmp(command, "off") == 0)
+  {
+    stop_stack_distance();
+    printf("Stack distance analysis stopped\n");
+    return;
+  }
+
+  block = atoi(command);
+  if(block < 4 || (block & (block - 1)) != 0)
+  {
+    printf("Please specify a block size that is a power of two of at least 4 bytes.\n");
+    return;
+  }
+
+  command = nextToken(tokenizer);
+  if(strcmp(command, "inst") == 0)
+  {
+    filter = INSTRUCTION_FETCH;
+    filter_active = 1;
+  }
+  else if(strcmp(command, "data") == 0)
+    filter_active = 1;
+  else if(strlen(command) != 0 && strcmp(command, "all") != 0)
+  {
+    printf("Invalid access type: %s\n", command);
+    return;
+  }
+
+  if(start_stack_distance(block, filter, filter_active) != 0)
+  {
+    printf("Not enough memory for the stack distance analysis\n");
+    return;
+  }
+
+  printf("Stack distance analysis started for %d byte blocks\n", block);
+}
+
+/* parses "<min>:<max>" (or a single value) into a range of powers of two */
+static int parse_range(const char* value, unsigned int limit, unsigned int* min, unsigned int* max)
+{
+  unsigned long low, high;
+  char* end;
+
+  if(!isdigit((unsigned char)*value))
+    return -1;
+  low = high = strtoul(value, &end, 10);
+  if(*end == ':')
+  {
+    if(!isdigit((unsigned char)end[1]))
+      return -1;
+    high = strtoul(end + 1, &end, 10);
+  }
+  if(*end != '\0')
+    return -1;
+
+  if(low < 1 || high < low || high > limit || (low & (low - 1)) != 0 || (high & (high - 1)) != 0)
+    return -1;
+
+  *min = low;
+  *max = high;
+  return 0;
+}
+
+/* parses a comma separated list of replacement or sync policies into a mask */
+static int parse_policies(char* value, int sync, unsigned int* mask)
+{
+  char* name;
+  int p;
+
+  *mask = 0;
+  for(name = strtok(value, ","); name != NULL; name = strtok(NULL, ","))
+  {
+    if(sync)
+      p = strcmp(name, "wb") == 0 ? WRITE_BACK : (strcmp(name, "wt") == 0 ? WRITE_THROUGH : -1);
+    else
+      p = find_replacement_policy(name);
+    if(p < 0)
+      return -1;
+    *mask |= 1 << p;
+  }
+
+  return 0;
+}
+
+void sweep_cache(StringTokenizer* tokenizer)
+{
+  sweepSpace space = { 1, MAX_LEVEL_SETS, 1, MAX_ASSOC, 4, MAX_BLOCK_SIZE, 1 << LRU, 1 << WRITE_BACK, 0 };
+  char option[200];
+  char file[200] = "";
+  char* value;
+  int json = 0;
+  int error = 0;
+  int count;
+  FILE* out = stdout;
+  char* command = nextToken(tokenizer);
+
+  if(strcmp(command, "record") == 0)
+  {
+    start_sweep_recording();
+    printf("Recording accesses for a sweep\n");
+    return;
+  }
+  else if(strcmp(command, "stop") == 0)
+  {
+    stop_sweep_recording();
+    printf("%llu accesses recorded\n", sweep_recorded_accesses());
+    return;
+  }
+  else if(strcmp(command, "run") != 0)
+  {
+    printf("Invalid sweep command: %s\n", command);
+    return;
+  }
+
+  while(strlen(command = nextToken(tokenizer)) != 0)
+  {
+    strcpy(option, command);
+    if((value = strchr(option, '=')) == NULL)
+      value = option + strlen(option);
+    else
+      *value++ = '\0';
+
+    if(strcmp(option, "sets") == 0)
+      error = parse_range(value, MAX_LEVEL_SETS, &space.min_sets, &space.max_sets);
+    else if(strcmp(option, "assoc") == 0)
+      error = parse_range(value, MAX_ASSOC, &space.min_assoc, &space.max_assoc);
+    else if(strcmp(option, "block") == 0)
+      error = parse_range(value, MAX_BLOCK_SIZE, &space.min_block, &space.max_block) || space.min_block < 4;
+    else if(strcmp(option, "policy") == 0)
+      error = parse_policies(value, 0, &space.policies);
+    else if(strcmp(option, "sync") == 0)
+      error = parse_policies(value, 1, &space.sync_policies);
+    else if(strcmp(option, "threads") == 0)
+      space.threads = atoi(value);
+    else if(strcmp(option, "format") == 0 && (strcmp(value, "csv") == 0 || strcmp(value, "json") == 0))
+      json = strcmp(value, "json") == 0;
+    else if(strcmp(option, "file") == 0)
+      strcpy(file, value);
+    else
+      error = 1;
+
+    if(error)
+    {
+      printf("Invalid sweep option: %s\n", command);
+      return;
+    }
+  }
+
+  if(sweep_recording)
+    stop_sweep_recording();
+
+  if(strlen(file) != 0 && (out = fopen(file, "w")) == NULL)
+  {
+    printf("Unable to open [%s]\n", file);
+    return;
+  }
+
+  count = run_sweep(&space, out, json);
+  if(out != stdout)
+    fclose(out);
+
+  if(count < 0)
+    printf("No accesses recorded; use \"sweep record\" and run the program first\n");
+  else
+    printf("%d configurations swept over %llu accesses\n", count, sweep_recorded_accesses());
+}
+
+void trace_cache(StringTokenizer* tokenizer)
+{
+  cacheHierarchy h;
+  TraceFormat format = TRACE_DETECT;
+  char file[200];
+  long long count;
+  char* command = nextToken(tokenizer);
+
+  if(strcmp(command, "stop") == 0)
+  {
+    printf("%llu accesses traced\n", stop_trace_recording());
+    return;
+  }
+  else if(strcmp(command, "record") != 0 && strcmp(command, "replay") != 0)
+  {
+    printf("Invalid trace command: %s\n", command);
+    return;
+  }
+
+  if(strcmp(command, "record") == 0)
+  {
+    command = nextToken(tokenizer);
+    if(strlen(command) == 0 || start_trace_recording(command) != 0)
+      printf("Unable to create [%s]\n", command);
+    else
+      printf("Tracing accesses to [%s]\n", command);
+    return;
+  }
 
-  //I'm probably making this way too ugly with the additional check for LFU
-  printf("\nCache parameters changed:\n + set count = %d\n + associativity = %d\n + block size = %d\n + replacement policy = %s\n + memory sync policy = %s\n", set_count, assoc, block_size, (policy == RANDOM ? "Random" : (policy == LRU ? "LRU" : "LFU")), (memory_sync_policy == WRITE_BACK ? "Write Back" : "Write Through"));
+  strcpy(file, nextToken(tokenizer));
+  command = nextToken(tokenizer);
+  if(strcmp(command, "tips") == 0)
+    format = TRACE_TIPS;
+  else if(strcmp(command, "din") == 0)
+    format = TRACE_DINERO;
+  else if(strcmp(command, "lackey") == 0)
+    format = TRACE_LACKEY;
+  else if(strlen(command) != 0)
+  {
+    printf("Invalid trace format: %s\n", command);
+    return;
+  }
+
+  /* the trace runs through a copy of the configured hierarchy, so that the
+     cache of the simulated CPU keeps its contents */
+  memset(&h, 0, sizeof(h));
+  if(copy_hierarchy_config(&h, &memory_hierarchy) != 0)
+    printf("Unable to allocate the cache hierarchy\n");
+  else if((count = replay_trace(file, format, &h)) < 0)
+    printf("Unable to read [%s]\n", file);
+  else
+  {
+    printf("%lld accesses replayed from [%s]\n", count, file);
+    display_hierarchy(&h);
+  }
+  free_hierarchy(&h);
 }
 
 void do_step(StringTokenizer* tokenizer)
@@ -324,14 +1236,159 @@ void start_simulation(StringTokenizer* tokenizer)
 
 }
 
-void activate_no_gui(int argc, char** argv)
+/*
+  Runs one console command
+
+  returns 0 if the command ends the console, 1 otherwise.
+*/
+static int execute_command(char* input)
 {
   int console_active = 1;
   StringTokenizer* tokenizer;
-  char input[200];
   char* command;
   int speed;
 
+  tokenizer = initTokenizer(input);
+  command = nextToken(tokenizer);
+
+  if(strcmp(command, "quit") == 0)
+    console_active = 0;
+  else if(strcmp(command, "exit") == 0)
+    console_active = 0;
+  else if(strcmp(command, "print") == 0 ||
+	  strcmp(command, "display") == 0)
+  {
+    command = nextToken(tokenizer);
+    if(strcmp(command, "regs") == 0)
+      display_regs();
+    else if(strcmp(command, "cache") == 0)
+      display_cache();
+    else if(strcmp(command, "hierarchy") == 0)
+      display_hierarchy(&memory_hierarchy);
+    else if(strcmp(command, "stats") == 0)
+      display_stats(tokenizer);
+    else if(strcmp(command, "mrc") == 0)
+      report_stack_distance(stdout);
+    else if(strcmp(command, "profile") == 0)
+      display_profile(tokenizer);
+    else if(strcmp(command, "timing") == 0)
+      report_timing(&memory_hierarchy, stdout);
+    else if(strcmp(command, "coherence") == 0)
+      display_coherence(tokenizer);
+    else if(strcmp(command, "vm") == 0)
+      report_vm(stdout);
+    else
+      printf("Invalid command: %s\n", input);
+  }
+  else if(strcmp(command, "config") == 0)
+    configure_cache(tokenizer);
+  else if(strcmp(command, "latency") == 0)
+    configure_latency(tokenizer);
+  else if(strcmp(command, "prefetch") == 0)
+    configure_prefetch(tokenizer);
+  else if(strcmp(command, "dram") == 0)
+    configure_dram(tokenizer);
+  else if(strcmp(command, "timing") == 0)
+    configure_timing(tokenizer);
+  else if(strcmp(command, "mshr") == 0)
+    configure_mshr(tokenizer);
+  else if(strcmp(command, "cores") == 0)
+    configure_core_count(tokenizer);
+  else if(strcmp(command, "coherence") == 0)
+    configure_protocol(tokenizer);
+  else if(strcmp(command, "memory") == 0)
+    configure_memory(tokenizer);
+  else if(strcmp(command, "tlb") == 0)
+    configure_tlbs(tokenizer);
+  else if(strcmp(command, "victim") == 0)
+    configure_buffers(tokenizer, 0);
+  else if(strcmp(command, "writebuffer") == 0)
+    configure_buffers(tokenizer, 1);
+  else if(strcmp(command, "allocate") == 0)
+    configure_allocation(tokenizer, 0);
+  else if(strcmp(command, "sector") == 0)
+    configure_allocation(tokenizer, 1);
+  else if(strcmp(command, "trace") == 0)
+    trace_cache(tokenizer);
+  else if(strcmp(command, "sweep") == 0)
+    sweep_cache(tokenizer);
+  else if(strcmp(command, "stackdist") == 0)
+    configure_stack_distance(tokenizer);
+  else if(strcmp(command, "view") == 0)
+  {
+    command = nextToken(tokenizer);
+    if(strcmp(command, "i") == 0 || strcmp(command, "index") == 0)
+    {
+      view = INDEX;
+      printf("Cache view now index based\n");
+    }
+    else if(strcmp(command, "a") == 0 || strcmp(command, "assoc") == 0)
+    {
+      view = ASSOC;
+      printf("Cache view now assoc based\n");
+    }
+    else
+      printf("Invalide command: %s\n", input);
+  }
+  else if(strcmp(command, "load") == 0)
+  {
+    command = nextToken(tokenizer);
+    load_dumpfile(command);
+  }
+  else if(strcmp(command, "s") == 0)
+    do_step(tokenizer);
+  else if(strcmp(command, "step") == 0)
+    do_step(tokenizer);
+  else if(strcmp(command, "run") == 0)
+  {
+    command = nextToken(tokenizer);
+    speed = atoi(command);
+    if(speed < 10)
+      speed = 10;
+    run_active = 1;
+    while(run_active)
+    {
+      step_processor();
+      usleep(1000 * speed);
+    }
+  }
+  else if(strcmp(command, "reinit") == 0)
+  {
+    reinit_processor();
+    printf("\nPC reset");
+    flush_cache();
+    printf("\nCache flushed\n");
+  }
+  else if(strcmp(command, "reset") == 0)
+  {
+    command = nextToken(tokenizer);
+    if(strcmp(command, "cpu") == 0)
+    {
+      reinit_processor();
+      printf("\nPC reset\n");
+    }
+    else if(strcmp(command, "cache") == 0)
+    {
+      flush_cache();
+      printf("\nCache flushed\n");
+    }
+    else
+      printf("Invalid command: %s\n", input);
+  }
+  else if(strcmp(command, "help") == 0)
+    display_help();
+  else if(strlen(command) != 0)
+    printf("Invalid command: %s\n", input);
+
+  destroy_tokenizer(tokenizer);
+  return console_active;
+}
+
+void activate_no_gui(int argc, char** argv)
+{
+  int console_active = 1;
+  char input[200];
+
   (void)signal(SIGINT, catch);
   run_active = 0;
   
@@ -345,93 +1402,100 @@ void activate_no_gui(int argc, char** argv)
   {
     printf("\n[%s] > ", program_name);
     fgets(input, 200, stdin);
+    console_active = execute_command(input);
+  }
+}
 
-    tokenizer = initTokenizer(input);
-    command = nextToken(tokenizer);
+/* Runs the console commands given with -c among argv[first] to argv[last - 1] */
+static void run_batch_commands(char** argv, int first, int last)
+{
+  char input[200];
+  int i;
 
-    if(strcmp(command, "quit") == 0)
-      console_active = 0;
-    else if(strcmp(command, "exit") == 0)
-      console_active = 0;
-    else if(strcmp(command, "print") == 0 ||
-	    strcmp(command, "display") == 0)
-    {
-      command = nextToken(tokenizer);
-      if(strcmp(command, "regs") == 0)
-	display_regs();
-      else if(strcmp(command, "cache") == 0)
-	display_cache();
-      else
-	printf("Invalid command: %s\n", input);
-    }
-    else if(strcmp(command, "config") == 0)
-      configure_cache(tokenizer);
-    else if(strcmp(command, "view") == 0)
-    {
-      command = nextToken(tokenizer);
-      if(strcmp(command, "i") == 0 || strcmp(command, "index") == 0)
-      {
-	view = INDEX;
-	printf("Cache view now index based\n");
-      }
-      else if(strcmp(command, "a") == 0 || strcmp(command, "assoc") == 0)
-      {
-	view = ASSOC;
-	printf("Cache view now assoc based\n");
-      }
-      else
-	printf("Invalide command: %s\n", input);
-    }
-    else if(strcmp(command, "load") == 0)
+  for(i = first; i < last; i++)
+  {
+    if(strcmp(argv[i], "-c") == 0)
     {
-      command = nextToken(tokenizer);
-      load_dumpfile(command);
+      snprintf(input, sizeof(input), "%s", argv[++i]);
+      execute_command(input);
     }
-    else if(strcmp(command, "s") == 0)
-      do_step(tokenizer);
-    else if(strcmp(command, "step") == 0)
-      do_step(tokenizer);
-    else if(strcmp(command, "run") == 0)
-    {
-      command = nextToken(tokenizer);
-      speed = atoi(command);
-      if(speed < 10)
-	speed = 10;
-      run_active = 1;
-      while(run_active)
-      {
-	step_processor();
-	usleep(1000 * speed);
-      }
-    }
-    else if(strcmp(command, "reinit") == 0)
-    {
-      reinit_processor();
-      printf("\nPC reset");
-      flush_cache();
-      printf("\nCache flushed\n");
-    }
-    else if(strcmp(command, "reset") == 0)
+    else if(strcmp(argv[i], "-max") == 0)
+      i++;
+  }
+}
+
+/*
+  Runs a program from the command line at full speed, without the console
+  or the per-instruction log:
+
+    tips -batch [-c "<command>"]... [-max <instructions>] <dumpfile> [-c "<command>"]...
+
+  The -c commands are console commands; those before the dump file run
+  before it is loaded, to configure the caches (e.g. -c "config 4 2 16 lru wb"),
+  and those after it once the program has ended (e.g. -c "print regs").  The
+  program runs to its end, or for at most -max instructions per core, and
+  then the statistics are printed.
+
+  returns 0 if successful, non-zero if the arguments or the dump file could
+  not be used.
+*/
+int run_batch(int argc, char** argv)
+{
+  int file = 0;
+  unsigned long long limit = 0;
+  unsigned long long steps;
+  unsigned long long instructions = 0;
+  clock_t start;
+  double seconds;
+  int i;
+
+  for(i = 2; i < argc; i++)
+  {
+    if(strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+      i++;
+    else if(strcmp(argv[i], "-max") == 0 && i + 1 < argc)
+      limit = strtoull(argv[++i], NULL, 0);
+    else if(argv[i][0] != '-' && file == 0)
+      file = i;
+    else
     {
-      command = nextToken(tokenizer);
-      if(strcmp(command, "cpu") == 0)
-      {
-	reinit_processor();
-	printf("\nPC reset\n");
-      }
-      else if(strcmp(command, "cache") == 0)
-      {
-	flush_cache();
-	printf("\nCache flushed\n");
-      }
-      else
-	printf("Invalid command: %s\n", input);
+      printf("Invalid argument: %s\n", argv[i]);
+      file = 0;
+      break;
     }
-    else if(strcmp(command, "help") == 0)
-      display_help();
-    else if(strlen(command) != 0)
-      printf("Invalid command: %s\n", input);
+  }
+  if(file == 0)
+  {
+    printf("Usage: %s -batch [-c \"<command>\"]... [-max <instructions>] <dumpfile> [-c \"<command>\"]...\n", program_name);
+    return 1;
+  }
+
+  run_batch_commands(argv, 2, file);
+  if(load_dumpfile(argv[file]) != 0)
+    return 1;
 
-    destroy_tokenizer(tokenizer);
+  /* Run to the sentinel */
+  start = clock();
+  for(steps = 0; !processor_halted() && (limit == 0 || steps < limit); steps++)
+    step_processor();
+  seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  for(i = 0; i < core_count; i++)
+    instructions += core_hierarchy(i)->accesses[IFETCH];
+  printf("%llu instructions in %.3f s%s\n\n", instructions, seconds, processor_halted() ? "" : ", stopped before the end");
+
+  report_stats(&memory_hierarchy, stdout);
+  if(memory_hierarchy.timed)
+  {
+    printf("\n");
+    report_timing(&memory_hierarchy, stdout);
   }
+  if(core_count > 1)
+  {
+    printf("\n");
+    report_coherence(10, stdout);
+  }
+
+  run_batch_commands(argv, file + 1, argc);
+  return 0;
 }
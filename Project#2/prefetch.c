@@ -0,0 +1,318 @@
+#include "tips.h"
+
+/******************************************************************************
+   Prefetchers
+
+   A level may have a prefetcher that watches its demand accesses and asks
+   for blocks it expects to be needed soon:
+
+     nextline - on a miss, or on the first use of a prefetched block, the
+                degree blocks starting distance blocks past it
+     stride - a table indexed by the PC of loads and stores remembers the
+              last address and stride of each; once the same stride is seen
+              twice, degree blocks starting distance strides ahead
+     stream - up to STREAM_COUNT ascending or descending streams of misses;
+              once a miss continues a stream, degree blocks starting
+              distance blocks further along it
+
+   The cache logic issues the requests (see cachelogic.c): prefetched blocks
+   go into the level itself, or into a small fully associative prefetch
+   buffer beside it that is checked on a miss.  This file keeps the state of
+   the predictors and of the buffer.
+ *****************************************************************************/
+
+#define STRIDE_TABLE_SIZE 64
+#define STREAM_COUNT 4
+
+typedef struct {
+  address pc;
+  address last;
+  int stride;
+  unsigned int confidence;          /* 0..3, prefetches from 2 */
+  int valid;
+} strideEntry;
+
+typedef struct {
+  address last;                     /* last block of the stream */
+  int direction;                    /* +1, -1, or 0 until confirmed */
+  unsigned long long used;          /* for LRU replacement of streams */
+  int valid;
+} streamEntry;
+
+struct _prefetcher {
+  strideEntry stride[STRIDE_TABLE_SIZE];
+  streamEntry stream[STREAM_COUNT];
+  unsigned long long stream_clock;
+  prefetchLine* buffer;
+  unsigned long long buffer_clock;
+};
+
+static const struct {
+  const char* command;
+  const char* name;
+} prefetchers[PREFETCHER_COUNT] = {
+  { "off", "None" },
+  { "nextline", "Next line" },
+  { "stride", "Stride" },
+  { "stream", "Stream" }
+};
+
+const char* prefetcher_name(PrefetcherKind kind)
+{
+  return kind < PREFETCHER_COUNT ? prefetchers[kind].name : "Unknown";
+}
+
+/* returns the prefetcher named command, or -1 */
+int find_prefetcher(const char* command)
+{
+  int kind;
+
+  for(kind = PREFETCH_NONE; kind < PREFETCHER_COUNT; kind++)
+  {
+    if(strcmp(command, prefetchers[kind].command) == 0)
+      return kind;
+  }
+
+  return -1;
+}
+
+/*
+  Empties the prefetcher of a level, as configured by level->prefetch.
+  Called when the level is flushed.
+
+  returns 0 if successful, non-zero if it could not be allocated.
+*/
+int reset_prefetcher(cacheLevel* level)
+{
+  prefetchEngine* p = level->prefetcher;
+
+  if(p == NULL && (p = level->prefetcher = (prefetchEngine*)calloc(1, sizeof(prefetchEngine))) == NULL)
+    return -1;
+
+  free(p->buffer);
+  memset(p, 0, sizeof(prefetchEngine));
+  if(level->prefetch.buffer_lines != 0 &&
+     (p->buffer = (prefetchLine*)calloc(level->prefetch.buffer_lines, sizeof(prefetchLine))) == NULL)
+  {
+    free_prefetcher(level);
+    return -1;
+  }
+
+  return 0;
+}
+
+void free_prefetcher(cacheLevel* level)
+{
+  if(level->prefetcher == NULL)
+    return;
+
+  free(level->prefetcher->buffer);
+  free(level->prefetcher);
+  level->prefetcher = NULL;
+}
+
+/* Adds the block of from + offset to the requests, unless it is already
+   there or the address wraps around */
+static unsigned int add_request(cacheLevel* level, address* blocks, unsigned int count, address from, long long offset)
+{
+  long long target = (long long)from + offset;
+  address block;
+  unsigned int i;
+
+  if(target < 0 || target > 0xffffffffLL)
+    return count;
+
+  block = (address)target & ~(level->block_size - 1);
+  for(i = 0; i < count; i++)
+  {
+    if(blocks[i] == block)
+      return count;
+  }
+
+  blocks[count] = block;
+  return count + 1;
+}
+
+static unsigned int predict_stride(cacheLevel* level, address pc, address addr, address* blocks)
+{
+  strideEntry* e = &level->prefetcher->stride[(pc >> 2) % STRIDE_TABLE_SIZE];
+  unsigned int count = 0;
+  unsigned int i;
+  int stride;
+
+  if(!e->valid || e->pc != pc)
+  {
+    e->valid = 1;
+    e->pc = pc;
+    e->last = addr;
+    e->stride = 0;
+    e->confidence = 0;
+    return 0;
+  }
+
+  stride = (int)(addr - e->last);
+  e->last = addr;
+  if(stride == e->stride && stride != 0)
+  {
+    if(e->confidence < 3)
+      e->confidence++;
+  }
+  else if(e->confidence > 0)
+    e->confidence--;
+  else
+    e->stride = stride;
+
+  if(e->confidence < 2)
+    return 0;
+
+  for(i = 0; i < level->prefetch.degree; i++)
+    count = add_request(level, blocks, count, addr, (long long)e->stride * (level->prefetch.distance + i));
+  return count;
+}
+
+static unsigned int predict_stream(cacheLevel* level, address block, address* blocks)
+{
+  prefetchEngine* p = level->prefetcher;
+  streamEntry* e;
+  streamEntry* victim = &p->stream[0];
+  long long step = level->block_size;
+  long long ahead;
+  unsigned int count = 0;
+  unsigned int i;
+
+  p->stream_clock++;
+  for(i = 0; i < STREAM_COUNT; i++)
+  {
+    e = &p->stream[i];
+    if(!e->valid)
+    {
+      if(victim->valid)
+	victim = e;
+      continue;
+    }
+    if(victim->valid && e->used < victim->used)
+      victim = e;
+
+    /* an unconfirmed stream takes the direction of its second miss */
+    if(e->direction == 0 && (block == e->last + step || block == e->last - step))
+      e->direction = (block == e->last + step) ? 1 : -1;
+    else if(e->direction == 0)
+      continue;
+    else
+    {
+      /* a confirmed stream accepts any block up to its prefetch window */
+      ahead = ((long long)block - e->last) * e->direction;
+      if(ahead <= 0 || ahead > step * (level->prefetch.distance + level->prefetch.degree))
+	continue;
+    }
+
+    e->last = block;
+    e->used = p->stream_clock;
+    for(i = 0; i < level->prefetch.degree; i++)
+      count = add_request(level, blocks, count, block, e->direction * step * (long long)(level->prefetch.distance + i));
+    return count;
+  }
+
+  victim->valid = 1;
+  victim->last = block;
+  victim->direction = 0;
+  victim->used = p->stream_clock;
+  return 0;
+}
+
+/*
+  Trains the prefetcher of a level with a demand access, and returns the
+  blocks it asks for
+
+    pc, addr, type - the instruction, address and type of the access
+    trigger - non-zero for a miss, or for the first use of a prefetched block
+    blocks - receives the addresses of the first bytes of the blocks, at most
+             MAX_PREFETCH_DEGREE of them
+
+  returns the number of blocks requested
+*/
+unsigned int predict_prefetches(cacheLevel* level, address pc, address addr, AccessType type, int trigger, address* blocks)
+{
+  address block = addr & ~(level->block_size - 1);
+  unsigned int count = 0;
+  unsigned int i;
+
+  if(level->prefetcher == NULL)
+    return 0;
+
+  switch(level->prefetch.kind)
+  {
+  case PREFETCH_NEXT_LINE:
+    if(trigger)
+    {
+      for(i = 0; i < level->prefetch.degree; i++)
+	count = add_request(level, blocks, count, block, (long long)level->block_size * (level->prefetch.distance + i));
+    }
+    break;
+  case PREFETCH_STRIDE:
+    /* instruction fetches would share the table entries of their own PCs */
+    if(type == DATA_ACCESS)
+      count = predict_stride(level, pc, addr, blocks);
+    break;
+  case PREFETCH_STREAM:
+    if(trigger)
+      count = predict_stream(level, block, blocks);
+    break;
+  default:
+    break;
+  }
+
+  return count;
+}
+
+/* returns the line of the prefetch buffer holding block, or NULL */
+prefetchLine* find_prefetched_line(cacheLevel* level, address block)
+{
+  prefetchLine* line;
+  unsigned int i;
+
+  if(level->prefetcher == NULL || level->prefetcher->buffer == NULL)
+    return NULL;
+
+  for(i = 0; i < level->prefetch.buffer_lines; i++)
+  {
+    line = &level->prefetcher->buffer[i];
+    if(line->valid && line->block == block)
+      return line;
+  }
+
+  return NULL;
+}
+
+/*
+  Returns the line of the prefetch buffer a new prefetch goes into: an empty
+  one, else the least recently prefetched, which is dropped (buffer lines are
+  never dirty).
+*/
+prefetchLine* prefetch_buffer_slot(cacheLevel* level)
+{
+  prefetchEngine* p = level->prefetcher;
+  prefetchLine* slot;
+  unsigned int i;
+
+  if(p == NULL || p->buffer == NULL)
+    return NULL;
+
+  slot = &p->buffer[0];
+  for(i = 0; i < level->prefetch.buffer_lines; i++)
+  {
+    if(!p->buffer[i].valid)
+    {
+      slot = &p->buffer[i];
+      break;
+    }
+    if(p->buffer[i].used < slot->used)
+      slot = &p->buffer[i];
+  }
+
+  if(slot->valid)
+    level->useless_prefetches++;
+  slot->valid = 0;
+  slot->used = ++p->buffer_clock;
+  return slot;
+}
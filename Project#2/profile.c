@@ -0,0 +1,168 @@
+#include "tips.h"
+#include <netinet/in.h>
+
+/******************************************************************************
+   Per-PC miss profile
+
+   The hierarchy counts, for every instruction address, how many of the
+   accesses it made (its fetches and its loads/stores) missed in the level
+   they entered and how many went all the way to DRAM.  The counters live in
+   an open addressing hash table keyed by PC, reset by a flush.
+ *****************************************************************************/
+
+typedef struct {
+  address pc;
+  int used;
+  unsigned long long accesses[2];   /* indexed by AccessType */
+  unsigned long long misses[2];
+  unsigned long long dram[2];
+} pcCounters;
+
+struct _pcProfile {
+  pcCounters* entries;
+  unsigned int capacity;
+  unsigned int count;
+};
+
+/* Empties the profile of a hierarchy; returns non-zero if out of memory */
+int reset_pc_profile(cacheHierarchy* h)
+{
+  if(h->profile == NULL && (h->profile = (pcProfile*)calloc(1, sizeof(pcProfile))) == NULL)
+    return -1;
+
+  if(h->profile->entries != NULL)
+    memset(h->profile->entries, 0, h->profile->capacity * sizeof(pcCounters));
+  h->profile->count = 0;
+  return 0;
+}
+
+void free_pc_profile(cacheHierarchy* h)
+{
+  if(h->profile == NULL)
+    return;
+
+  free(h->profile->entries);
+  free(h->profile);
+  h->profile = NULL;
+}
+
+static pcCounters* find_pc(pcCounters* entries, unsigned int capacity, address pc)
+{
+  unsigned int i = ((pc >> 2) * 2654435761u) & (capacity - 1);
+
+  while(entries[i].used && entries[i].pc != pc)
+    i = (i + 1) & (capacity - 1);
+
+  return &entries[i];
+}
+
+/* keeps the table at most half full */
+static int grow_profile(pcProfile* p)
+{
+  pcCounters* old = p->entries;
+  unsigned int old_capacity = p->capacity;
+  unsigned int capacity = old_capacity ? 2 * old_capacity : 1024;
+  pcCounters* entries;
+  unsigned int i;
+
+  if((entries = (pcCounters*)calloc(capacity, sizeof(pcCounters))) == NULL)
+    return -1;
+
+  for(i = 0; i < old_capacity; i++)
+  {
+    if(old[i].used)
+      *find_pc(entries, capacity, old[i].pc) = old[i];
+  }
+
+  free(old);
+  p->entries = entries;
+  p->capacity = capacity;
+  return 0;
+}
+
+/*
+  Counts one access of the instruction at pc
+
+    missed - non-zero if it missed in the level it entered
+    dram - non-zero if it had to read DRAM
+*/
+void profile_access(cacheHierarchy* h, address pc, AccessType type, int missed, int dram)
+{
+  pcProfile* p = h->profile;
+  pcCounters* entry;
+
+  if(p == NULL)
+    return;
+  if(2 * (p->count + 1) > p->capacity && grow_profile(p) != 0)
+    return;
+
+  entry = find_pc(p->entries, p->capacity, pc);
+  if(!entry->used)
+  {
+    entry->used = 1;
+    entry->pc = pc;
+    p->count++;
+  }
+
+  entry->accesses[type]++;
+  entry->misses[type] += missed != 0;
+  entry->dram[type] += dram != 0;
+}
+
+static int compare_misses(const void* a, const void* b)
+{
+  const pcCounters* x = *(const pcCounters* const*)a;
+  const pcCounters* y = *(const pcCounters* const*)b;
+  unsigned long long x_misses = x->misses[INSTRUCTION_FETCH] + x->misses[DATA_ACCESS];
+  unsigned long long y_misses = y->misses[INSTRUCTION_FETCH] + y->misses[DATA_ACCESS];
+
+  if(x_misses != y_misses)
+    return x_misses < y_misses ? 1 : -1;
+  return x->pc < y->pc ? -1 : (x->pc > y->pc);
+}
+
+/* Prints the count instructions with the most misses, and their disassembly */
+void report_pc_profile(const cacheHierarchy* h, unsigned int count, FILE* out)
+{
+  pcProfile* p = h->profile;
+  pcCounters** sorted;
+  pcCounters* e;
+  unsigned int n = 0;
+  unsigned int i;
+  char text[200];
+  word inst;
+
+  if(p == NULL || p->count == 0)
+  {
+    fprintf(out, "No accesses profiled\n");
+    return;
+  }
+
+  if((sorted = (pcCounters**)malloc(p->count * sizeof(pcCounters*))) == NULL)
+    return;
+  for(i = 0; i < p->capacity; i++)
+  {
+    if(p->entries[i].used)
+      sorted[n++] = &p->entries[i];
+  }
+  qsort(sorted, n, sizeof(pcCounters*), compare_misses);
+
+  fprintf(out, "PC          Loads/Stores     Misses  Miss Rate       DRAM  Fetch Misses  Instruction\n");
+  for(i = 0; i < n && i < count; i++)
+  {
+    e = sorted[i];
+
+    /* traces from elsewhere have PCs outside the loaded program */
+    if(e->pc >= PROGRAM_START && e->pc < PROGRAM_END && peekDRAM(e->pc, (byte*)&inst, sizeof(inst)) == 0)
+      format_inst(text, ntohl(inst), e->pc);
+    else
+      strcpy(text, "-");
+    text[strcspn(text, "\n")] = '\0';
+
+    fprintf(out, "0x%08X  %12llu  %9llu  %8.2f%%  %9llu  %12llu  %s\n", e->pc, e->accesses[DATA_ACCESS], e->misses[DATA_ACCESS],
+	    (e->accesses[DATA_ACCESS] == 0 ? 0.0 : 100.0 * e->misses[DATA_ACCESS] / e->accesses[DATA_ACCESS]),
+	    e->dram[DATA_ACCESS], e->misses[INSTRUCTION_FETCH], text);
+  }
+
+  free(sorted);
+}
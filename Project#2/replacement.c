@@ -0,0 +1,308 @@
+#include "tips.h"
+#include "util.h"
+
+/******************************************************************************
+   Replacement policies
+
+   Each policy is a set of hooks called by the cache logic:
+
+     init - a block is flushed (also resets the per-set state)
+     on_hit - a valid block was accessed
+     on_fill - a block was just brought into the set
+     choose_victim - every block of the set is valid; pick one to evict
+
+   Per-block state lives in lru.value and accessCount, per-set state in the
+   replacement field of the set.  The cache logic always fills invalid blocks
+   before asking for a victim.
+ *****************************************************************************/
+
+/* LFU counts are halved after this many accesses to a set */
+#define LFU_AGING_PERIOD 64
+
+/* Re-reference prediction values are 2 bits wide */
+#define RRPV_MAX 3
+
+/* BRRIP inserts with a long re-reference prediction once in this many fills */
+#define BRRIP_LONG_INTERVAL 32
+
+/******************************************************************************
+   Random
+ *****************************************************************************/
+
+static void random_init(cacheLevel* level, unsigned int set_index, unsigned int block_index)
+{
+  level->set[set_index].replacement = 0;
+}
+
+static void random_update(cacheLevel* level, unsigned int set_index, unsigned int block_index)
+{
+}
+
+static unsigned int random_victim(cacheLevel* level, unsigned int set_index)
+{
+  return randomint_r(&level->hierarchy->random_state, level->assoc);
+}
+
+/******************************************************************************
+   LRU -- assoc - 1 means most recently used down to 0 which means least
+   recently used; acts like a Jenga stack where you can pull from anywhere and
+   put on top
+ *****************************************************************************/
+
+static void lru_init(cacheLevel* level, unsigned int set_index, unsigned int block_index)
+{
+  level->set[set_index].replacement = 0;
+  level->set[set_index].block[block_index].lru.value = 0;
+}
+
+static void lru_update(cacheLevel* level, unsigned int set_index, unsigned int block_index)
+{
+  cacheSet* set = &level->set[set_index];
+  unsigned int old_lru = set->block[block_index].lru.value;
+  unsigned int i;
+
+  /* Decrement the LRU of all blocks above the old value; this will lead to
+     an order of LRUs from 0 to assoc - 1 if all blocks are used */
+  for(i = 0; i < level->assoc; i++)
+  {
+    if(set->block[i].lru.value > old_lru)
+      set->block[i].lru.value--;
+  }
+
+  set->block[block_index].lru.value = level->assoc - 1;
+}
+
+static unsigned int lru_victim(cacheLevel* level, unsigned int set_index)
+{
+  cacheSet* set = &level->set[set_index];
+  unsigned int i;
+
+  for(i = 0; i < level->assoc; i++)
+  {
+    if(set->block[i].lru.value == 0)
+      return i;
+  }
+
+  return 0;
+}
+
+/******************************************************************************
+   LFU with aging -- every LFU_AGING_PERIOD accesses to a set all of its
+   counts are halved, so blocks that were hot long ago can be evicted
+ *****************************************************************************/
+
+static void lfu_init(cacheLevel* level, unsigned int set_index, unsigned int block_index)
+{
+  level->set[set_index].replacement = 0;
+  level->set[set_index].block[block_index].accessCount = 0;
+}
+
+static void lfu_age(cacheLevel* level, unsigned int set_index)
+{
+  cacheSet* set = &level->set[set_index];
+  unsigned int i;
+
+  if(++set->replacement < LFU_AGING_PERIOD)
+    return;
+
+  for(i = 0; i < level->assoc; i++)
+    set->block[i].accessCount >>= 1;
+  set->replacement = 0;
+}
+
+static void lfu_hit(cacheLevel* level, unsigned int set_index, unsigned int block_index)
+{
+  level->set[set_index].block[block_index].accessCount++;
+  lfu_age(level, set_index);
+}
+
+static void lfu_fill(cacheLevel* level, unsigned int set_index, unsigned int block_index)
+{
+  level->set[set_index].block[block_index].accessCount = 1;
+  lfu_age(level, set_index);
+}
+
+static unsigned int lfu_victim(cacheLevel* level, unsigned int set_index)
+{
+  cacheSet* set = &level->set[set_index];
+  unsigned int victim = 0;
+  unsigned int i;
+
+  for(i = 1; i < level->assoc; i++)
+  {
+    if(set->block[i].accessCount < set->block[victim].accessCount)
+      victim = i;
+  }
+
+  return victim;
+}
+
+/******************************************************************************
+   Tree pseudo-LRU -- one bit per node of a binary tree over the blocks, kept
+   in the replacement field of the set (node n at bit n, root at bit 1).  A
+   bit of 0 points the victim search left, 1 right; an access flips the bits
+   on its path to point away from the block.  Associativities that are not a
+   power of two use the next larger tree and never walk into the blocks past
+   assoc.
+ *****************************************************************************/
+
+/* number of leaves of the tree for an associativity */
+static unsigned int plru_leaves(unsigned int assoc)
+{
+  unsigned int leaves = 1;
+
+  while(leaves < assoc)
+    leaves <<= 1;
+
+  return leaves;
+}
+
+static void plru_init(cacheLevel* level, unsigned int set_index, unsigned int block_index)
+{
+  level->set[set_index].replacement = 0;
+}
+
+static void plru_update(cacheLevel* level, unsigned int set_index, unsigned int block_index)
+{
+  unsigned int* bits = &level->set[set_index].replacement;
+  unsigned int node = 1;
+  unsigned int low = 0;
+  unsigned int half;
+
+  for(half = plru_leaves(level->assoc) >> 1; half != 0; half >>= 1)
+  {
+    if(block_index < low + half)
+    {
+      *bits |= 1 << node;
+      node = 2 * node;
+    }
+    else
+    {
+      *bits &= ~(1 << node);
+      node = 2 * node + 1;
+      low += half;
+    }
+  }
+}
+
+static unsigned int plru_victim(cacheLevel* level, unsigned int set_index)
+{
+  unsigned int bits = level->set[set_index].replacement;
+  unsigned int node = 1;
+  unsigned int low = 0;
+  unsigned int half;
+
+  for(half = plru_leaves(level->assoc) >> 1; half != 0; half >>= 1)
+  {
+    if(((bits >> node) & 1) && low + half < level->assoc)
+    {
+      node = 2 * node + 1;
+      low += half;
+    }
+    else
+      node = 2 * node;
+  }
+
+  return low;
+}
+
+/******************************************************************************
+   SRRIP / BRRIP -- static and bimodal re-reference interval prediction.
+   lru.value holds each block's re-reference prediction value (RRPV): 0 on a
+   hit, RRPV_MAX - 1 on a fill for SRRIP, and usually RRPV_MAX for BRRIP so
+   that scans do not flush the set.  The victim is a block predicted for the
+   distant future (RRPV_MAX); if there is none every block is aged.
+ *****************************************************************************/
+
+static void rrip_init(cacheLevel* level, unsigned int set_index, unsigned int block_index)
+{
+  level->set[set_index].replacement = 0;
+  level->set[set_index].block[block_index].lru.value = RRPV_MAX;
+}
+
+static void rrip_hit(cacheLevel* level, unsigned int set_index, unsigned int block_index)
+{
+  level->set[set_index].block[block_index].lru.value = 0;
+}
+
+static void srrip_fill(cacheLevel* level, unsigned int set_index, unsigned int block_index)
+{
+  level->set[set_index].block[block_index].lru.value = RRPV_MAX - 1;
+}
+
+static void brrip_fill(cacheLevel* level, unsigned int set_index, unsigned int block_index)
+{
+  if(randomint_r(&level->hierarchy->random_state, BRRIP_LONG_INTERVAL) == 0)
+    level->set[set_index].block[block_index].lru.value = RRPV_MAX - 1;
+  else
+    level->set[set_index].block[block_index].lru.value = RRPV_MAX;
+}
+
+static unsigned int rrip_victim(cacheLevel* level, unsigned int set_index)
+{
+  cacheSet* set = &level->set[set_index];
+  unsigned int i;
+
+  for(;;)
+  {
+    for(i = 0; i < level->assoc; i++)
+    {
+      if(set->block[i].lru.value >= RRPV_MAX)
+	return i;
+    }
+
+    for(i = 0; i < level->assoc; i++)
+      set->block[i].lru.value++;
+  }
+}
+
+/******************************************************************************
+   FIFO -- a round-robin pointer per set, kept in the replacement field
+ *****************************************************************************/
+
+static void fifo_init(cacheLevel* level, unsigned int set_index, unsigned int block_index)
+{
+  level->set[set_index].replacement = 0;
+}
+
+static void fifo_update(cacheLevel* level, unsigned int set_index, unsigned int block_index)
+{
+}
+
+static unsigned int fifo_victim(cacheLevel* level, unsigned int set_index)
+{
+  unsigned int* next = &level->set[set_index].replacement;
+  unsigned int victim = *next % level->assoc;
+
+  *next = (victim + 1) % level->assoc;
+  return victim;
+}
+
+/* Indexed by ReplacementPolicy */
+const ReplacementPolicyHooks replacement_policies[REPLACEMENT_POLICY_COUNT] = {
+  { "Random", "r",     random_init, random_update, random_update, random_victim },
+  { "LRU",    "lru",   lru_init,    lru_update,    lru_update,    lru_victim },
+  { "LFU",    "lfu",   lfu_init,    lfu_hit,       lfu_fill,      lfu_victim },
+  { "PLRU",   "plru",  plru_init,   plru_update,   plru_update,   plru_victim },
+  { "SRRIP",  "srrip", rrip_init,   rrip_hit,      srrip_fill,    rrip_victim },
+  { "BRRIP",  "brrip", rrip_init,   rrip_hit,      brrip_fill,    rrip_victim },
+  { "FIFO",   "fifo",  fifo_init,   fifo_update,   fifo_update,   fifo_victim }
+};
+
+/*
+  Looks up a policy by the name used in the config command
+
+  returns the policy, or -1 if there is none with that name
+ */
+int find_replacement_policy(const char* command)
+{
+  int p;
+
+  for(p = 0; p < REPLACEMENT_POLICY_COUNT; p++)
+  {
+    if(strcmp(command, replacement_policies[p].command) == 0)
+      return p;
+  }
+
+  return -1;
+}
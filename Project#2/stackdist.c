@@ -0,0 +1,436 @@
+#include "tips.h"
+
+/******************************************************************************
+   LRU stack distance analysis
+
+   Mattson's observation: an access hits in an LRU cache of N blocks exactly
+   when fewer than N other blocks were touched since the previous access to
+   the same block (its stack distance).  One pass that histograms the stack
+   distances therefore gives the hit ratio of every cache size at once.  For
+   a cache with S sets the distance only counts blocks of the same set, and an
+   A-way cache hits when that distance is below A.
+
+   The distance of an access is the number of distinct blocks whose last
+   access is more recent than this block's.  Every block keeps only its last
+   access time, in an order statistic treap per set (and per set count), so
+   the count is O(log n).  Since time only grows, a block's new time is always
+   the largest key and is merged in at the right edge.
+ *****************************************************************************/
+
+/* Set counts analysed: 1, 2, 4, ... MAX_LEVEL_SETS */
+#define SD_SET_COUNTS 15
+
+/* Distances tracked per set count for set-associative caches; deeper ones
+   miss in any cache with at most MAX_ASSOC ways */
+#define SD_ASSOC_DISTANCES MAX_ASSOC
+
+typedef struct {
+  unsigned long long key;    /* time of the last access to the block */
+  unsigned int priority;
+  int left;
+  int right;
+  unsigned int size;          /* nodes in the subtree */
+} treapNode;
+
+typedef struct {
+  address block;
+  unsigned long long time;
+  int used;
+} lastAccess;
+
+int stack_distance_active;
+
+static unsigned int sd_block_size;
+static unsigned int sd_offset_bits;
+static AccessType sd_filter;
+static int sd_filter_active;
+
+static unsigned long long sd_time;
+static unsigned long long sd_accesses;
+static unsigned long long sd_cold;
+
+/* hash table of the last access time of every block seen */
+static lastAccess* last_access;
+static unsigned int last_access_capacity;
+static unsigned int last_access_count;
+
+/* treap nodes, SD_SET_COUNTS per block */
+static treapNode* nodes;
+static unsigned int node_count;
+static unsigned int node_capacity;
+static int* roots[SD_SET_COUNTS];
+static unsigned int priority_seed = 2463534242u;
+
+/* histograms: full distances for 1 set, capped ones for more sets */
+static unsigned long long* full_histogram;
+static unsigned int full_histogram_size;
+static unsigned long long assoc_histogram[SD_SET_COUNTS][SD_ASSOC_DISTANCES];
+
+/******************************************************************************
+   Order statistic treap
+ *****************************************************************************/
+
+#define NODE_SIZE(n) ((n) < 0 ? 0 : nodes[n].size)
+
+static unsigned int next_priority(void)
+{
+  priority_seed ^= priority_seed << 13;
+  priority_seed ^= priority_seed >> 17;
+  priority_seed ^= priority_seed << 5;
+  return priority_seed;
+}
+
+static void update_size(int n)
+{
+  nodes[n].size = 1 + NODE_SIZE(nodes[n].left) + NODE_SIZE(nodes[n].right);
+}
+
+/* splits t into the keys below key and the keys at or above it */
+static void treap_split(int t, unsigned long long key, int* below, int* above)
+{
+  if(t < 0)
+  {
+    *below = *above = -1;
+    return;
+  }
+
+  if(nodes[t].key < key)
+  {
+    treap_split(nodes[t].right, key, &nodes[t].right, above);
+    *below = t;
+  }
+  else
+  {
+    treap_split(nodes[t].left, key, below, &nodes[t].left);
+    *above = t;
+  }
+  update_size(t);
+}
+
+/* joins two treaps where every key of a is below every key of b */
+static int treap_merge(int a, int b)
+{
+  if(a < 0)
+    return b;
+  if(b < 0)
+    return a;
+
+  if(nodes[a].priority > nodes[b].priority)
+  {
+    nodes[a].right = treap_merge(nodes[a].right, b);
+    update_size(a);
+    return a;
+  }
+
+  nodes[b].left = treap_merge(a, nodes[b].left);
+  update_size(b);
+  return b;
+}
+
+static int new_node(void)
+{
+  treapNode* grown;
+
+  if(node_count == node_capacity)
+  {
+    grown = (treapNode*)realloc(nodes, (node_capacity ? 2 * node_capacity : 1024) * sizeof(treapNode));
+    if(grown == NULL)
+      return -1;
+    nodes = grown;
+    node_capacity = node_capacity ? 2 * node_capacity : 1024;
+  }
+
+  nodes[node_count].priority = next_priority();
+  return node_count++;
+}
+
+/* gives node n the key time and makes it the newest key of the treap */
+static void treap_push(int* root, int n, unsigned long long time)
+{
+  nodes[n].key = time;
+  nodes[n].left = -1;
+  nodes[n].right = -1;
+  nodes[n].size = 1;
+  *root = treap_merge(*root, n);
+}
+
+/*
+  Takes the node with key time out of the treap
+
+  returns the node, and through distance the number of newer keys
+*/
+static int treap_take(int* root, unsigned long long time, unsigned int* distance)
+{
+  int below, rest, node, newer;
+
+  treap_split(*root, time, &below, &rest);
+  treap_split(rest, time + 1, &node, &newer);
+  *distance = NODE_SIZE(newer);
+  *root = treap_merge(below, newer);
+  return node;
+}
+
+/******************************************************************************
+   Last access table
+ *****************************************************************************/
+
+static unsigned int hash_block(address block)
+{
+  return (block * 2654435761u) & (last_access_capacity - 1);
+}
+
+static lastAccess* find_last_access(address block)
+{
+  unsigned int i = hash_block(block);
+
+  while(last_access[i].used && last_access[i].block != block)
+    i = (i + 1) & (last_access_capacity - 1);
+
+  return &last_access[i];
+}
+
+static int grow_last_access(void)
+{
+  lastAccess* old = last_access;
+  unsigned int old_capacity = last_access_capacity;
+  unsigned int i;
+
+  last_access_capacity = old_capacity ? 2 * old_capacity : 4096;
+  if((last_access = (lastAccess*)calloc(last_access_capacity, sizeof(lastAccess))) == NULL)
+  {
+    last_access = old;
+    last_access_capacity = old_capacity;
+    return -1;
+  }
+
+  for(i = 0; i < old_capacity; i++)
+  {
+    if(old[i].used)
+      *find_last_access(old[i].block) = old[i];
+  }
+
+  free(old);
+  return 0;
+}
+
+/******************************************************************************
+   Analysis
+ *****************************************************************************/
+
+static void free_stack_distance(void)
+{
+  int s;
+
+  free(last_access);
+  free(nodes);
+  free(full_histogram);
+  for(s = 0; s < SD_SET_COUNTS; s++)
+  {
+    free(roots[s]);
+    roots[s] = NULL;
+  }
+
+  last_access = NULL;
+  last_access_capacity = 0;
+  last_access_count = 0;
+  nodes = NULL;
+  node_count = 0;
+  node_capacity = 0;
+  full_histogram = NULL;
+  full_histogram_size = 0;
+}
+
+/*
+  Starts a new analysis, dropping the previous one
+
+    block_size_value - block size shared by every cache analysed
+    filter - only accesses of this type are analysed if filter_active
+
+  returns 0 if successful, non-zero if memory could not be allocated.
+*/
+int start_stack_distance(unsigned int block_size_value, AccessType filter, int filter_active)
+{
+  int s;
+
+  free_stack_distance();
+  memset(assoc_histogram, 0, sizeof(assoc_histogram));
+  sd_time = 0;
+  sd_accesses = 0;
+  sd_cold = 0;
+
+  sd_block_size = block_size_value;
+  sd_offset_bits = 0;
+  while((1u << sd_offset_bits) < block_size_value)
+    sd_offset_bits++;
+  sd_filter = filter;
+  sd_filter_active = filter_active;
+
+  for(s = 0; s < SD_SET_COUNTS; s++)
+  {
+    if((roots[s] = (int*)malloc((1 << s) * sizeof(int))) == NULL)
+    {
+      free_stack_distance();
+      return -1;
+    }
+    memset(roots[s], 0xff, (1 << s) * sizeof(int));
+  }
+
+  if(grow_last_access() != 0)
+  {
+    free_stack_distance();
+    return -1;
+  }
+
+  stack_distance_active = 1;
+  return 0;
+}
+
+void stop_stack_distance(void)
+{
+  stack_distance_active = 0;
+}
+
+static void count_full_distance(unsigned int distance)
+{
+  unsigned long long* grown;
+  unsigned int size;
+
+  if(distance >= full_histogram_size)
+  {
+    size = full_histogram_size ? full_histogram_size : 1024;
+    while(size <= distance)
+      size *= 2;
+    if((grown = (unsigned long long*)realloc(full_histogram, size * sizeof(unsigned long long))) == NULL)
+      return;
+    memset(grown + full_histogram_size, 0, (size - full_histogram_size) * sizeof(unsigned long long));
+    full_histogram = grown;
+    full_histogram_size = size;
+  }
+
+  full_histogram[distance]++;
+}
+
+/* Called by accessCache() for every access while the analysis is active */
+void record_stack_distance(address addr, AccessType type)
+{
+  address block;
+  lastAccess* entry;
+  unsigned int distance;
+  unsigned int set;
+  int s;
+  int n;
+
+  if(sd_filter_active && type != sd_filter)
+    return;
+
+  block = addr >> sd_offset_bits;
+  sd_time++;
+  sd_accesses++;
+
+  if(2 * (last_access_count + 1) > last_access_capacity && grow_last_access() != 0)
+  {
+    stop_stack_distance();
+    return;
+  }
+
+  entry = find_last_access(block);
+  if(!entry->used)
+  {
+    /* first touch: a miss at every size */
+    if(node_capacity - node_count < SD_SET_COUNTS)
+    {
+      for(s = 0; s < SD_SET_COUNTS; s++)
+      {
+	if(new_node() < 0)
+	{
+	  stop_stack_distance();
+	  return;
+	}
+      }
+      node_count -= SD_SET_COUNTS;
+    }
+
+    entry->used = 1;
+    entry->block = block;
+    last_access_count++;
+    sd_cold++;
+    for(s = 0; s < SD_SET_COUNTS; s++)
+    {
+      set = block & ((1 << s) - 1);
+      treap_push(&roots[s][set], new_node(), sd_time);
+    }
+  }
+  else
+  {
+    for(s = 0; s < SD_SET_COUNTS; s++)
+    {
+      set = block & ((1 << s) - 1);
+      n = treap_take(&roots[s][set], entry->time, &distance);
+      treap_push(&roots[s][set], n, sd_time);
+
+      if(s == 0)
+	count_full_distance(distance);
+      if(distance < SD_ASSOC_DISTANCES)
+	assoc_histogram[s][distance]++;
+    }
+  }
+
+  entry->time = sd_time;
+}
+
+/* misses of a cache with 2^s sets of ways blocks, according to the histograms */
+static unsigned long long stack_distance_misses(int s, unsigned int ways)
+{
+  unsigned long long hits = 0;
+  unsigned int d;
+
+  if(s == 0)
+  {
+    for(d = 0; d < ways && d < full_histogram_size; d++)
+      hits += full_histogram[d];
+  }
+  else
+  {
+    for(d = 0; d < ways && d < SD_ASSOC_DISTANCES; d++)
+      hits += assoc_histogram[s][d];
+  }
+
+  return sd_accesses - hits;
+}
+
+/* Prints the miss ratio curves of the analysis so far */
+void report_stack_distance(FILE* out)
+{
+  unsigned int blocks;
+  unsigned int ways;
+  int s;
+
+  if(sd_accesses == 0)
+  {
+    fprintf(out, "No accesses analysed\n");
+    return;
+  }
+
+  fprintf(out, "Stack distance analysis: %u byte blocks, %llu accesses, %llu distinct blocks (compulsory misses)\n",
+	  sd_block_size, sd_accesses, sd_cold);
+
+  fprintf(out, "\nFully associative LRU\n   Blocks      Bytes  Miss Ratio\n");
+  for(blocks = 1; ; blocks *= 2)
+  {
+    fprintf(out, "%9u  %9u  %10.4f\n", blocks, blocks * sd_block_size, (double)stack_distance_misses(0, blocks) / sd_accesses);
+    if(blocks >= last_access_count)
+      break;
+  }
+
+  fprintf(out, "\nSet-associative LRU miss ratio (cache size in bytes)\n   Sets");
+  for(ways = 1; ways <= MAX_ASSOC; ways *= 2)
+    fprintf(out, "  %8u-way        ", ways);
+  fprintf(out, "\n");
+  for(s = 0; s < SD_SET_COUNTS; s++)
+  {
+    fprintf(out, "%7u", 1 << s);
+    for(ways = 1; ways <= MAX_ASSOC; ways *= 2)
+      fprintf(out, "  %6.4f (%9u)", (double)stack_distance_misses(s, ways) / sd_accesses, (1 << s) * ways * sd_block_size);
+    fprintf(out, "\n");
+  }
+}
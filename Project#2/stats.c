@@ -0,0 +1,274 @@
+#include "tips.h"
+
+/******************************************************************************
+   Cache statistics
+
+   The counters themselves are kept by the cache logic in each level, set and
+   hierarchy (see cachelogic.c) and cleared by a flush; this file only turns
+   them into reports.  The average memory access time of a level is its hit
+   latency plus its measured miss rate times the average access time of the
+   level below, ending with the DRAM latency, or with the average latency of
+   the DRAM reads when DRAM is timed (see dram.c).  Misses are also broken down
+   into the three Cs when the hierarchy classifies them (see missclass.c).
+
+   The levels with a prefetcher also report its accuracy, the share of its
+   prefetches that were used, its coverage, the share of would-be misses its
+   prefetches removed, and its lead, the accesses between a prefetch and the
+   use of the block.  The levels with a victim cache or a write buffer (see
+   buffers.c) report their hits, drains and merges, and sectored levels the
+   misses of blocks that were present without the sectors needed.
+ *****************************************************************************/
+
+const char* access_kind_name(AccessKind kind)
+{
+  switch(kind)
+  {
+  case IFETCH:
+    return "ifetch";
+  case LOAD:
+    return "load";
+  case STORE:
+    return "store";
+  default:
+    return "unknown";
+  }
+}
+
+static double miss_rate(unsigned long long hits, unsigned long long misses)
+{
+  return (hits + misses == 0) ? 0.0 : (double)misses / (hits + misses);
+}
+
+/* Average cycles of an access entering a hierarchy at level (NULL is DRAM);
+   misses its victim cache serves do not go further down */
+double level_amat(const cacheHierarchy* h, const cacheLevel* level)
+{
+  unsigned long long accesses;
+
+  if(level == NULL)
+    return dram_read_latency(h);
+
+  accesses = level->hits + level->misses;
+  if(accesses == 0)
+    return level->latency;
+  return level->latency + ((double)level->victim_hits * VICTIM_CACHE_LATENCY +
+			   (double)(level->misses - level->victim_hits) * level_amat(h, level->next)) / accesses;
+}
+
+/* Average cycles of the accesses of kinds [first, last] entering a hierarchy
+   at level: its latency, plus their own miss rate there times the average
+   cost of a miss of the level */
+static double kind_amat(const cacheHierarchy* h, const cacheLevel* level, AccessKind first, AccessKind last)
+{
+  unsigned long long hits = 0;
+  unsigned long long misses = 0;
+  double miss_cycles;
+  int kind;
+
+  if(level == NULL)
+    return level_amat(h, NULL);
+
+  for(kind = first; kind <= last; kind++)
+  {
+    hits += level->kind_hits[kind];
+    misses += level->kind_misses[kind];
+  }
+  if(level->misses == 0)
+    return level->latency + miss_rate(hits, misses) * level_amat(h, level->next);
+
+  miss_cycles = ((double)level->victim_hits * VICTIM_CACHE_LATENCY +
+		 (double)(level->misses - level->victim_hits) * level_amat(h, level->next)) / level->misses;
+  return level->latency + miss_rate(hits, misses) * miss_cycles;
+}
+
+/* Prints the counters of every level, the DRAM traffic and the AMAT */
+void report_stats(const cacheHierarchy* h, FILE* out)
+{
+  const cacheLevel* level;
+  unsigned long long instructions = h->accesses[IFETCH];
+  unsigned long long data = h->accesses[LOAD] + h->accesses[STORE];
+  double instruction_amat = kind_amat(h, h->instruction_cache, IFETCH, IFETCH);
+  double data_amat = kind_amat(h, h->data_cache, LOAD, STORE);
+  unsigned long long requests;
+  int id;
+  int kind;
+
+  fprintf(out, "Accesses: %llu ifetch, %llu load, %llu store\n", h->accesses[IFETCH], h->accesses[LOAD], h->accesses[STORE]);
+
+  fprintf(out, "\nLevel  Kind         Hits     Misses  Miss Rate\n");
+  for(id = L1I; id < LEVEL_COUNT; id++)
+  {
+    level = &h->level[id];
+    if(!LEVEL_ENABLED(level))
+      continue;
+
+    for(kind = IFETCH; kind < ACCESS_KIND_COUNT; kind++)
+      fprintf(out, "%-5s  %-6s  %9llu  %9llu  %8.2f%%\n", (kind == IFETCH ? level->name : ""), access_kind_name(kind),
+	      level->kind_hits[kind], level->kind_misses[kind], 100.0 * miss_rate(level->kind_hits[kind], level->kind_misses[kind]));
+    fprintf(out, "%-5s  %-6s  %9llu  %9llu  %8.2f%%\n", "", "total", level->hits, level->misses, 100.0 * miss_rate(level->hits, level->misses));
+  }
+
+  fprintf(out, "\nLevel  Evictions  Write-backs  Write-throughs  Back-inval  Latency       AMAT\n");
+  for(id = L1I; id < LEVEL_COUNT; id++)
+  {
+    level = &h->level[id];
+    if(LEVEL_ENABLED(level))
+      fprintf(out, "%-5s  %9llu  %11llu  %14llu  %10llu  %7u  %9.2f\n", level->name, level->evictions, level->write_backs,
+	      level->write_throughs, level->back_invalidations, level->latency, level_amat(h, level));
+  }
+  if(h->dram_timing == NULL)
+    fprintf(out, "%-5s  %9s  %11s  %14s  %10s  %7u  %9.2f\n", "DRAM", "", "", "", "", h->dram_latency, level_amat(h, NULL));
+  else
+    fprintf(out, "%-5s  %9s  %11s  %14s  %10s  %7s  %9.2f\n", "DRAM", "", "", "", "", "timed", level_amat(h, NULL));
+
+  for(id = L1I; id < LEVEL_COUNT; id++)
+  {
+    if(LEVEL_ENABLED(&h->level[id]) && SECTOR_SIZE(&h->level[id]) < h->level[id].block_size)
+      break;
+  }
+  if(id < LEVEL_COUNT)
+  {
+    fprintf(out, "\nLevel  Sector  Sector Misses\n");
+    for(id = L1I; id < LEVEL_COUNT; id++)
+    {
+      level = &h->level[id];
+      if(LEVEL_ENABLED(level) && SECTOR_SIZE(level) < level->block_size)
+	fprintf(out, "%-5s  %6u  %13llu\n", level->name, SECTOR_SIZE(level), level->sector_misses);
+    }
+  }
+
+  if(h->classify_misses)
+  {
+    fprintf(out, "\nLevel");
+    for(kind = COMPULSORY; kind < MISS_CLASS_COUNT; kind++)
+      fprintf(out, "  %-20s", miss_class_name(kind));
+    fprintf(out, "\n");
+    for(id = L1I; id < LEVEL_COUNT; id++)
+    {
+      level = &h->level[id];
+      if(!LEVEL_ENABLED(level))
+	continue;
+
+      fprintf(out, "%-5s", level->name);
+      for(kind = COMPULSORY; kind < MISS_CLASS_COUNT; kind++)
+	fprintf(out, "  %9llu (%6.2f%%)", level->miss_classes[kind],
+		(level->misses == 0 ? 0.0 : 100.0 * level->miss_classes[kind] / level->misses));
+      fprintf(out, "\n");
+    }
+  }
+
+  for(id = L1I; id < LEVEL_COUNT; id++)
+  {
+    if(LEVEL_ENABLED(&h->level[id]) && h->level[id].prefetch.kind != PREFETCH_NONE)
+      break;
+  }
+  if(id < LEVEL_COUNT)
+  {
+    fprintf(out, "\nLevel  Prefetcher   Issued     Useful       Late    Useless  Accuracy  Coverage  Avg Lead\n");
+    for(id = L1I; id < LEVEL_COUNT; id++)
+    {
+      level = &h->level[id];
+      if(!LEVEL_ENABLED(level) || level->prefetch.kind == PREFETCH_NONE)
+	continue;
+
+      fprintf(out, "%-5s  %-9s  %8llu  %9llu  %9llu  %9llu  %7.2f%%  %7.2f%%  %8.1f\n", level->name, prefetcher_name(level->prefetch.kind),
+	      level->prefetches, level->useful_prefetches, level->late_prefetches, level->useless_prefetches,
+	      100.0 * (level->prefetches == 0 ? 0.0 : (double)level->useful_prefetches / level->prefetches),
+	      100.0 * miss_rate(level->misses, level->useful_prefetches),
+	      (level->useful_prefetches == 0 ? 0.0 : (double)level->prefetch_lead / level->useful_prefetches));
+    }
+  }
+
+  for(id = L1I; id < LEVEL_COUNT; id++)
+  {
+    if(h->level[id].victim != NULL || h->level[id].write_buffer != NULL)
+      break;
+  }
+  if(id < LEVEL_COUNT)
+  {
+    fprintf(out, "\nLevel  Victim Hits  Victim Evictions  Buffered Writes     Merged     Drains  Full Drains  Read Drains  Pending\n");
+    for(id = L1I; id < LEVEL_COUNT; id++)
+    {
+      level = &h->level[id];
+      if(level->victim == NULL && level->write_buffer == NULL)
+	continue;
+
+      fprintf(out, "%-5s  %11llu  %16llu  %15llu  %9llu  %9llu  %11llu  %11llu  %7u\n", level->name, level->victim_hits,
+	      level->victim_evictions, level->buffered_writes, level->merged_writes, level->write_buffer_drains,
+	      level->full_drains, level->read_drains, level->write_buffer_count);
+    }
+  }
+
+  fprintf(out, "\nDRAM traffic: %llu bytes read in %llu transfers, %llu bytes written in %llu transfers\n",
+	  h->dram_reads, h->dram_read_transfers, h->dram_writes, h->dram_write_transfers);
+  if(h->dram_timing != NULL)
+  {
+    requests = h->dram_row_hits + h->dram_row_misses + h->dram_row_conflicts;
+    fprintf(out, "DRAM rows: %llu hits, %llu misses, %llu conflicts (%.2f%% hit rate), %llu requests reordered\n",
+	    h->dram_row_hits, h->dram_row_misses, h->dram_row_conflicts,
+	    (requests == 0 ? 0.0 : 100.0 * h->dram_row_hits / requests), h->dram_reordered);
+    fprintf(out, "DRAM reads: %llu cycles, %.2f per read\n", h->dram_read_cycles, dram_read_latency(h));
+  }
+  fprintf(out, "AMAT: %.2f cycles per instruction fetch, %.2f per load/store, %.2f overall\n", instruction_amat, data_amat,
+	  (instructions + data == 0) ? 0.0 : (instructions * instruction_amat + data * data_amat) / (instructions + data));
+}
+
+/* Prints the cycles of the pipeline, its stalls and the MSHRs of the levels
+   accesses enter the hierarchy at, in cycle mode */
+void report_timing(const cacheHierarchy* h, FILE* out)
+{
+  const cacheLevel* entries[2] = { h->instruction_cache, h->data_cache };
+  const cacheLevel* level;
+  unsigned long long cycles = h->cycle - pipeline.start;
+  int i;
+
+  if(!h->timed)
+  {
+    fprintf(out, "Cycle mode is off\n");
+    return;
+  }
+
+  fprintf(out, "Cycles: %llu for %llu instructions, CPI %.2f\n", cycles, pipeline.instructions,
+	  (pipeline.instructions == 0 ? 0.0 : (double)cycles / pipeline.instructions));
+  fprintf(out, "Stall cycles: %llu fetch, %llu load-use, %llu waiting for the cache to accept a load or store\n",
+	  pipeline.fetch_stalls, pipeline.load_use_stalls, pipeline.memory_stalls);
+
+  fprintf(out, "\nLevel  MSHRs  Hits Under Miss  Misses Under Miss     Merged  Full Stalls  Stall Cycles\n");
+  for(i = 0; i < 2; i++)
+  {
+    level = entries[i];
+    if(level == NULL || (i == 1 && level == entries[0]))
+      continue;
+
+    fprintf(out, "%-5s  %5u  %15llu  %17llu  %9llu  %11llu  %12llu\n", level->name, level->mshrs, level->hits_under_miss,
+	    level->misses_under_miss, level->mshr_merges, level->mshr_full_stalls, level->mshr_stall_cycles);
+  }
+}
+
+/* Prints the hits and misses of each set of a level, and their classes */
+void report_set_stats(const cacheLevel* level, FILE* out)
+{
+  const cacheSet* set;
+  unsigned int i;
+
+  if(!LEVEL_ENABLED(level))
+  {
+    fprintf(out, "%s is not configured\n", level->name);
+    return;
+  }
+
+  fprintf(out, "%s    Set       Hits     Misses  Miss Rate", level->name);
+  if(level->hierarchy->classify_misses)
+    fprintf(out, "  Compulsory   Capacity   Conflict");
+  fprintf(out, "\n");
+
+  for(i = 0; i < level->set_count; i++)
+  {
+    set = &level->set[i];
+    fprintf(out, "%*s  %5u  %9llu  %9llu  %8.2f%%", (int)strlen(level->name), "", i, set->hits, set->misses,
+	    100.0 * miss_rate(set->hits, set->misses));
+    if(level->hierarchy->classify_misses)
+      fprintf(out, "  %10llu  %9llu  %9llu", set->miss_classes[COMPULSORY], set->miss_classes[CAPACITY], set->miss_classes[CONFLICT]);
+    fprintf(out, "\n");
+  }
+}
@@ -0,0 +1,383 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <unistd.h>
+#include "tips.h"
+
+/******************************************************************************
+   Design space sweep
+
+   The accesses of the simulated CPU are recorded once, then replayed against
+   one cache hierarchy per configuration of the L1 data (or unified) cache.
+   The other levels of each instance are copied from the CPU's hierarchy, so
+   the sweep shows the L1 choices on top of the current L2/L3.  Instances
+   share no state, and only count DRAM traffic instead of moving data, so the
+   configurations run in parallel.
+
+   The configurations are spread over a pool of threads in contiguous ranges;
+   a thread that runs out of work steals the upper half of the largest range
+   left, which evens out configurations of very different cost (a flush of
+   16384 sets against one of a single set).
+ *****************************************************************************/
+
+typedef struct {
+  address addr;
+  unsigned char we;
+  unsigned char type;
+} sweepAccess;
+
+typedef struct {
+  unsigned int set_count;
+  unsigned int assoc;
+  unsigned int block_size;
+  ReplacementPolicy policy;
+  MemorySyncPolicy memory_sync_policy;
+  unsigned long long hits;
+  unsigned long long misses;
+  unsigned long long write_backs;
+  unsigned long long dram_reads;
+  unsigned long long dram_writes;
+  int failed;
+} sweepResult;
+
+typedef struct {
+  pthread_mutex_t lock;
+  unsigned int next;                /* first configuration left */
+  unsigned int end;                 /* one past the last configuration left */
+} sweepQueue;
+
+typedef struct {
+  pthread_t thread;
+  unsigned int id;
+  int started;                      /* the thread was created */
+} sweepWorker;
+
+int sweep_recording;
+
+static sweepAccess* sweep_accesses;
+static unsigned long long sweep_access_count;
+static unsigned long long sweep_access_capacity;
+
+static sweepResult* sweep_results;
+static sweepQueue* sweep_queues;
+static unsigned int sweep_thread_count;
+
+/* Drops any previous recording and records the accesses that follow */
+void start_sweep_recording(void)
+{
+  free(sweep_accesses);
+  sweep_accesses = NULL;
+  sweep_access_count = 0;
+  sweep_access_capacity = 0;
+  sweep_recording = 1;
+}
+
+void stop_sweep_recording(void)
+{
+  sweep_recording = 0;
+}
+
+unsigned long long sweep_recorded_accesses(void)
+{
+  return sweep_access_count;
+}
+
+/* Called by accessCache() for every access while recording */
+void record_sweep_access(address addr, WriteEnable we, AccessType type)
+{
+  sweepAccess* grown;
+  unsigned long long capacity;
+
+  if(sweep_access_count == sweep_access_capacity)
+  {
+    capacity = sweep_access_capacity ? 2 * sweep_access_capacity : 65536;
+    if((grown = (sweepAccess*)realloc(sweep_accesses, capacity * sizeof(sweepAccess))) == NULL)
+    {
+      append_log("Out of memory; sweep recording stopped\n");
+      stop_sweep_recording();
+      return;
+    }
+    sweep_accesses = grown;
+    sweep_access_capacity = capacity;
+  }
+
+  sweep_accesses[sweep_access_count].addr = addr;
+  sweep_accesses[sweep_access_count].we = we;
+  sweep_accesses[sweep_access_count].type = type;
+  sweep_access_count++;
+}
+
+/* Runs the recorded accesses against one configuration */
+static void run_configuration(cacheHierarchy* h, sweepResult* result)
+{
+  cacheLevel* level = &h->level[L1D];
+  unsigned long long i;
+  word data;
+
+  if(configure_hierarchy_level(h, L1D, result->set_count, result->assoc, result->block_size,
+			       result->policy, result->memory_sync_policy, NON_INCLUSIVE) != 0)
+  {
+    result->failed = 1;
+    return;
+  }
+
+  /* same random numbers whichever thread runs the configuration */
+  h->random_state = 1;
+
+  for(i = 0; i < sweep_access_count; i++)
+  {
+    data = 0;
+    access_hierarchy(h, 0, sweep_accesses[i].addr, &data, sweep_accesses[i].we, sweep_accesses[i].type);
+  }
+
+  result->hits = level->hits;
+  result->misses = level->misses;
+  result->write_backs = level->write_backs;
+  result->dram_reads = h->dram_reads;
+  result->dram_writes = h->dram_writes;
+}
+
+/* Takes the next configuration of a worker's own range, or -1 if it is empty */
+static int take_configuration(sweepQueue* queue)
+{
+  int job = -1;
+
+  pthread_mutex_lock(&queue->lock);
+  if(queue->next < queue->end)
+    job = queue->next++;
+  pthread_mutex_unlock(&queue->lock);
+
+  return job;
+}
+
+/* Moves the upper half of the largest range left into thief's range */
+static int steal_configurations(unsigned int thief)
+{
+  unsigned int victim = thief;
+  unsigned int most = 0;
+  unsigned int left;
+  unsigned int middle;
+  unsigned int end;
+  unsigned int i;
+
+  for(i = 0; i < sweep_thread_count; i++)
+  {
+    if(i == thief)
+      continue;
+    pthread_mutex_lock(&sweep_queues[i].lock);
+    left = sweep_queues[i].end - sweep_queues[i].next;
+    pthread_mutex_unlock(&sweep_queues[i].lock);
+    if(left > most)
+    {
+      most = left;
+      victim = i;
+    }
+  }
+  if(victim == thief)
+    return -1;
+
+  pthread_mutex_lock(&sweep_queues[victim].lock);
+  left = sweep_queues[victim].end - sweep_queues[victim].next;
+  if(left == 0)
+  {
+    pthread_mutex_unlock(&sweep_queues[victim].lock);
+    return 0;
+  }
+  end = sweep_queues[victim].end;
+  middle = sweep_queues[victim].next + left / 2;
+  sweep_queues[victim].end = middle;
+  pthread_mutex_unlock(&sweep_queues[victim].lock);
+
+  pthread_mutex_lock(&sweep_queues[thief].lock);
+  sweep_queues[thief].next = middle;
+  sweep_queues[thief].end = end;
+  pthread_mutex_unlock(&sweep_queues[thief].lock);
+  return 0;
+}
+
+static void* sweep_worker(void* arg)
+{
+  sweepWorker* worker = (sweepWorker*)arg;
+  cacheHierarchy h;
+  int job;
+
+  /* the L1D level is replaced by each configuration */
+  memset(&h, 0, sizeof(h));
+  copy_hierarchy_config(&h, &memory_hierarchy);
+  h.classify_misses = 0;
+  h.profile_pcs = 0;
+
+  for(;;)
+  {
+    while((job = take_configuration(&sweep_queues[worker->id])) >= 0)
+      run_configuration(&h, &sweep_results[job]);
+
+    if(steal_configurations(worker->id) != 0)
+      break;
+  }
+
+  free_hierarchy(&h);
+  return NULL;
+}
+
+static unsigned int count_options(unsigned int mask)
+{
+  unsigned int count = 0;
+
+  while(mask)
+  {
+    count += mask & 1;
+    mask >>= 1;
+  }
+
+  return count;
+}
+
+static void print_results(FILE* out, unsigned int count, int json)
+{
+  sweepResult* r;
+  unsigned long long accesses;
+  const char* separator = "";
+  unsigned int i;
+
+  if(json)
+    fprintf(out, "[\n");
+  else
+    fprintf(out, "sets,assoc,block_size,size_bytes,replacement,sync,accesses,hits,misses,hit_rate,write_backs,dram_read_bytes,dram_write_bytes\n");
+
+  for(i = 0; i < count; i++)
+  {
+    r = &sweep_results[i];
+    if(r->failed)
+      continue;
+
+    accesses = r->hits + r->misses;
+    if(json)
+    {
+      fprintf(out, "%s  {\"sets\": %u, \"assoc\": %u, \"block_size\": %u, \"size_bytes\": %u, \"replacement\": \"%s\", \"sync\": \"%s\", "
+	      "\"accesses\": %llu, \"hits\": %llu, \"misses\": %llu, \"hit_rate\": %.6f, \"write_backs\": %llu, "
+	      "\"dram_read_bytes\": %llu, \"dram_write_bytes\": %llu}",
+	      separator, r->set_count, r->assoc, r->block_size, r->set_count * r->assoc * r->block_size,
+	      replacement_policies[r->policy].command, (r->memory_sync_policy == WRITE_BACK ? "wb" : "wt"),
+	      accesses, r->hits, r->misses, (accesses == 0 ? 0.0 : (double)r->hits / accesses), r->write_backs,
+	      r->dram_reads, r->dram_writes);
+      separator = ",\n";
+    }
+    else
+      fprintf(out, "%u,%u,%u,%u,%s,%s,%llu,%llu,%llu,%.6f,%llu,%llu,%llu\n",
+	      r->set_count, r->assoc, r->block_size, r->set_count * r->assoc * r->block_size,
+	      replacement_policies[r->policy].command, (r->memory_sync_policy == WRITE_BACK ? "wb" : "wt"),
+	      accesses, r->hits, r->misses, (accesses == 0 ? 0.0 : (double)r->hits / accesses), r->write_backs,
+	      r->dram_reads, r->dram_writes);
+  }
+
+  if(json)
+    fprintf(out, "\n]\n");
+}
+
+/*
+  Replays the recorded accesses against every configuration of a space and
+  prints one line (CSV) or object (JSON) per configuration
+
+    space - the configurations; set counts, associativities and block sizes
+            run over the powers of two between their bounds
+    out - where the table is printed
+    json - non-zero for JSON, zero for CSV
+
+  returns the number of configurations run, or -1 on error
+*/
+int run_sweep(const sweepSpace* space, FILE* out, int json)
+{
+  sweepWorker* workers;
+  sweepResult* r;
+  unsigned int count;
+  unsigned int sets, ways, block;
+  unsigned int per_thread;
+  unsigned int started;
+  unsigned int i;
+  int p, m;
+
+  if(sweep_access_count == 0)
+    return -1;
+
+  count = 0;
+  for(sets = space->min_sets; sets <= space->max_sets; sets *= 2)
+    for(ways = space->min_assoc; ways <= space->max_assoc; ways *= 2)
+      for(block = space->min_block; block <= space->max_block; block *= 2)
+	count++;
+  count *= count_options(space->policies) * count_options(space->sync_policies);
+  if(count == 0)
+    return 0;
+
+  if((sweep_results = (sweepResult*)calloc(count, sizeof(sweepResult))) == NULL)
+    return -1;
+
+  r = sweep_results;
+  for(sets = space->min_sets; sets <= space->max_sets; sets *= 2)
+    for(ways = space->min_assoc; ways <= space->max_assoc; ways *= 2)
+      for(block = space->min_block; block <= space->max_block; block *= 2)
+	for(p = 0; p < REPLACEMENT_POLICY_COUNT; p++)
+	  for(m = WRITE_BACK; m <= WRITE_THROUGH; m++)
+	  {
+	    if(!(space->policies & (1 << p)) || !(space->sync_policies & (1 << m)))
+	      continue;
+	    r->set_count = sets;
+	    r->assoc = ways;
+	    r->block_size = block;
+	    r->policy = p;
+	    r->memory_sync_policy = m;
+	    r++;
+	  }
+
+  sweep_thread_count = space->threads > 0 ? space->threads : (unsigned int)sysconf(_SC_NPROCESSORS_ONLN);
+  if(sweep_thread_count < 1)
+    sweep_thread_count = 1;
+  if(sweep_thread_count > count)
+    sweep_thread_count = count;
+
+  workers = (sweepWorker*)malloc(sweep_thread_count * sizeof(sweepWorker));
+  sweep_queues = (sweepQueue*)malloc(sweep_thread_count * sizeof(sweepQueue));
+  if(workers == NULL || sweep_queues == NULL)
+  {
+    free(workers);
+    free(sweep_queues);
+    free(sweep_results);
+    return -1;
+  }
+
+  per_thread = (count + sweep_thread_count - 1) / sweep_thread_count;
+  for(i = 0; i < sweep_thread_count; i++)
+  {
+    pthread_mutex_init(&sweep_queues[i].lock, NULL);
+    sweep_queues[i].next = i * per_thread < count ? i * per_thread : count;
+    sweep_queues[i].end = (i + 1) * per_thread < count ? (i + 1) * per_thread : count;
+  }
+
+  started = 0;
+  for(i = 0; i < sweep_thread_count; i++)
+  {
+    workers[i].id = i;
+    workers[i].started = pthread_create(&workers[i].thread, NULL, sweep_worker, &workers[i]) == 0;
+    started += workers[i].started;
+  }
+
+  /* the workers that started steal the queues of those that did not; if
+     none did, this thread runs every configuration */
+  if(started == 0)
+    sweep_worker(&workers[0]);
+  for(i = 0; i < sweep_thread_count; i++)
+  {
+    if(workers[i].started)
+      pthread_join(workers[i].thread, NULL);
+  }
+
+  print_results(out, count, json);
+
+  for(i = 0; i < sweep_thread_count; i++)
+    pthread_mutex_destroy(&sweep_queues[i].lock);
+  free(workers);
+  free(sweep_queues);
+  free(sweep_results);
+  sweep_queues = NULL;
+  sweep_results = NULL;
+  return count;
+}
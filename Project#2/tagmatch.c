@@ -0,0 +1,108 @@
+#include "tips.h"
+
+/******************************************************************************
+   Tag matching
+
+   Every lookup compares one tag against all ways of a set.  Since the tags of
+   a set live in one contiguous array (with INVALID_TAG in invalid ways), the
+   comparison can be done 4 or 8 ways at a time with a vector compare, and the
+   matching way read back from the movemask.  Which implementation is used is
+   decided once at startup from CPUID; the scalar loop is kept for hosts
+   without SSE2/AVX2 and for compilers without the intrinsics.
+ *****************************************************************************/
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TAG_MATCH_X86
+#include <immintrin.h>
+#endif
+
+typedef int (*TagMatchFunction)(const unsigned int* tags, unsigned int tag, unsigned int ways);
+
+/* Mask of the lanes that belong to the first "ways" ways of a vector */
+#define WAY_MASK(ways) ((ways) >= 32 ? 0xffffffff : ((1u << (ways)) - 1))
+
+static int match_tag_scalar(const unsigned int* tags, unsigned int tag, unsigned int ways)
+{
+  unsigned int i;
+
+  for(i = 0; i < ways; i++)
+  {
+    if(tags[i] == tag)
+      return i;
+  }
+
+  return -1;
+}
+
+#ifdef TAG_MATCH_X86
+
+__attribute__((target("sse2")))
+static int match_tag_sse2(const unsigned int* tags, unsigned int tag, unsigned int ways)
+{
+  __m128i key = _mm_set1_epi32((int)tag);
+  unsigned int i;
+  unsigned int hits;
+
+  /* MAX_ASSOC is a multiple of 4, so whole vectors never leave the array */
+  for(i = 0; i < ways; i += 4)
+  {
+    hits = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(key, _mm_loadu_si128((const __m128i*)(tags + i)))));
+    hits &= WAY_MASK(ways - i);
+    if(hits)
+      return i + __builtin_ctz(hits);
+  }
+
+  return -1;
+}
+
+__attribute__((target("avx2")))
+static int match_tag_avx2(const unsigned int* tags, unsigned int tag, unsigned int ways)
+{
+  __m256i key = _mm256_set1_epi32((int)tag);
+  unsigned int i;
+  unsigned int hits;
+
+  /* MAX_ASSOC is a multiple of 8, so whole vectors never leave the array */
+  for(i = 0; i < ways; i += 8)
+  {
+    hits = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(key, _mm256_loadu_si256((const __m256i*)(tags + i)))));
+    hits &= WAY_MASK(ways - i);
+    if(hits)
+      return i + __builtin_ctz(hits);
+  }
+
+  return -1;
+}
+
+#endif
+
+static TagMatchFunction tag_match = match_tag_scalar;
+
+/*
+  Selects the fastest tag compare supported by the host CPU.  Called once by
+  init_memory() before any cache access.
+ */
+void init_tag_match(void)
+{
+#ifdef TAG_MATCH_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2"))
+    tag_match = match_tag_avx2;
+  else if(__builtin_cpu_supports("sse2"))
+    tag_match = match_tag_sse2;
+#endif
+}
+
+/*
+  Looks for a block with the given tag in a set
+
+    set - the set to search
+    tag - the tag bits of the address being accessed
+    ways - the number of blocks in use in the set (the associativity)
+
+  returns the index of the matching block, or -1 on a miss
+ */
+int match_tag(const cacheSet* set, unsigned int tag, unsigned int ways)
+{
+  return tag_match(set->tag, tag, ways);
+}
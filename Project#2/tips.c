@@ -5,45 +5,70 @@
 char* program_name;
 CacheView view;
 int gui_active;
+int logging;
 
-void validate_cache_parameters(int set_count_value, int assoc_value, int block_size_value)
+static void clamp_cache_parameters(int set_count_value, int assoc_value, int block_size_value, unsigned int max_sets,
+				   unsigned int* set_count_out, unsigned int* assoc_out, unsigned int* block_size_out)
 {
   if(assoc_value < 0)
-    assoc = 0;
+    *assoc_out = 0;
   else if(assoc_value > MAX_ASSOC)
-    assoc = MAX_ASSOC;
+    *assoc_out = MAX_ASSOC;
   else
-    assoc = assoc_value;
+    *assoc_out = assoc_value;
 
   if(set_count_value < 0)
-    set_count = 0;
-  else if(set_count_value > MAX_SETS)
-    set_count = MAX_SETS;
+    *set_count_out = 0;
+  else if(set_count_value > max_sets)
+    *set_count_out = max_sets;
   else if(set_count_value != 0)
-    set_count = 1 << uint_log2(set_count_value);
+    *set_count_out = 1 << uint_log2(set_count_value);
   else
-    set_count = 0;
+    *set_count_out = 0;
 
   if(block_size_value < 0)
-    block_size = 0;
+    *block_size_out = 0;
   else if(block_size_value > MAX_BLOCK_SIZE)
-    block_size = MAX_BLOCK_SIZE;
+    *block_size_out = MAX_BLOCK_SIZE;
   else if(block_size_value != 0)
   {
-    block_size = 1 << uint_log2(block_size_value);    
-    if(block_size == 1 || block_size == 2)
-      block_size = 4;
+    *block_size_out = 1 << uint_log2(block_size_value);    
+    if(*block_size_out == 1 || *block_size_out == 2)
+      *block_size_out = 4;
   } 
   else
-    block_size = 0;
+    *block_size_out = 0;
+}
+
+void validate_cache_parameters(int set_count_value, int assoc_value, int block_size_value)
+{
+  clamp_cache_parameters(set_count_value, assoc_value, block_size_value, MAX_SETS, &set_count, &assoc, &block_size);
 }
 
+void validate_level_parameters(cacheLevel* level, int set_count_value, int assoc_value, int block_size_value)
+{
+  clamp_cache_parameters(set_count_value, assoc_value, block_size_value, MAX_LEVEL_SETS, &level->set_count, &level->assoc, &level->block_size);
+}
+
+/*
+  Loads a dump file of big-endian instructions at PROGRAM_START, followed by
+  the sentinel instruction: the file is read in one go, byte swapped in one
+  pass and written to DRAM with a single range write, without going through
+  the caches or logging each word.  Programs may fill the text segment, up
+  to PROGRAM_END.
+
+  returns 0 if successful, non-zero if the file could not be read or does
+  not fit in physical memory.
+*/
 int load_dumpfile(const char* filename)
 {
   char buffer[200];
   FILE* dumpfile;
-  int i;
-  byte* inst = (byte*)(malloc(sizeof(byte) * sizeof(instruction)));
+  word* image;
+  long size;
+  unsigned int count;
+  unsigned int i;
+  word w;
 
   /* Read in file */
   if(!(dumpfile = fopen(filename, "rb")))
@@ -52,26 +77,47 @@ int load_dumpfile(const char* filename)
     append_log(buffer);
     return -1;
   }
-  else
+
+  /* Whole instructions only, leaving room for the sentinel */
+  if(fseek(dumpfile, 0, SEEK_END) != 0 || (size = ftell(dumpfile)) < 0)
+    size = 0;
+  rewind(dumpfile);
+  count = size / sizeof(instruction);
+  if(count > (PROGRAM_END - PROGRAM_START) / sizeof(instruction) - 1)
+    count = (PROGRAM_END - PROGRAM_START) / sizeof(instruction) - 1;
+
+  if((image = (word*)malloc((count + 1) * sizeof(word))) == NULL)
   {
-    sprintf(buffer, "[%s] loaded\n", filename);
+    fclose(dumpfile);
+    sprintf(buffer, "Unable to load [%s]\n", filename);
     append_log(buffer);
+    return -1;
   }
+  count = fread(image, sizeof(word), count, dumpfile);
+  fclose(dumpfile);
 
-  /* Load instructions into memory */
-  for(i = 0; i < PHYSICAL_PAGE_SIZE && fread(inst, sizeof(instruction), 1, dumpfile); i += sizeof(instruction))
+  /* Reverse the endianness of every instruction */
+  for(i = 0; i < count; i++)
   {
-    /* sprintf(buffer, "%02x , %08x\n", *inst, ntohl(*((word*)inst))); */
-    reverse_endianness( (instruction*) inst );
-    accessDRAM(PROGRAM_START + i, inst, WORD_SIZE, WRITE);
-  }  
-  
+    w = image[i];
+    image[i] = (w >> 24) | ((w >> 8) & 0x0000ff00) | ((w << 8) & 0x00ff0000) | (w << 24);
+  }
+
   /* Insert sentinel instruction */
-  *((word*)inst) = 0xffffffff;
-  accessDRAM(PROGRAM_START + i, inst, WORD_SIZE, WRITE);
+  image[count] = 0xffffffff;
 
-  fclose(dumpfile);
-  free(inst);
+  /* Load instructions into memory */
+  if(loadDRAM(PROGRAM_START, (byte*)image, (count + 1) * sizeof(word)) != 0)
+  {
+    free(image);
+    sprintf(buffer, "[%s] does not fit in physical memory\n", filename);
+    append_log(buffer);
+    return -1;
+  }
+  free(image);
+
+  sprintf(buffer, "[%s] loaded, %u instructions\n", filename, count);
+  append_log(buffer);
 
   /* Initialize processor */
   reinit_processor();
@@ -79,19 +125,11 @@ int load_dumpfile(const char* filename)
   return 0;
 }
 
-void reverse_endianness(instruction* word)
-{
-  int w = 0, i = 0;
-  for( i = 0; i < 4; i++ ) {
-    w |= ((*word>>(i*8)) & 0xff) << (3-i)*8;
-  }
-  *word = w;
-}
-
 int main(int argc, char** argv)
 {
   program_name = argv[0];
   gui_active = 1;
+  logging = 1;
 
   /* Initialize parameters */
   set_count = 0;
@@ -107,6 +145,12 @@ int main(int argc, char** argv)
   /* Check for flags */
   if(argc >= 2 && (strcmp(argv[1], "-nogui") == 0))
     gui_active = 0;
+  else if(argc >= 2 && (strcmp(argv[1], "-batch") == 0))
+  {
+    gui_active = 0;
+    logging = 0;
+    return run_batch(argc, argv);
+  }
 
   /* Build GUI */
   if(IS_GUI_ACTIVE())
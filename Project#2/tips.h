@@ -3,7 +3,19 @@
 #include <string.h>
 #include <assert.h>
 
+#ifdef NO_GUI
+#define IS_GUI_ACTIVE() 0
+#else
 #define IS_GUI_ACTIVE() (gui_active == 1)
+#endif
+
+/* Messages logged for every instruction and DRAM transfer; building with
+   -DNO_LOGGING takes them out of the simulation loop altogether */
+#ifdef NO_LOGGING
+#define IS_LOGGING() 0
+#else
+#define IS_LOGGING() (logging == 1)
+#endif
 
 typedef enum {INDEX, ASSOC} CacheView;
 typedef unsigned char byte;
@@ -13,19 +25,24 @@ typedef unsigned int instruction;
 
 /* Define Memory Constants */
 #define PHYSICAL_PAGE_SIZE 16384
-#define PHYSICAL_PAGE_COUNT 4
-#define PAGE_TABLE_SIZE 4
+#define DEFAULT_PHYSICAL_PAGES 1024
+#define MAX_PHYSICAL_PAGES 65536
 
 /* Define Address Space Constants */
 #define PROGRAM_START 0x00400000
-#define PROGRAM_END PROGRAM_START + PHYSICAL_PAGE_SIZE
+#define PROGRAM_END GLOBAL_START
 #define GLOBAL_START 0x10010000
 #define STACK_START 0x7fffeffc
 
 /* Define Cache Constants */
 #define MAX_BLOCK_SIZE 32
 #define MAX_SETS 16
-#define MAX_ASSOC 5
+#define MAX_ASSOC 16
+#define MAX_LEVEL_SETS 16384
+
+/* Tag value that no address can produce (block_size >= 4 leaves at most
+   30 tag bits), stored in the tag array of every invalid block */
+#define INVALID_TAG 0xffffffff
 
 /* Define Execution Constants */
 #define MIN_SPEED 10
@@ -34,6 +51,7 @@ typedef unsigned int instruction;
 /* Variables that will have to be externed */
 extern CacheView view;
 extern int gui_active;
+extern int logging;
 extern unsigned int registers[32];
 extern unsigned int hilo[2];
 extern address PC;
@@ -50,11 +68,19 @@ extern char* program_name;
   Typedef some useful states for variables
 *****************************************************************************/
 
-typedef enum {RANDOM, LRU, LFU} ReplacementPolicy;
+typedef enum {RANDOM, LRU, LFU, PLRU, SRRIP, BRRIP, FIFO, REPLACEMENT_POLICY_COUNT} ReplacementPolicy;
 typedef enum {WRITE_BACK, WRITE_THROUGH} MemorySyncPolicy;
+typedef enum {WRITE_ALLOCATE, NO_WRITE_ALLOCATE} AllocationPolicy;
 typedef enum {READ, WRITE} WriteEnable;
 typedef enum {BYTE_SIZE = 0, HALF_WORD_SIZE, WORD_SIZE, DOUBLEWORD_SIZE, QUADWORD_SIZE, OCTWORD_SIZE} TransferUnit;
 typedef enum {HIT, MISS} CacheAction;
+typedef enum {NON_INCLUSIVE, INCLUSIVE, EXCLUSIVE} InclusionPolicy;
+typedef enum {INSTRUCTION_FETCH, DATA_ACCESS} AccessType;
+typedef enum {IFETCH, LOAD, STORE, ACCESS_KIND_COUNT} AccessKind;
+typedef enum {COMPULSORY, CAPACITY, CONFLICT, MISS_CLASS_COUNT} MissClass;
+
+/* Kind of an access, as counted by the statistics */
+#define ACCESS_KIND(type, we) ((type) == INSTRUCTION_FETCH ? IFETCH : ((we) == READ ? LOAD : STORE))
 
 /*****************************************************************************
   Define cache variables and memory structure and functions 
@@ -69,34 +95,379 @@ extern MemorySyncPolicy memory_sync_policy;  /* Memory sync policy        */
 /* Define cache block
    ==================
    valid - assign INVALID if block invalid; assign VALID if block valid
-   tag - container for the tag bits; unsigned to allow ignoring sign ext issue
    data - the data contained in a block
    lru.data - pointer to lru information
    lru.value - int that represents lru information
+   sector_valid, sector_dirty - bit i set when sector i of the block holds
+                                data, or data newer than the level below;
+                                a block that is not sectored is one sector
+   prefetched - for a block brought in by a prefetcher and not used yet, the
+                count of accesses to the hierarchy when it was prefetched,
+                plus one; 0 otherwise
 */
 typedef struct {
   enum {INVALID, VALID} valid;   
   enum {VIRGIN, DIRTY} dirty;
-  unsigned int tag;
   byte data[MAX_BLOCK_SIZE];
   union { 
     void* data;
     unsigned int value;
   } lru;
   int accessCount;
+  unsigned int sector_valid;
+  unsigned int sector_dirty;
+  unsigned long long prefetched;
 } cacheBlock;
 
 /* Define cache unit
    =================
+   tag - container for the tag bits of each block; unsigned to allow ignoring
+         sign ext issue.  Kept apart from the blocks so that a whole set can
+         be compared in one pass, and holds INVALID_TAG for invalid blocks
    block - array that represents a set of blocks with the SAME index
+   replacement - state the replacement policy keeps for the whole set
+   hits, misses - lookups in the set since the last flush
+   miss_classes - the misses by class (when the hierarchy classifies them)
 */
 typedef struct {
+  unsigned int tag[MAX_ASSOC];
   cacheBlock block[MAX_ASSOC];
+  unsigned int replacement;
+  unsigned long long hits;
+  unsigned long long misses;
+  unsigned long long miss_classes[MISS_CLASS_COUNT];
 } cacheSet;
 
 /* Define actual cache structure that will be manipulated by accessMemory() */
 extern cacheSet cache[MAX_SETS];
 
+/* Define prefetcher
+   =================
+   kind - what predicts the blocks to prefetch; see prefetch.c
+   degree - blocks requested each time the prefetcher fires
+   distance - how many blocks (or strides) ahead the first one is
+   buffer_lines - size of the prefetch buffer the blocks go into; 0 puts
+                  them into the level itself
+*/
+typedef enum {PREFETCH_NONE, PREFETCH_NEXT_LINE, PREFETCH_STRIDE, PREFETCH_STREAM, PREFETCHER_COUNT} PrefetcherKind;
+
+#define MAX_PREFETCH_DEGREE 16
+#define MAX_PREFETCH_BUFFER_LINES 64
+
+typedef struct {
+  PrefetcherKind kind;
+  unsigned int degree;
+  unsigned int distance;
+  unsigned int buffer_lines;
+} prefetchConfig;
+
+/* A block of a prefetch buffer; issued is as cacheBlock.prefetched */
+typedef struct {
+  address block;
+  int valid;
+  unsigned long long issued;
+  unsigned long long used;
+  byte data[MAX_BLOCK_SIZE];
+} prefetchLine;
+
+typedef struct _prefetcher prefetchEngine;
+
+/* Define victim cache and write buffer
+   ====================================
+   victimLine - a block of a victim cache, with the LRU clock of its fill
+   writeBufferEntry - the writes to one block waiting in a write buffer;
+                      bit i of words is set when word i of data is to be
+                      written
+   See buffers.c.
+*/
+#define MAX_VICTIM_LINES 64
+#define MAX_WRITE_BUFFER_DEPTH 64
+
+/* cycles a hit in a victim cache adds to the miss of its level */
+#define VICTIM_CACHE_LATENCY 1
+
+typedef struct {
+  address block;
+  int valid;
+  int dirty;
+  unsigned long long used;
+  byte data[MAX_BLOCK_SIZE];
+} victimLine;
+
+typedef struct {
+  address block;
+  unsigned int words;
+  byte data[MAX_BLOCK_SIZE];
+} writeBufferEntry;
+
+/* Define miss status holding register
+   ====================================
+   An outstanding miss of a level in cycle mode: the block being brought in
+   and the cycle its data arrives.  An entry whose ready cycle has passed is
+   free.  See buffers.c.
+*/
+#define MAX_MSHRS 32
+
+typedef struct {
+  address block;
+  unsigned long long ready;
+} mshrEntry;
+
+/* Define cache level
+   ==================
+   One cache of the memory hierarchy.  The L1 data (or unified) level takes
+   its parameters from the variables above and keeps its blocks in cache[];
+   the other levels are configured on their own.  A level with any parameter
+   set to 0 does not exist and is skipped over.
+
+   inclusion - relation of this level to the levels above it
+   allocation - whether a write miss brings the block into the level
+   sector_size - bytes moved to and from the level below at once, a power of
+                 two of at least 4; 0 (or block_size) for whole blocks
+   latency - cycles a hit in the level takes
+   set - the set_count sets of the level
+   next - the level misses are sent to; NULL means DRAM
+   hierarchy - the hierarchy the level belongs to
+   classifier - state of the miss classification; see missclass.c
+   prefetch, prefetcher - configuration and state of the prefetcher
+   prefetches - blocks the prefetcher brought in
+   useful_prefetches - of those, blocks a demand access used
+   late_prefetches - useful prefetches used fewer accesses after they were
+                     issued than the cycles a fill from below takes
+   useless_prefetches - prefetched blocks evicted before any use
+   prefetch_lead - accesses between issue and first use, summed
+   victim_lines, victim - size and lines of the victim cache; 0 for none
+   write_buffer_depth, write_buffer - entries of the write buffer; 0 for none
+   write_buffer_count - entries in use, oldest first
+   buffer_clock - LRU clock of the victim cache
+   sector_misses - misses of blocks that were present without the sectors
+                   needed; counted in misses but in none of the 3 Cs
+   victim_hits - misses the victim cache served
+   victim_evictions - blocks pushed out of the victim cache
+   buffered_writes - writes the write buffer absorbed
+   merged_writes - of those, writes merged into an existing entry
+   write_buffer_drains - entries written to the level below
+   full_drains, read_drains - drains forced by a full buffer, or by a read
+                              of a buffered block from below
+   mshrs, mshr - MSHRs of the level in cycle mode, used when accesses enter
+                 the hierarchy at it; 0 makes it block on every miss
+   hits_under_miss, misses_under_miss - hits, and misses given an MSHR, while
+                                        another miss was outstanding
+   mshr_merges - misses to a block already outstanding, merged into its MSHR
+   mshr_full_stalls, mshr_stall_cycles - misses that found every MSHR busy,
+                                         and the cycles they waited for one
+*/
+typedef enum {L1I, L1D, L2, L3, LEVEL_COUNT} CacheLevelId;
+
+struct _cacheHierarchy;
+typedef struct _missClassifier missClassifier;
+typedef struct _pcProfile pcProfile;
+
+typedef struct _cacheLevel {
+  const char* name;
+  unsigned int set_count;
+  unsigned int assoc;
+  unsigned int block_size;
+  ReplacementPolicy policy;
+  MemorySyncPolicy memory_sync_policy;
+  InclusionPolicy inclusion;
+  AllocationPolicy allocation;
+  unsigned int sector_size;
+  unsigned int latency;
+  unsigned int offset_bits;
+  unsigned int index_bits;
+  cacheSet* set;
+  struct _cacheLevel* next;
+  struct _cacheHierarchy* hierarchy;
+  missClassifier* classifier;
+  prefetchConfig prefetch;
+  prefetchEngine* prefetcher;
+  unsigned int victim_lines;
+  unsigned int write_buffer_depth;
+  victimLine* victim;
+  writeBufferEntry* write_buffer;
+  unsigned int write_buffer_count;
+  unsigned long long buffer_clock;
+  unsigned int mshrs;
+  mshrEntry* mshr;
+  unsigned long long hits;
+  unsigned long long misses;
+  unsigned long long kind_hits[ACCESS_KIND_COUNT];
+  unsigned long long kind_misses[ACCESS_KIND_COUNT];
+  unsigned long long miss_classes[MISS_CLASS_COUNT];
+  unsigned long long evictions;
+  unsigned long long write_backs;
+  unsigned long long write_throughs;
+  unsigned long long back_invalidations;
+  unsigned long long sector_misses;
+  unsigned long long prefetches;
+  unsigned long long useful_prefetches;
+  unsigned long long late_prefetches;
+  unsigned long long useless_prefetches;
+  unsigned long long prefetch_lead;
+  unsigned long long victim_hits;
+  unsigned long long victim_evictions;
+  unsigned long long buffered_writes;
+  unsigned long long merged_writes;
+  unsigned long long write_buffer_drains;
+  unsigned long long full_drains;
+  unsigned long long read_drains;
+  unsigned long long hits_under_miss;
+  unsigned long long misses_under_miss;
+  unsigned long long mshr_merges;
+  unsigned long long mshr_full_stalls;
+  unsigned long long mshr_stall_cycles;
+} cacheLevel;
+
+/* Define replacement policy
+   =========================
+   Hooks through which the cache logic drives a replacement policy; see
+   replacement.c.  command is the name used by the config command.
+*/
+typedef struct {
+  const char* name;
+  const char* command;
+  void (*init)(cacheLevel* level, unsigned int set_index, unsigned int block_index);
+  void (*on_hit)(cacheLevel* level, unsigned int set_index, unsigned int block_index);
+  void (*on_fill)(cacheLevel* level, unsigned int set_index, unsigned int block_index);
+  unsigned int (*choose_victim)(cacheLevel* level, unsigned int set_index);
+} ReplacementPolicyHooks;
+
+extern const ReplacementPolicyHooks replacement_policies[REPLACEMENT_POLICY_COUNT];
+
+#define LEVEL_ENABLED(level) ((level)->set_count != 0 && (level)->assoc != 0 && (level)->block_size != 0)
+#define SECTOR_SIZE(level) ((level)->sector_size != 0 && (level)->sector_size < (level)->block_size ? (level)->sector_size : (level)->block_size)
+
+/* Define DRAM timing
+   ===================
+   channels - independent channels, each with its own data bus; 0 turns the
+              model off and every transfer takes dram_latency cycles
+   banks - banks per channel, each with one open row
+   row_size - bytes of a row
+   tRCD, tCAS, tRP - cycles to open a row, to read or write an open row, and
+                     to close a row
+   tBURST - cycles the data of one transfer holds its channel's bus
+   queue_depth - requests that may wait for the banks, scheduled FR-FCFS
+   page_policy - whether rows are left open after an access
+   mapping - how an address picks its channel, bank and row
+   Channels, banks and row_size are powers of two.  See dram.c.
+*/
+typedef enum {OPEN_PAGE, CLOSED_PAGE} PagePolicy;
+typedef enum {MAP_ROW_INTERLEAVED, MAP_BLOCK_INTERLEAVED, MAP_XOR_INTERLEAVED, DRAM_MAPPING_COUNT} DramMapping;
+
+#define MAX_DRAM_CHANNELS 8
+#define MAX_DRAM_BANKS 64
+#define MAX_DRAM_QUEUE 64
+
+typedef struct {
+  unsigned int channels;
+  unsigned int banks;
+  unsigned int row_size;
+  unsigned int tRCD;
+  unsigned int tCAS;
+  unsigned int tRP;
+  unsigned int tBURST;
+  unsigned int queue_depth;
+  PagePolicy page_policy;
+  DramMapping mapping;
+} dramConfig;
+
+typedef struct _dramTiming dramTiming;
+
+/* Define cache hierarchy
+   ======================
+   A complete cache model: its levels, where accesses enter it and what lies
+   below the last level.  The simulated CPU uses memory_hierarchy; other
+   instances (e.g. the sweep) share no state with it and can run on other
+   threads.
+
+   displayed - non-zero for the hierarchy drawn and logged by the UI
+   dram - called for every transfer to or from DRAM, or NULL when only the
+          traffic is counted and the data is not needed
+   classify_misses - non-zero to sort the misses of every level into the 3 Cs
+   profile_pcs - non-zero to count the hits and misses of every instruction
+   profile - the per-PC counters; see profile.c
+   pc - the PC of the access in progress, for the prefetchers
+   timed - non-zero for cycle mode: accesses are made at cycle and return
+           when they were accepted and when their data is ready
+   cycle - the current cycle in cycle mode, advanced by the CPU; it is never
+           reset, so times left from before a flush are in the past
+   accepted, ready - results of the last access in cycle mode
+   demand, demand_cycles - whether the access in progress is a demand access
+                           in cycle mode, and the cycles its levels took
+   random_state - seed of the random numbers used by replacement policies
+   dram_latency - cycles a transfer to or from DRAM takes without the timing
+                  model
+   dram_config - the DRAM timing model, off unless dram_config.channels is set
+   dram_timing - the state of the banks and the request queue; see dram.c
+   accesses - accesses that entered the hierarchy, by kind
+   dram_reads, dram_writes - bytes moved from and to DRAM
+   dram_read_transfers, dram_write_transfers - transfers that moved them
+   dram_read_cycles - cycles the reads of DRAM took, from their request to
+                      their data; writes are posted and take none
+   dram_row_hits, dram_row_misses, dram_row_conflicts - DRAM requests that
+                      found their row open, their bank closed, or another row
+                      open in their bank
+   dram_reordered - requests the scheduler served ahead of older ones
+*/
+typedef struct _cacheHierarchy {
+  cacheLevel level[LEVEL_COUNT];
+  cacheLevel* instruction_cache;             /* Level instruction fetches go to */
+  cacheLevel* data_cache;                    /* Level loads and stores go to    */
+  int displayed;
+  int classify_misses;
+  int profile_pcs;
+  pcProfile* profile;
+  address pc;
+  int timed;
+  unsigned long long cycle;
+  unsigned long long accepted;
+  unsigned long long ready;
+  int demand;
+  unsigned long long demand_cycles;
+  int (*dram)(address addr, byte* data, TransferUnit mode, WriteEnable flag);
+  unsigned int random_state;
+  unsigned int dram_latency;
+  dramConfig dram_config;
+  dramTiming* dram_timing;
+  unsigned long long accesses[ACCESS_KIND_COUNT];
+  unsigned long long dram_reads;
+  unsigned long long dram_writes;
+  unsigned long long dram_read_transfers;
+  unsigned long long dram_write_transfers;
+  unsigned long long dram_read_cycles;
+  unsigned long long dram_row_hits;
+  unsigned long long dram_row_misses;
+  unsigned long long dram_row_conflicts;
+  unsigned long long dram_reordered;
+} cacheHierarchy;
+
+extern cacheHierarchy memory_hierarchy;
+
+/* Define multicore coherence
+   ==========================
+   With core_count above 1, every core runs the program on its own registers
+   and private hierarchy, kept coherent by invalidation; see multicore.c.
+   Core c starts with its stack CORE_STACK_SIZE * c bytes below STACK_START,
+   inside the stack page, and its number in $k0.
+
+   SnoopAction - what a snoop does to the copies of a block a hierarchy holds
+   SNOOP_HELD, SNOOP_DIRTY - what a snoop found
+   directory - non-zero to send requests to a directory that knows the
+               holders of every block, instead of broadcasting on a bus
+*/
+#define MAX_CORES 4
+#define CORE_STACK_SIZE 0x800
+
+typedef enum {SNOOP_PROBE, SNOOP_CLEAN, SNOOP_INVALIDATE} SnoopAction;
+typedef enum {MSI, MESI} CoherenceProtocol;
+
+#define SNOOP_HELD 1
+#define SNOOP_DIRTY 2
+
+extern int core_count;
+extern int active_core;
+
 /*
   This function should be called when you want to interact with physical memory
 
@@ -110,6 +481,8 @@ extern cacheSet cache[MAX_SETS];
 
  */
 int accessDRAM(address addr, byte* data, TransferUnit mode, WriteEnable flag);
+int peekDRAM(address addr, byte* data, unsigned int size);
+int loadDRAM(address addr, const byte* data, unsigned int size);
 
 
 /*
@@ -123,6 +496,12 @@ int accessDRAM(address addr, byte* data, TransferUnit mode, WriteEnable flag);
 */
 void accessMemory(address addr, word* data, WriteEnable flag);
 
+/*
+  Same as accessMemory(), but states whether the access is an instruction
+  fetch or a load/store, so that it can be sent to a split L1 cache.
+*/
+void accessCache(address addr, word* data, WriteEnable flag, AccessType type);
+
 /*
   These are the GUI functions you can call to visualize changes in the cache
  */
@@ -159,6 +538,12 @@ void highlight_block(unsigned int set_num, unsigned int assoc_num);
  */
 void highlight_offset(unsigned int set_num, unsigned int assoc_num, unsigned int offset, CacheAction action);
 
+#ifdef NO_GUI
+/* Built without GTK (see nogtk.c): there is nothing to highlight */
+#define highlight_block(set_num, assoc_num) ((void)0)
+#define highlight_offset(set_num, assoc_num, offset, action) ((void)0)
+#endif
+
 /*****************************************************************************
  *
  *     Stop Reading -- you don't need anything past this point.
@@ -172,29 +557,193 @@ void highlight_offset(unsigned int set_num, unsigned int assoc_num, unsigned int
 
 /* Defined in tips.c */
 int load_dumpfile(const char* filename);
-void reverse_endianness(instruction* word);
 
 /* Defined in memory.c */
 void init_memory(void);
+int configure_physical_memory(unsigned int pages);
 void flush_cache(void);
+void link_cache_levels(void);
+void link_hierarchy(cacheHierarchy* h);
+void flush_hierarchy(cacheHierarchy* h);
+void free_hierarchy(cacheHierarchy* h);
+int copy_hierarchy_config(cacheHierarchy* h, const cacheHierarchy* source);
+int configure_hierarchy_level(cacheHierarchy* h, CacheLevelId id, int set_count_value, int assoc_value, int block_size_value, ReplacementPolicy p, MemorySyncPolicy m, InclusionPolicy inclusion);
+int configure_level(CacheLevelId id, int set_count_value, int assoc_value, int block_size_value, ReplacementPolicy p, MemorySyncPolicy m, InclusionPolicy inclusion);
+const char* inclusion_name(InclusionPolicy inclusion);
+int configure_prefetcher(cacheHierarchy* h, CacheLevelId id, const prefetchConfig* config);
+int configure_write_policy(cacheHierarchy* h, CacheLevelId id, AllocationPolicy allocation, unsigned int sector_size);
+int configure_level_buffers(cacheHierarchy* h, CacheLevelId id, unsigned int victim_lines, unsigned int write_buffer_depth);
+int configure_dram_timing(cacheHierarchy* h, const dramConfig* config);
+int configure_mshrs(cacheHierarchy* h, CacheLevelId id, unsigned int mshrs);
 
 /* Defined in cpu.c */
+/*
+  Timing of the in-order pipeline in cycle mode, since the processor was
+  last reinitialized: one instruction issues per cycle unless it waits for
+  its fetch, for a load that writes one of its registers, or for the cache
+  to accept its load or store.
+*/
+typedef struct {
+  unsigned long long start;         /* hierarchy cycle of the reset */
+  unsigned long long instructions;
+  unsigned long long fetch_stalls;
+  unsigned long long load_use_stalls;
+  unsigned long long memory_stalls;
+} pipelineStats;
+
+extern pipelineStats pipeline;
+
 void reinit_processor(void);
+void reset_pipeline(void);
+void switch_core(int core);
 void step_processor(void);
+int processor_halted(void);
+void format_inst(char* buffer, word inst, address pc);
 
-/* Defined in gui.c */
+/* Defined in gui.c, or in nogtk.c when built without GTK (-DNO_GUI), where
+   the display hooks compile to nothing */
 int build_gui(int argc, char** argv);
 void refresh_register_display();
 void refresh_cache_display();
 void stop_run();
 void flush_drawlist();
 
+#ifdef NO_GUI
+#define refresh_register_display() ((void)0)
+#define refresh_cache_display() ((void)0)
+#define flush_drawlist() ((void)0)
+#endif
+
 /* Defined in nogui.c */
 void activate_no_gui(int argc, char** argv);
+int run_batch(int argc, char** argv);
+
+/* Defined in replacement.c */
+int find_replacement_policy(const char* command);
+
+/* Defined in tagmatch.c */
+void init_tag_match(void);
+int match_tag(const cacheSet* set, unsigned int tag, unsigned int ways);
+
+/* Defined in stackdist.c */
+extern int stack_distance_active;
+int start_stack_distance(unsigned int block_size_value, AccessType filter, int filter_active);
+void stop_stack_distance(void);
+void record_stack_distance(address addr, AccessType type);
+void report_stack_distance(FILE* out);
+
+/* Defined in sweep.c */
+typedef struct {
+  unsigned int min_sets, max_sets;
+  unsigned int min_assoc, max_assoc;
+  unsigned int min_block, max_block;
+  unsigned int policies;                     /* 1 << ReplacementPolicy for each policy */
+  unsigned int sync_policies;                /* 1 << MemorySyncPolicy for each policy  */
+  int threads;                               /* 0 means one per processor              */
+} sweepSpace;
+
+extern int sweep_recording;
+void start_sweep_recording(void);
+void stop_sweep_recording(void);
+unsigned long long sweep_recorded_accesses(void);
+void record_sweep_access(address addr, WriteEnable we, AccessType type);
+int run_sweep(const sweepSpace* space, FILE* out, int json);
+
+/* Defined in trace.c */
+typedef enum {TRACE_DETECT, TRACE_TIPS, TRACE_DINERO, TRACE_LACKEY} TraceFormat;
+
+extern int trace_recording;
+int start_trace_recording(const char* filename);
+unsigned long long stop_trace_recording(void);
+void record_trace_access(address pc, address addr, WriteEnable we, AccessType type);
+long long replay_trace(const char* filename, TraceFormat format, cacheHierarchy* h);
+
+/* Defined in missclass.c */
+int reset_miss_classifier(cacheLevel* level);
+void free_miss_classifier(cacheLevel* level);
+MissClass classify_lookup(cacheLevel* level, address addr, int hit);
+const char* miss_class_name(MissClass miss_class);
+
+/* Defined in prefetch.c */
+const char* prefetcher_name(PrefetcherKind kind);
+int find_prefetcher(const char* command);
+int reset_prefetcher(cacheLevel* level);
+void free_prefetcher(cacheLevel* level);
+unsigned int predict_prefetches(cacheLevel* level, address pc, address addr, AccessType type, int trigger, address* blocks);
+prefetchLine* find_prefetched_line(cacheLevel* level, address block);
+prefetchLine* prefetch_buffer_slot(cacheLevel* level);
+
+/* Defined in buffers.c */
+int reset_level_buffers(cacheLevel* level);
+void free_level_buffers(cacheLevel* level);
+victimLine* find_victim_line(cacheLevel* level, address block);
+victimLine* victim_slot(cacheLevel* level);
+writeBufferEntry* find_write_entry(cacheLevel* level, address block);
+void remove_write_entry(cacheLevel* level, unsigned int i);
+void report_level_buffers(const cacheLevel* level, FILE* out);
+int reset_mshrs(cacheLevel* level);
+void free_mshrs(cacheLevel* level);
+mshrEntry* find_mshr(cacheLevel* level, address block, unsigned long long now);
+mshrEntry* mshr_slot(cacheLevel* level, unsigned long long now);
+unsigned int outstanding_mshrs(const cacheLevel* level, unsigned long long now);
+
+/* Defined in profile.c */
+int reset_pc_profile(cacheHierarchy* h);
+void free_pc_profile(cacheHierarchy* h);
+void profile_access(cacheHierarchy* h, address pc, AccessType type, int missed, int dram);
+void report_pc_profile(const cacheHierarchy* h, unsigned int count, FILE* out);
+
+/* Defined in dram.c */
+const char* dram_mapping_name(DramMapping mapping);
+int find_dram_mapping(const char* command);
+int reset_dram_timing(cacheHierarchy* h);
+void free_dram_timing(cacheHierarchy* h);
+unsigned int dram_request(cacheHierarchy* h, address addr, WriteEnable we, unsigned long long now);
+double dram_read_latency(const cacheHierarchy* h);
+
+/* Defined in multicore.c */
+cacheHierarchy* core_hierarchy(int core);
+void flush_cores(void);
+int configure_cores(int count);
+void configure_coherence(CoherenceProtocol protocol, int directory);
+void coherent_access(address pc, address addr, word* data, WriteEnable we, AccessType type);
+void report_coherence(unsigned int count, FILE* out);
+
+/* Defined in vmem.c */
+/*
+  A TLB level of sets sets of assoc translations each; 0 sets for none.  The
+  second level is searched when the first misses, before the page table.
+*/
+typedef enum {TLB_L1, TLB_L2, TLB_LEVEL_COUNT} TlbLevelId;
+
+typedef struct {
+  unsigned int sets;
+  unsigned int assoc;
+} tlbConfig;
+
+void reset_page_table(unsigned int pages);
+int flush_tlbs(void);
+int configure_tlb(TlbLevelId id, unsigned int sets, unsigned int assoc);
+const tlbConfig* tlb_config(TlbLevelId id);
+int translate_address(address virtual_addr, address* physical_addr);
+int lookup_address(address virtual_addr, address* physical_addr);
+int check_free_pages(address virtual_addr, unsigned int size);
+void report_vm(FILE* out);
+
+/* Defined in stats.c */
+const char* access_kind_name(AccessKind kind);
+double level_amat(const cacheHierarchy* h, const cacheLevel* level);
+void report_stats(const cacheHierarchy* h, FILE* out);
+void report_set_stats(const cacheLevel* level, FILE* out);
+void report_timing(const cacheHierarchy* h, FILE* out);
 
 /* Defined in cachelogic.c */
-void init_lfu(int set_number, int assoc_value);
-void init_lru(int set_number, int assoc_value);
+void observe_access(address pc, address addr, WriteEnable we, AccessType type);
+void access_hierarchy(cacheHierarchy* h, address pc, address addr, word* data, WriteEnable we, AccessType type);
+int snoop_hierarchy(cacheHierarchy* h, address addr, unsigned int size, SnoopAction action);
 char* lfu_to_string(int set_number, int assoc_value);
 char* lru_to_string(int set_number, int assoc_value);
+
+/* Defined in tips.c */
 void validate_cache_parameters(int set_number, int assoc_value, int block_size_value);
+void validate_level_parameters(cacheLevel* level, int set_number, int assoc_value, int block_size_value);
@@ -0,0 +1,267 @@
+#include "tips.h"
+
+/******************************************************************************
+   Access traces
+
+   Every access of the CPU can be streamed to a file, and a file replayed
+   into a cache hierarchy without running the CPU.  Besides the TIPS format,
+   replay reads the traces of DineroIV ("din": one "<label> <hex address>"
+   per line, label 0 read, 1 write, 2 instruction fetch) and of Valgrind's
+   lackey tool (--trace-mem=yes: "I  <addr>,<size>" and " L|S|M <addr>,<size>").
+   Their addresses are truncated to 32 bits, and accesses are split into the
+   aligned words they touch, since the cache model works on words.
+
+   TIPS format: the 8 byte magic TRACE_MAGIC followed by one record per
+   access, each the little-endian 32-bit address and PC and a flags byte.
+ *****************************************************************************/
+
+#define TRACE_MAGIC "TIPSTRC1"
+#define TRACE_RECORD_SIZE 9
+
+#define TRACE_WRITE 0x01
+#define TRACE_DATA 0x02
+
+/* records are written and read through a buffer of this many bytes */
+#define TRACE_BUFFER_SIZE (4096 * TRACE_RECORD_SIZE)
+
+int trace_recording;
+
+static FILE* trace_file;
+static byte trace_buffer[TRACE_BUFFER_SIZE];
+static byte replay_buffer[TRACE_BUFFER_SIZE];
+static unsigned int trace_buffered;
+static unsigned long long trace_records;
+
+static void put_word(byte* p, word w)
+{
+  p[0] = w & 0xff;
+  p[1] = (w >> 8) & 0xff;
+  p[2] = (w >> 16) & 0xff;
+  p[3] = (w >> 24) & 0xff;
+}
+
+static word get_word(const byte* p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((word)p[3] << 24);
+}
+
+/*
+  Starts streaming every access to a file, in the TIPS format
+
+  returns 0 if successful, non-zero if the file could not be created.
+*/
+int start_trace_recording(const char* filename)
+{
+  stop_trace_recording();
+
+  if((trace_file = fopen(filename, "wb")) == NULL)
+    return -1;
+
+  fwrite(TRACE_MAGIC, 1, strlen(TRACE_MAGIC), trace_file);
+  trace_buffered = 0;
+  trace_records = 0;
+  trace_recording = 1;
+  return 0;
+}
+
+/* Closes the trace being recorded; returns the number of accesses in it */
+unsigned long long stop_trace_recording(void)
+{
+  if(trace_file != NULL)
+  {
+    fwrite(trace_buffer, 1, trace_buffered, trace_file);
+    fclose(trace_file);
+    trace_file = NULL;
+  }
+
+  trace_recording = 0;
+  return trace_records;
+}
+
+/* Called for every access while recording */
+void record_trace_access(address pc, address addr, WriteEnable we, AccessType type)
+{
+  byte* record = trace_buffer + trace_buffered;
+
+  put_word(record, addr);
+  put_word(record + 4, pc);
+  record[8] = (we == WRITE ? TRACE_WRITE : 0) | (type == DATA_ACCESS ? TRACE_DATA : 0);
+  trace_records++;
+
+  trace_buffered += TRACE_RECORD_SIZE;
+  if(trace_buffered == TRACE_BUFFER_SIZE)
+  {
+    if(fwrite(trace_buffer, 1, TRACE_BUFFER_SIZE, trace_file) != TRACE_BUFFER_SIZE)
+    {
+      append_log("Unable to write the trace; recording stopped\n");
+      trace_buffered = 0;
+      stop_trace_recording();
+      return;
+    }
+    trace_buffered = 0;
+  }
+}
+
+/* Sends the words of [addr, addr + size) to the hierarchy and to the analyses */
+static unsigned long long replay_access(cacheHierarchy* h, address pc, unsigned long long addr, unsigned int size, WriteEnable we, AccessType type)
+{
+  address first = (address)addr & ~(sizeof(word) - 1);
+  address last = ((address)addr + (size ? size - 1 : 0)) & ~(sizeof(word) - 1);
+  unsigned long long count = 0;
+  address a = first;
+  word data;
+
+  for(;;)
+  {
+    data = 0;
+    observe_access(pc, a, we, type);
+    access_hierarchy(h, pc, a, &data, we, type);
+    count++;
+    if(a == last)
+      break;
+    a += sizeof(word);
+  }
+
+  return count;
+}
+
+static unsigned long long replay_tips(FILE* file, cacheHierarchy* h)
+{
+  byte* record;
+  size_t records;
+  size_t i;
+  unsigned long long count = 0;
+
+  while((records = fread(replay_buffer, TRACE_RECORD_SIZE, TRACE_BUFFER_SIZE / TRACE_RECORD_SIZE, file)) > 0)
+  {
+    for(i = 0; i < records; i++)
+    {
+      record = replay_buffer + i * TRACE_RECORD_SIZE;
+      count += replay_access(h, get_word(record + 4), get_word(record), sizeof(word),
+			     (record[8] & TRACE_WRITE) ? WRITE : READ,
+			     (record[8] & TRACE_DATA) ? DATA_ACCESS : INSTRUCTION_FETCH);
+    }
+  }
+
+  return count;
+}
+
+static unsigned long long replay_dinero(FILE* file, cacheHierarchy* h)
+{
+  char line[200];
+  unsigned long long addr;
+  unsigned long long count = 0;
+  int label;
+
+  while(fgets(line, sizeof(line), file) != NULL)
+  {
+    if(sscanf(line, "%d %llx", &label, &addr) != 2)
+      continue;
+
+    if(label == 0)
+      count += replay_access(h, 0, addr, sizeof(word), READ, DATA_ACCESS);
+    else if(label == 1)
+      count += replay_access(h, 0, addr, sizeof(word), WRITE, DATA_ACCESS);
+    else if(label == 2)
+      count += replay_access(h, 0, addr, sizeof(word), READ, INSTRUCTION_FETCH);
+  }
+
+  return count;
+}
+
+static unsigned long long replay_lackey(FILE* file, cacheHierarchy* h)
+{
+  char line[200];
+  char kind;
+  unsigned long long addr;
+  unsigned int size;
+  address pc = 0;
+  unsigned long long count = 0;
+
+  while(fgets(line, sizeof(line), file) != NULL)
+  {
+    /* "==pid==" lines are lackey's own messages */
+    if(sscanf(line, " %c %llx,%u", &kind, &addr, &size) != 3)
+      continue;
+
+    switch(kind)
+    {
+    case 'I':
+      pc = (address)addr;
+      count += replay_access(h, pc, addr, size, READ, INSTRUCTION_FETCH);
+      break;
+    case 'L':
+      count += replay_access(h, pc, addr, size, READ, DATA_ACCESS);
+      break;
+    case 'S':
+      count += replay_access(h, pc, addr, size, WRITE, DATA_ACCESS);
+      break;
+    case 'M':
+      count += replay_access(h, pc, addr, size, READ, DATA_ACCESS);
+      count += replay_access(h, pc, addr, size, WRITE, DATA_ACCESS);
+      break;
+    }
+  }
+
+  return count;
+}
+
+/* Guesses the format of a trace from its first bytes */
+static TraceFormat detect_trace_format(FILE* file)
+{
+  char head[200];
+  size_t length = fread(head, 1, sizeof(head) - 1, file);
+
+  rewind(file);
+  head[length] = '\0';
+
+  if(length >= strlen(TRACE_MAGIC) && memcmp(head, TRACE_MAGIC, strlen(TRACE_MAGIC)) == 0)
+    return TRACE_TIPS;
+  if(strncmp(head, "==", 2) == 0 || strchr(head, ',') != NULL)
+    return TRACE_LACKEY;
+  return TRACE_DINERO;
+}
+
+/*
+  Replays a trace file into a hierarchy, and into the analyses that are
+  active (stack distance, sweep recording, trace recording)
+
+    filename - the trace
+    format - its format, or TRACE_DETECT to guess it
+    h - the hierarchy to replay into; it is not flushed first
+
+  returns the number of accesses replayed, or -1 if the file could not be read
+*/
+long long replay_trace(const char* filename, TraceFormat format, cacheHierarchy* h)
+{
+  FILE* file;
+  char magic[sizeof(TRACE_MAGIC)];
+  unsigned long long count;
+
+  if((file = fopen(filename, "rb")) == NULL)
+    return -1;
+
+  if(format == TRACE_DETECT)
+    format = detect_trace_format(file);
+
+  switch(format)
+  {
+  case TRACE_TIPS:
+    if(fread(magic, 1, strlen(TRACE_MAGIC), file) != strlen(TRACE_MAGIC) || memcmp(magic, TRACE_MAGIC, strlen(TRACE_MAGIC)) != 0)
+    {
+      fclose(file);
+      return -1;
+    }
+    count = replay_tips(file, h);
+    break;
+  case TRACE_LACKEY:
+    count = replay_lackey(file, h);
+    break;
+  default:
+    count = replay_dinero(file, h);
+    break;
+  }
+
+  fclose(file);
+  return count;
+}
@@ -21,3 +21,15 @@ unsigned int uint_log2(unsigned int w)
 int randomint( int x ) { 
   return rand()%x;
 }
+
+/* return random int from 0..x-1 from a private xorshift sequence, so that
+   independent cache models running on several threads stay reproducible */
+int randomint_r( unsigned int* state, int x ) {
+  unsigned int s = *state ? *state : 1;
+
+  s ^= s << 13;
+  s ^= s >> 17;
+  s ^= s << 5;
+  *state = s;
+  return s%x;
+}
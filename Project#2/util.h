@@ -3,3 +3,6 @@ unsigned int uint_log2(unsigned int w);
 
 /* return random int from 0..x-1 */
 int randomint( int x );
+
+/* same as randomint, drawing from the sequence of *state instead of rand() */
+int randomint_r( unsigned int* state, int x );
@@ -0,0 +1,298 @@
+#include "tips.h"
+
+/******************************************************************************
+   Virtual memory
+
+   Every transfer to or from DRAM is translated from the virtual address the
+   caches use to a physical address.  Pages are PHYSICAL_PAGE_SIZE bytes; the
+   page number is split in two halves that index a page directory and one of
+   its page tables, which are allocated on demand like the pages themselves:
+   the first touch of a page maps it to the next free physical page, until
+   physical memory is full.
+
+   A set-associative LRU TLB caches the translations, optionally backed by a
+   larger second level TLB.  A hit costs one set lookup; a miss in every TLB
+   walks the two levels of the page table, and refills both TLBs.
+ *****************************************************************************/
+
+#define PAGE_OFFSET_BITS 14                 /* log2(PHYSICAL_PAGE_SIZE) */
+#define PAGE_TABLE_BITS 9                   /* entries of each level: (32 - 14) / 2 bits */
+#define PAGE_TABLE_ENTRIES (1u << PAGE_TABLE_BITS)
+
+typedef struct {
+  word physical_page;
+  int valid;
+} pageTableEntry;
+
+typedef struct {
+  word virtual_page;
+  word physical_page;
+  int valid;
+  unsigned long long used;                  /* for LRU replacement */
+} tlbEntry;
+
+typedef struct {
+  tlbConfig config;
+  tlbEntry* entry;                          /* sets * assoc entries, set by set */
+  unsigned long long hits;
+  unsigned long long misses;
+} tlbLevel;
+
+static pageTableEntry* directory[PAGE_TABLE_ENTRIES];
+static unsigned int physical_pages;
+static unsigned int mapped_pages;
+static unsigned long long page_walks;
+static unsigned long long page_faults;
+
+static tlbLevel tlb[TLB_LEVEL_COUNT] = {
+  { .config = { 8, 4 } }                    /* 32 entries, no second level */
+};
+static unsigned long long tlb_clock;
+
+/*
+  Unmaps every page and empties the TLBs, with pages physical pages to map
+  pages to.  Called when physical memory is reset.
+*/
+void reset_page_table(unsigned int pages)
+{
+  unsigned int i;
+
+  for(i = 0; i < PAGE_TABLE_ENTRIES; i++)
+  {
+    free(directory[i]);
+    directory[i] = NULL;
+  }
+
+  physical_pages = pages;
+  mapped_pages = 0;
+  page_faults = 0;
+  flush_tlbs();
+}
+
+/*
+  Empties the TLBs, as configured, and clears their counters and the count
+  of page walks.  Called when the cache is flushed.
+
+  returns 0 if successful, non-zero if they could not be allocated.
+*/
+int flush_tlbs(void)
+{
+  tlbLevel* t;
+  int error = 0;
+  int id;
+
+  for(id = 0; id < TLB_LEVEL_COUNT; id++)
+  {
+    t = &tlb[id];
+    free(t->entry);
+    t->entry = NULL;
+    t->hits = 0;
+    t->misses = 0;
+    if(t->config.sets != 0 && (t->entry = (tlbEntry*)calloc(t->config.sets * t->config.assoc, sizeof(tlbEntry))) == NULL)
+    {
+      t->config.sets = 0;
+      error = -1;
+    }
+  }
+
+  tlb_clock = 0;
+  page_walks = 0;
+  return error;
+}
+
+/*
+  Sets the sets and ways of a TLB level; 0 sets removes it.  Empties the TLBs.
+
+  returns 0 if successful, non-zero if the TLB could not be allocated.
+*/
+int configure_tlb(TlbLevelId id, unsigned int sets, unsigned int assoc)
+{
+  if(sets != 0 && ((sets & (sets - 1)) != 0 || assoc == 0))
+    return -1;
+
+  tlb[id].config.sets = sets;
+  tlb[id].config.assoc = sets != 0 ? assoc : 0;
+  return flush_tlbs();
+}
+
+const tlbConfig* tlb_config(TlbLevelId id)
+{
+  return &tlb[id].config;
+}
+
+/* returns the page table entry of virtual_page, allocating its page table if allocate is set, or NULL */
+static pageTableEntry* find_page(word virtual_page, int allocate)
+{
+  pageTableEntry** table = &directory[virtual_page >> PAGE_TABLE_BITS];
+
+  if(*table == NULL && (!allocate || (*table = (pageTableEntry*)calloc(PAGE_TABLE_ENTRIES, sizeof(pageTableEntry))) == NULL))
+    return NULL;
+
+  return &(*table)[virtual_page & (PAGE_TABLE_ENTRIES - 1)];
+}
+
+/* returns the entry of a TLB level holding virtual_page, or NULL */
+static tlbEntry* tlb_lookup(tlbLevel* t, word virtual_page)
+{
+  tlbEntry* set = &t->entry[(virtual_page & (t->config.sets - 1)) * t->config.assoc];
+  unsigned int i;
+
+  for(i = 0; i < t->config.assoc; i++)
+  {
+    if(set[i].valid && set[i].virtual_page == virtual_page)
+      return &set[i];
+  }
+
+  return NULL;
+}
+
+/* Puts a translation into a TLB level, replacing the least recently used entry of its set */
+static void tlb_fill(tlbLevel* t, word virtual_page, word physical_page)
+{
+  tlbEntry* set = &t->entry[(virtual_page & (t->config.sets - 1)) * t->config.assoc];
+  tlbEntry* victim = &set[0];
+  unsigned int i;
+
+  for(i = 0; i < t->config.assoc; i++)
+  {
+    if(!set[i].valid)
+    {
+      victim = &set[i];
+      break;
+    }
+    if(set[i].used < victim->used)
+      victim = &set[i];
+  }
+
+  victim->valid = 1;
+  victim->virtual_page = virtual_page;
+  victim->physical_page = physical_page;
+  victim->used = ++tlb_clock;
+}
+
+/*
+  Translates the virtual address of a transfer to DRAM, through the TLBs,
+  mapping its page if it is touched for the first time
+
+  returns 0 if successful, non-zero if physical memory is full.
+*/
+int translate_address(address virtual_addr, address* physical_addr)
+{
+  word virtual_page = virtual_addr >> PAGE_OFFSET_BITS;
+  pageTableEntry* page;
+  tlbEntry* hit = NULL;
+  int id;
+
+  for(id = 0; id < TLB_LEVEL_COUNT; id++)
+  {
+    if(tlb[id].entry == NULL)
+      continue;
+    if((hit = tlb_lookup(&tlb[id], virtual_page)) != NULL)
+    {
+      tlb[id].hits++;
+      hit->used = ++tlb_clock;
+      break;
+    }
+    tlb[id].misses++;
+  }
+
+  if(hit == NULL)
+  {
+    page_walks++;
+    if((page = find_page(virtual_page, 1)) == NULL)
+      return -1;
+    if(!page->valid)
+    {
+      if(mapped_pages == physical_pages)
+	return -1;
+      page_faults++;
+      page->physical_page = mapped_pages++;
+      page->valid = 1;
+    }
+
+    for(id = 0; id < TLB_LEVEL_COUNT; id++)
+    {
+      if(tlb[id].entry != NULL)
+	tlb_fill(&tlb[id], virtual_page, page->physical_page);
+    }
+    *physical_addr = (page->physical_page << PAGE_OFFSET_BITS) | (virtual_addr & (PHYSICAL_PAGE_SIZE - 1));
+    return 0;
+  }
+
+  /* a hit in the second level moves the translation up into the first */
+  if(id == TLB_L2 && tlb[TLB_L1].entry != NULL)
+    tlb_fill(&tlb[TLB_L1], virtual_page, hit->physical_page);
+
+  *physical_addr = (hit->physical_page << PAGE_OFFSET_BITS) | (virtual_addr & (PHYSICAL_PAGE_SIZE - 1));
+  return 0;
+}
+
+/*
+  Checks that the pages of size bytes from virtual_addr on that are not
+  mapped yet fit in the physical pages left, without mapping any of them
+
+  returns 0 if they fit, non-zero if physical memory is too small.
+*/
+int check_free_pages(address virtual_addr, unsigned int size)
+{
+  word first = virtual_addr >> PAGE_OFFSET_BITS;
+  word last = (virtual_addr + size - 1) >> PAGE_OFFSET_BITS;
+  pageTableEntry* page;
+  unsigned int needed = 0;
+  word virtual_page;
+
+  if(size == 0)
+    return 0;
+  if(last < first)
+    return -1;
+
+  for(virtual_page = first; virtual_page <= last && needed <= physical_pages - mapped_pages; virtual_page++)
+  {
+    page = find_page(virtual_page, 0);
+    needed += (page == NULL || !page->valid);
+  }
+
+  return needed > physical_pages - mapped_pages;
+}
+
+/*
+  Translates a virtual address from the page table alone, for the reports
+  that show what is stored at an address; nothing is mapped or counted
+
+  returns 0 if successful, non-zero if the page is not mapped.
+*/
+int lookup_address(address virtual_addr, address* physical_addr)
+{
+  pageTableEntry* page = find_page(virtual_addr >> PAGE_OFFSET_BITS, 0);
+
+  if(page == NULL || !page->valid)
+    return -1;
+
+  *physical_addr = (page->physical_page << PAGE_OFFSET_BITS) | (virtual_addr & (PHYSICAL_PAGE_SIZE - 1));
+  return 0;
+}
+
+/* Prints the TLB hits and misses, the page walks and the use of physical memory */
+void report_vm(FILE* out)
+{
+  const tlbLevel* t;
+  unsigned long long lookups;
+  int id;
+
+  fprintf(out, "Physical memory: %u of %u pages of %u bytes mapped, %llu page faults\n", mapped_pages, physical_pages,
+	  PHYSICAL_PAGE_SIZE, page_faults);
+
+  fprintf(out, "\nTLB    Sets  Assoc       Hits     Misses  Miss Rate\n");
+  for(id = 0; id < TLB_LEVEL_COUNT; id++)
+  {
+    t = &tlb[id];
+    if(t->entry == NULL)
+      continue;
+
+    lookups = t->hits + t->misses;
+    fprintf(out, "%-5s  %4u  %5u  %9llu  %9llu  %8.2f%%\n", (id == TLB_L1 ? "L1" : "L2"), t->config.sets, t->config.assoc,
+	    t->hits, t->misses, (lookups == 0 ? 0.0 : 100.0 * t->misses / lookups));
+  }
+
+  fprintf(out, "\nPage walks: %llu\n", page_walks);
+}